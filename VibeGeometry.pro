@@ -1,15 +1,25 @@
-QT += widgets printsupport
+QT += widgets printsupport concurrent
 
 CONFIG += c++17
 
 TEMPLATE = app
 TARGET = VibeGeometry
 
+include(core.pri)
+
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
-    canvaswidget.cpp
+    canvaswidget.cpp \
+    framestats.cpp \
+    labellayout.cpp \
+    tilerenderer.cpp \
+    viewport.cpp
 
 HEADERS += \
     mainwindow.h \
-    canvaswidget.h
+    canvaswidget.h \
+    framestats.h \
+    labellayout.h \
+    tilerenderer.h \
+    viewport.h
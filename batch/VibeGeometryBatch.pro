@@ -0,0 +1,13 @@
+# Headless batch runner: plays a macro over scene files without a window.
+QT = core
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = VibeGeometryBatch
+
+include(../core.pri)
+
+SOURCES += \
+    main.cpp
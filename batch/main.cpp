@@ -0,0 +1,190 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+#include <algorithm>
+
+#include "macro.h"
+#include "sceneeditor.h"
+#include "scenefile.h"
+
+namespace {
+// Process exit codes; with several scenes the highest one wins.
+enum ExitCode {
+    Ok = 0,
+    UsageError = 1,
+    MacroError = 2,
+    SceneError = 3,
+    CommandError = 4,
+    SaveError = 5
+};
+
+bool readMacro(const QString &path, Macro &macro, int &rejected) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    QStringList lines;
+    while (!file.atEnd()) {
+        lines.append(QString::fromUtf8(file.readLine()));
+    }
+    rejected = macro.appendLines(lines);
+    return true;
+}
+
+bool parseFormat(const QString &name, SceneFile::Format &format) {
+    static const QHash<QString, SceneFile::Format> formats = {
+        {"json", SceneFile::Format::Json},
+        {"binary", SceneFile::Format::Binary},
+        {"tiled", SceneFile::Format::Tiled},
+        {"compressed", SceneFile::Format::Compressed},
+        {"chunked", SceneFile::Format::Chunked},
+    };
+    if (!formats.contains(name)) {
+        return false;
+    }
+    format = formats.value(name);
+    return true;
+}
+
+// The file suffix SceneFile::formatForPath maps to format.
+QString suffixFor(SceneFile::Format format) {
+    switch (format) {
+    case SceneFile::Format::Binary: return "vgb";
+    case SceneFile::Format::Tiled: return "vgt";
+    case SceneFile::Format::Compressed: return "vgz";
+    case SceneFile::Format::Chunked: return "vgc";
+    default: return "json";
+    }
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("VibeGeometryBatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Plays a macro over scene files without a window: loads each scene, runs the macro, adds every "
+        "intersection point and saves the result.\n\n"
+        "Exit codes: 0 success, 1 usage, 2 macro unreadable, 3 scene unreadable, "
+        "4 macro command failed (--strict), 5 save failed.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("macro", "Macro file, as saved by the application.");
+    parser.addPositionalArgument("scenes", "Scene files to process.", "<scene>...");
+    const QCommandLineOption outputOption({"o", "output"},
+                                          "Output file for a single scene, or a directory the results are written "
+                                          "into under their own names.",
+                                          "path");
+    const QCommandLineOption formatOption("format", "Output format: json, binary, tiled, compressed or chunked. "
+                                                    "Defaults to the one matching the output name; results "
+                                                    "written into a directory take its suffix.",
+                                          "format");
+    const QCommandLineOption compactOption("compact", "Write JSON on one line without indentation.");
+    const QCommandLineOption noIntersectionsOption("no-intersections", "Do not add intersection points after the macro.");
+    const QCommandLineOption strictOption("strict", "Fail on unrecognized macro lines and on commands that change nothing.");
+    parser.addOption(outputOption);
+    parser.addOption(formatOption);
+    parser.addOption(compactOption);
+    parser.addOption(noIntersectionsOption);
+    parser.addOption(strictOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 2 || !parser.isSet(outputOption)) {
+        err << "Expected a macro, at least one scene and --output.\n\n" << parser.helpText();
+        return UsageError;
+    }
+    SceneFile::Format format = SceneFile::Format::Json;
+    const bool explicitFormat = parser.isSet(formatOption);
+    if (explicitFormat && !parseFormat(parser.value(formatOption).toLower(), format)) {
+        err << "Unknown format: " << parser.value(formatOption) << "\n";
+        return UsageError;
+    }
+    const QStringList scenes = args.mid(1);
+    const QString output = parser.value(outputOption);
+    const bool toDirectory = scenes.size() > 1 || QFileInfo(output).isDir();
+    if (!toDirectory && explicitFormat && SceneFile::formatForPath(output) != format) {
+        err << "Output " << output << " does not end in ." << suffixFor(format) << " as --format "
+            << parser.value(formatOption) << " requires.\n";
+        return UsageError;
+    }
+    if (toDirectory && !QDir().mkpath(output)) {
+        err << "Cannot create output directory " << output << "\n";
+        return SaveError;
+    }
+    const bool strict = parser.isSet(strictOption);
+
+    Macro macro;
+    int rejected = 0;
+    if (!readMacro(args.first(), macro, rejected)) {
+        err << "Cannot read macro " << args.first() << "\n";
+        return MacroError;
+    }
+    if (rejected > 0) {
+        err << "Skipped " << rejected << " unrecognized macro lines in " << args.first() << "\n";
+        if (strict) {
+            return MacroError;
+        }
+    }
+
+    int result = Ok;
+    QElapsedTimer total;
+    total.start();
+    for (const QString &path : scenes) {
+        QElapsedTimer phase;
+        phase.start();
+        SceneEditor editor;
+        if (!editor.open(path)) {
+            err << path << ": cannot read scene\n";
+            result = std::max(result, int(SceneError));
+            continue;
+        }
+        const qint64 loadMs = phase.restart();
+
+        int applied = 0;
+        for (int i = 0; i < macro.size(); ++i) {
+            if (editor.run(macro, i)) {
+                ++applied;
+            } else if (strict) {
+                err << path << ": command " << i + 1 << " changed nothing: " << macro.line(i) << "\n";
+            }
+        }
+        const qint64 macroMs = phase.restart();
+
+        const int intersections = parser.isSet(noIntersectionsOption) ? 0 : editor.addAllIntersections();
+        const qint64 intersectionMs = phase.restart();
+
+        // Results in a directory keep their names, with the suffix of the format they are written in.
+        const QFileInfo source(path);
+        const QString name = explicitFormat ? source.completeBaseName() + "." + suffixFor(format) : source.fileName();
+        const QString target = toDirectory ? QDir(output).filePath(name) : output;
+        SceneFile::WriteOptions options;
+        options.format = explicitFormat ? format : SceneFile::formatForPath(target);
+        options.compact = parser.isSet(compactOption);
+        if (!editor.save(target, options)) {
+            err << path << ": cannot write " << target << "\n";
+            result = std::max(result, int(SaveError));
+            continue;
+        }
+        const qint64 saveMs = phase.elapsed();
+
+        const Scene &scene = editor.scene();
+        out << path << " -> " << target << ": " << applied << " of " << macro.size() << " commands, "
+            << intersections << " intersection points, " << scene.points.size() << " points, "
+            << scene.lines.size() + scene.extendedLines.size() << " lines, " << scene.circles.size() << " circles; "
+            << "load " << loadMs << " ms, macro " << macroMs << " ms, intersections " << intersectionMs
+            << " ms, save " << saveMs << " ms" << Qt::endl;
+        if (strict && applied < macro.size()) {
+            result = std::max(result, int(CommandError));
+        }
+    }
+    out << "Processed " << scenes.size() << " scenes in " << total.elapsed() << " ms\n";
+    return result;
+}
@@ -0,0 +1,270 @@
+#include "binaryscene.h"
+
+#include <QFile>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+#include <cstring>
+
+#include "sceneformat.h"
+
+namespace {
+const char magic[8] = {'V', 'G', 'B', 'S', 'C', 'E', 'N', 'E'};
+const char cacheMagic[8] = {'V', 'G', 'B', 'C', 'A', 'C', 'H', 'E'};
+
+enum Count { PointCount, LineCount, ExtendedCount, CircleCount, StringCount, CountCount };
+
+enum Column {
+    PointX, PointY, PointLabel,
+    LineA, LineB, LineLabel,
+    ExtendedAx, ExtendedAy, ExtendedBx, ExtendedBy, ExtendedLabel,
+    CircleX, CircleY, CircleR, CircleLabel,
+    StringOffsets, StringData,
+    ColumnCount
+};
+
+constexpr quint64 headerSize = 8 + 4 + 4 + 8 * CountCount + 8 * ColumnCount + 8;
+
+using SceneFormat::align8;
+using SceneFormat::at;
+
+quint64 elementSize(int column) {
+    switch (column) {
+    case PointLabel:
+    case LineA:
+    case LineB:
+    case LineLabel:
+    case ExtendedLabel:
+    case CircleLabel:
+        return 4;
+    case StringData:
+        return 1;
+    default:
+        return 8;
+    }
+}
+
+// Number of elements in a column given the object counts.
+quint64 columnLength(int column, const quint64 *counts, quint64 stringBytes) {
+    if (column <= PointLabel) return counts[PointCount];
+    if (column <= LineLabel) return counts[LineCount];
+    if (column <= ExtendedLabel) return counts[ExtendedCount];
+    if (column <= CircleLabel) return counts[CircleCount];
+    if (column == StringOffsets) return counts[StringCount] + 1;
+    return stringBytes;
+}
+
+// Buffers small little-endian writes into large QIODevice::write calls.
+class ColumnWriter {
+public:
+    explicit ColumnWriter(QIODevice &device) : device(device) { buffer.reserve(chunk); }
+
+    template <typename T>
+    void put(T value) {
+        const T le = qToLittleEndian(value);
+        buffer.append(reinterpret_cast<const char *>(&le), sizeof(T));
+        written += sizeof(T);
+        if (buffer.size() >= chunk) flush();
+    }
+    void putBytes(const QByteArray &bytes) {
+        buffer.append(bytes);
+        written += quint64(bytes.size());
+        if (buffer.size() >= chunk) flush();
+    }
+    void padTo(quint64 offset) {
+        while (written < offset) put<quint8>(0);
+    }
+    bool flush() {
+        if (!buffer.isEmpty() && device.write(buffer) != buffer.size()) ok = false;
+        buffer.resize(0);
+        return ok;
+    }
+
+private:
+    static constexpr int chunk = 1 << 20;
+    QIODevice &device;
+    QByteArray buffer;
+    quint64 written = 0;
+    bool ok = true;
+};
+
+// Validates the header and every column extent against the mapped size before anything is read.
+bool readMapped(const uchar *base, quint64 size, Scene &scene) {
+    if (size < headerSize || std::memcmp(base, magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    if (at<quint32>(base, 8, 0) != BinaryScene::version || at<quint32>(base, 12, 0) != ColumnCount) {
+        return false;
+    }
+    quint64 counts[CountCount];
+    for (int i = 0; i < CountCount; ++i) {
+        counts[i] = at<quint64>(base, 16, i);
+        if (counts[i] > size) return false;
+    }
+    quint64 offsets[ColumnCount];
+    for (int i = 0; i < ColumnCount; ++i) {
+        offsets[i] = at<quint64>(base, 16 + 8 * CountCount, i);
+    }
+    const quint64 stringBytes = at<quint64>(base, 16 + 8 * CountCount + 8 * ColumnCount, 0);
+    if (counts[StringCount] < 1 || stringBytes > size) {
+        return false;
+    }
+    for (int i = 0; i < ColumnCount; ++i) {
+        const quint64 bytes = columnLength(i, counts, stringBytes) * elementSize(i);
+        if (offsets[i] % 8 != 0 || offsets[i] < headerSize || offsets[i] > size || bytes > size - offsets[i]) {
+            return false;
+        }
+    }
+
+    const quint64 stringCount = counts[StringCount];
+    QVector<QString> strings(int(stringCount));
+    quint64 previous = 0;
+    for (quint64 i = 0; i < stringCount; ++i) {
+        const quint64 begin = at<quint64>(base, offsets[StringOffsets], i);
+        const quint64 end = at<quint64>(base, offsets[StringOffsets], i + 1);
+        if (begin != previous || end < begin || end > stringBytes) return false;
+        strings[int(i)] = QString::fromUtf8(reinterpret_cast<const char *>(base + offsets[StringData] + begin), int(end - begin));
+        previous = end;
+    }
+    auto label = [&](int column, quint64 i, QString &out) {
+        const quint32 id = at<quint32>(base, offsets[column], i);
+        if (id >= stringCount) return false;
+        out = strings[int(id)];
+        return true;
+    };
+
+    Scene loaded;
+    QString text;
+    loaded.points.reserve(int(counts[PointCount]));
+    for (quint64 i = 0; i < counts[PointCount]; ++i) {
+        if (!label(PointLabel, i, text)) return false;
+        loaded.points.append(Scene::Point(QPointF(at<double>(base, offsets[PointX], i), at<double>(base, offsets[PointY], i)), text));
+    }
+    loaded.lines.reserve(int(counts[LineCount]));
+    for (quint64 i = 0; i < counts[LineCount]; ++i) {
+        if (!label(LineLabel, i, text)) return false;
+        loaded.lines.append(Scene::Line(at<qint32>(base, offsets[LineA], i), at<qint32>(base, offsets[LineB], i), text));
+    }
+    loaded.extendedLines.reserve(int(counts[ExtendedCount]));
+    for (quint64 i = 0; i < counts[ExtendedCount]; ++i) {
+        if (!label(ExtendedLabel, i, text)) return false;
+        loaded.extendedLines.append(Scene::ExtendedLine(
+            QPointF(at<double>(base, offsets[ExtendedAx], i), at<double>(base, offsets[ExtendedAy], i)),
+            QPointF(at<double>(base, offsets[ExtendedBx], i), at<double>(base, offsets[ExtendedBy], i)), text));
+    }
+    loaded.circles.reserve(int(counts[CircleCount]));
+    for (quint64 i = 0; i < counts[CircleCount]; ++i) {
+        if (!label(CircleLabel, i, text)) return false;
+        loaded.circles.append(Scene::Circle(QPointF(at<double>(base, offsets[CircleX], i), at<double>(base, offsets[CircleY], i)),
+                                            at<double>(base, offsets[CircleR], i), text));
+    }
+    scene = std::move(loaded);
+    return true;
+}
+}  // namespace
+
+bool BinaryScene::matches(const QByteArray &head) {
+    return head.size() >= int(sizeof(magic)) && std::memcmp(head.constData(), magic, sizeof(magic)) == 0;
+}
+
+bool BinaryScene::read(QFile &file, Scene &scene, QByteArray *cache) {
+    const qint64 size = file.size();
+    if (size < qint64(headerSize)) {
+        return false;
+    }
+    uchar *base = file.map(0, size);
+    if (!base) {
+        return false;
+    }
+    const bool ok = readMapped(base, quint64(size), scene);
+    if (ok && cache) {
+        cache->clear();
+        const quint64 end = quint64(size);
+        if (end >= headerSize + 16 && std::memcmp(base + end - 8, cacheMagic, sizeof(cacheMagic)) == 0) {
+            const quint64 bytes = at<quint64>(base, end - 16, 0);
+            if (bytes <= end - headerSize - 16) {
+                *cache = QByteArray(reinterpret_cast<const char *>(base + end - 16 - bytes), int(bytes));
+            }
+        }
+    }
+    file.unmap(base);
+    return ok;
+}
+
+bool BinaryScene::read(const uchar *data, quint64 size, Scene &scene) {
+    return readMapped(data, size, scene);
+}
+
+bool BinaryScene::write(QIODevice &device, const Scene &scene, const QByteArray &cache) {
+    const SceneFormat::Labels labels(scene);
+
+    quint64 counts[CountCount];
+    counts[PointCount] = quint64(scene.points.size());
+    counts[LineCount] = quint64(scene.lines.size());
+    counts[ExtendedCount] = quint64(scene.extendedLines.size());
+    counts[CircleCount] = quint64(scene.circles.size());
+    counts[StringCount] = quint64(labels.size());
+    const quint64 stringBytes = quint64(labels.data.size());
+    quint64 offsets[ColumnCount];
+    quint64 cursor = align8(headerSize);
+    for (int i = 0; i < ColumnCount; ++i) {
+        offsets[i] = cursor;
+        cursor = align8(cursor + columnLength(i, counts, stringBytes) * elementSize(i));
+    }
+
+    ColumnWriter out(device);
+    out.putBytes(QByteArray(magic, sizeof(magic)));
+    out.put<quint32>(version);
+    out.put<quint32>(ColumnCount);
+    for (quint64 count : counts) out.put<quint64>(count);
+    for (quint64 offset : offsets) out.put<quint64>(offset);
+    out.put<quint64>(stringBytes);
+
+    out.padTo(offsets[PointX]);
+    for (const auto &p : scene.points) out.put<double>(p.positiom.x());
+    out.padTo(offsets[PointY]);
+    for (const auto &p : scene.points) out.put<double>(p.positiom.y());
+    out.padTo(offsets[PointLabel]);
+    for (quint32 id : labels.points) out.put<quint32>(id);
+
+    out.padTo(offsets[LineA]);
+    for (const auto &l : scene.lines) out.put<qint32>(l.a);
+    out.padTo(offsets[LineB]);
+    for (const auto &l : scene.lines) out.put<qint32>(l.b);
+    out.padTo(offsets[LineLabel]);
+    for (quint32 id : labels.lines) out.put<quint32>(id);
+
+    out.padTo(offsets[ExtendedAx]);
+    for (const auto &l : scene.extendedLines) out.put<double>(l.a.x());
+    out.padTo(offsets[ExtendedAy]);
+    for (const auto &l : scene.extendedLines) out.put<double>(l.a.y());
+    out.padTo(offsets[ExtendedBx]);
+    for (const auto &l : scene.extendedLines) out.put<double>(l.b.x());
+    out.padTo(offsets[ExtendedBy]);
+    for (const auto &l : scene.extendedLines) out.put<double>(l.b.y());
+    out.padTo(offsets[ExtendedLabel]);
+    for (quint32 id : labels.extendedLines) out.put<quint32>(id);
+
+    out.padTo(offsets[CircleX]);
+    for (const auto &c : scene.circles) out.put<double>(c.center.x());
+    out.padTo(offsets[CircleY]);
+    for (const auto &c : scene.circles) out.put<double>(c.center.y());
+    out.padTo(offsets[CircleR]);
+    for (const auto &c : scene.circles) out.put<double>(c.radius);
+    out.padTo(offsets[CircleLabel]);
+    for (quint32 id : labels.circles) out.put<quint32>(id);
+
+    out.padTo(offsets[StringOffsets]);
+    for (quint64 offset : labels.offsets) out.put<quint64>(offset);
+    out.padTo(offsets[StringData]);
+    out.putBytes(labels.data);
+
+    if (!cache.isEmpty()) {
+        out.padTo(cursor);
+        out.putBytes(cache);
+        out.put<quint64>(quint64(cache.size()));
+        out.putBytes(QByteArray(cacheMagic, sizeof(cacheMagic)));
+    }
+    return out.flush();
+}
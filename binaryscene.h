@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include "scene.h"
+
+class QFile;
+class QIODevice;
+
+// Versioned binary scene format. Each object type is stored as a set of
+// packed little-endian columns (structure of arrays) and labels are
+// interned in one UTF-8 string table, so loading maps the file and copies
+// straight out of the columns without tokenizing anything.
+//
+// Layout, every column starting on an 8-byte boundary:
+//   header    magic "VGBSCENE", u32 version, u32 column count,
+//             u64 counts[points, lines, extended lines, circles, strings],
+//             u64 column offsets[ColumnCount], u64 string data size
+//   points    f64 x[], f64 y[], u32 label[]
+//   lines     i32 a[], i32 b[], u32 label[]
+//   extended  f64 ax[], f64 ay[], f64 bx[], f64 by[], u32 label[]
+//   circles   f64 x[], f64 y[], f64 r[], u32 label[]
+//   strings   u64 offsets[strings + 1], u8 data[]
+//   cache     optional: u8 data[], u64 size, magic "VGBCACHE"
+// String 0 is always the empty label. The cache trailer holds derived data
+// (see SceneCache) and is found from the end of the file; readers that do not
+// know it ignore it.
+class BinaryScene {
+public:
+    static constexpr quint32 version = 1;
+
+    // True when data starts with the binary scene magic.
+    static bool matches(const QByteArray &head);
+    // Copies the cache trailer, if any, into cache.
+    static bool read(QFile &file, Scene &scene, QByteArray *cache = nullptr);
+    // Reads a scene held in memory, e.g. embedded in another file.
+    static bool read(const uchar *data, quint64 size, Scene &scene);
+    static bool write(QIODevice &device, const Scene &scene, const QByteArray &cache = QByteArray());
+};
@@ -1,135 +1,358 @@
 #include "canvaswidget.h"
 
 #include <QPainter>
+#include <QPen>
 #include <QtMath>
-#include <QFile>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QDir>
-#include <QFileInfo>
 #include <QMouseEvent>
+#include <QResizeEvent>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QRandomGenerator>
+#include <QScreen>
+#include <QLineF>
+#include <QWheelEvent>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QLockFile>
+#include <QtConcurrent/QtConcurrentRun>
 #include <limits>
 #include <algorithm>
 #include <QList>
 #include <cmath>
 #include <vector>
 
+#include "geometry.h"
+#include "scenecache.h"
+#include "scenefile.h"
+
 namespace {
-bool segmentIntersection(const QPointF &p, const QPointF &p2, const QPointF &q, const QPointF &q2, QPointF &out) {
-    QPointF r = p2 - p;
-    QPointF s = q2 - q;
-    double denom = r.x() * s.y() - r.y() * s.x();
-    if (std::abs(denom) < 1e-9) {
-        return false;  // parallel or colinear
-    }
-    QPointF qp = q - p;
-    double t = (qp.x() * s.y() - qp.y() * s.x()) / denom;
-    double u = (qp.x() * r.y() - qp.y() * r.x()) / denom;
-    if (t >= -1e-9 && t <= 1.0 + 1e-9 && u >= -1e-9 && u <= 1.0 + 1e-9) {
-        out = p + t * r;
-        return true;
+bool isTiledFile(const QString &path) {
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) && TiledScene::matches(file.peek(8));
+}
+
+double pointToSegmentDistance(const QPointF &p, const QPointF &a, const QPointF &b, bool infinite) {
+    const double dx = b.x() - a.x();
+    const double dy = b.y() - a.y();
+    const double len2 = dx * dx + dy * dy;
+    if (len2 == 0.0) {
+        double dxp = p.x() - a.x();
+        double dyp = p.y() - a.y();
+        return std::sqrt(dxp * dxp + dyp * dyp);
     }
-    return false;
+    double t = ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / len2;
+    if (!infinite) {
+        t = std::clamp(t, 0.0, 1.0);
+    }
+    QPointF proj(a.x() + t * dx, a.y() + t * dy);
+    double dxp = p.x() - proj.x();
+    double dyp = p.y() - proj.y();
+    return std::sqrt(dxp * dxp + dyp * dyp);
 }
 
-std::vector<QPointF> segmentCircleIntersections(const QPointF &p1, const QPointF &p2, const QPointF &c, double r) {
-    std::vector<QPointF> hits;
-    QPointF d = p2 - p1;
-    double A = d.x() * d.x() + d.y() * d.y();
-    if (A < 1e-12) return hits;
-    QPointF f = p1 - c;
-    double B = 2.0 * (f.x() * d.x() + f.y() * d.y());
-    double C = f.x() * f.x() + f.y() * f.y() - r * r;
-    double disc = B * B - 4 * A * C;
-    if (disc < 0.0) return hits;
-    double sqrtDisc = std::sqrt(std::max(0.0, disc));
-    double t1 = (-B - sqrtDisc) / (2 * A);
-    double t2 = (-B + sqrtDisc) / (2 * A);
-    auto addIf = [&](double t) {
-        if (t >= -1e-9 && t <= 1.0 + 1e-9) {
-            hits.push_back(p1 + t * d);
-        }
-    };
-    addIf(t1);
-    if (disc > 1e-12) addIf(t2);
-    return hits;
-}
-
-std::vector<QPointF> circleCircleIntersections(const QPointF &c0, double r0, const QPointF &c1, double r1) {
-    std::vector<QPointF> hits;
-    double dx = c1.x() - c0.x();
-    double dy = c1.y() - c0.y();
-    double d = std::hypot(dx, dy);
-    if (d < 1e-9 || d > r0 + r1 || d < std::abs(r0 - r1)) {
-        return hits;
-    }
-    double a = (r0 * r0 - r1 * r1 + d * d) / (2 * d);
-    double h2 = r0 * r0 - a * a;
-    if (h2 < 0.0) return hits;
-    double h = std::sqrt(std::max(0.0, h2));
-    QPointF p2(c0.x() + a * dx / d, c0.y() + a * dy / d);
-    double rx = -dy * (h / d);
-    double ry = dx * (h / d);
-    hits.push_back(QPointF(p2.x() + rx, p2.y() + ry));
-    if (h > 1e-9) hits.push_back(QPointF(p2.x() - rx, p2.y() - ry));
-    return hits;
+// Screen-space growth of object bounds for culling: the widest pen or point marker.
+const double cullMargin = 8.0;
+
+void addDirtyRect(QRegion &region, const QRect &rect) {
+    // Scattered bulk edits (e.g. intersections) collapse to their bounding box to keep QRegion cheap.
+    if (region.rectCount() >= 64) {
+        region = QRegion(region.boundingRect().united(rect));
+    } else {
+        region += rect;
+    }
 }
 }  // namespace
 
 CanvasWidget::CanvasWidget(const QString &storagePath, QWidget *parent)
     : QWidget(parent),
       storagePath(storagePath) {
+    editor.setObserver(this);
+    editor.setIntersectionCache(&intersectionCache);
     setMinimumSize(320, 240);
+    setMouseTracking(true);
+    viewport.setWidgetSize(size());
+    hoverTimer = new QTimer(this);
+    hoverTimer->setSingleShot(true);
+    hoverTimer->setTimerType(Qt::PreciseTimer);
+    connect(hoverTimer, &QTimer::timeout, this, &CanvasWidget::updateHover);
+    inputClock.start();
+    compactTimer = new QTimer(this);
+    compactTimer->setInterval(30000);
+    connect(compactTimer, &QTimer::timeout, this, &CanvasWidget::compactJournal);
+    compactTimer->start();
+    if (storagePath.isEmpty()) {
+        startSession(Scene());
+    }
 }
 
-bool CanvasWidget::addPoint(const QPointF &point, const QString &label, bool selectNew) {
-    if (hasPoint(point)) {
-        return false;
+CanvasWidget::~CanvasWidget() {
+    // Let an in-flight background save finish writing before the process can exit. Its finished
+    // signal is not delivered any more, so a save queued behind it runs here, synchronously.
+    if (saveWatcher) {
+        saveWatcher->waitForFinished();
     }
-    points.append(Point(point, label));
-    if (selectNew) {
-        int newIndex = points.size() - 1;
-        selectedPointIndices.insert(newIndex);
-        pointSelectionOrder.removeAll(newIndex);
-        pointSelectionOrder.append(newIndex);
+    if (!pendingSavePath.isEmpty()) {
+        const QString next = pendingSavePath;
+        pendingSavePath.clear();
+        saveToFile(next, pendingSaveCompact);
     }
-    emit pointAdded(point);
-    update();
-    return true;
+    // Unsaved untitled work stays in its session, offered again at the next start.
+    journal.detach();
+    closeSession(true);
 }
 
-bool CanvasWidget::hasPoint(const QPointF &point) const {
-    for (const auto &p : points) {
-        if (qFuzzyCompare(p.positiom.x(), point.x()) && qFuzzyCompare(p.positiom.y(), point.y())) {
-            return true;
-        }
+void CanvasWidget::sceneChanged() {
+    ++sceneRevision;
+    ++structureRevision;
+    ++labelRevision;
+    staticLayerValid = false;
+    staticDirty = QRegion();
+    invalidateRect(rect());
+    // Indices may have shifted; resolve the hovered object again.
+    hoverIndex = -1;
+    if (underMouse()) {
+        scheduleHover();
+    }
+}
+
+void CanvasWidget::objectChanged(ObjectKind kind, int index, bool labelsAffected) {
+    if (labelsAffected) {
+        sceneChanged();
+        return;
+    }
+    ++sceneRevision;
+    ++structureRevision;
+    QRect bounds = objectScreenBounds(kind, index);
+    addDirtyRect(staticDirty, bounds);
+    invalidateRect(bounds);
+}
+
+void CanvasWidget::invalidateObject(ObjectKind kind, int index) {
+    invalidateRect(objectScreenBounds(kind, index));
+}
+
+void CanvasWidget::invalidateSelection() {
+    for (int idx : selectedPointIndices()) invalidateObject(ObjectKind::Point, idx);
+    for (int idx : selectedLineIndices()) invalidateObject(ObjectKind::Line, idx);
+    for (int idx : selectedExtendedLineIndices()) invalidateObject(ObjectKind::ExtendedLine, idx);
+    for (int idx : selectedCircleIndices()) invalidateObject(ObjectKind::Circle, idx);
+}
+
+void CanvasWidget::invalidateRect(const QRect &rect) {
+    if (rect.isEmpty()) {
+        return;
+    }
+    addDirtyRect(pendingDirty, rect);
+    // Flush once per event loop iteration so bursts of edits become a single update().
+    if (!dirtyFlushQueued) {
+        dirtyFlushQueued = true;
+        QMetaObject::invokeMethod(this, &CanvasWidget::flushDirty, Qt::QueuedConnection);
+    }
+}
+
+void CanvasWidget::flushDirty() {
+    dirtyFlushQueued = false;
+    if (!pendingDirty.isEmpty()) {
+        update(pendingDirty);
+        pendingDirty = QRegion();
+    }
+}
+
+bool CanvasWidget::objectWorldBounds(ObjectKind kind, int index, QRectF &bounds) const {
+    switch (kind) {
+    case ObjectKind::Point:
+        if (index < 0 || index >= points().size()) return false;
+        bounds = QRectF(points()[index].positiom, QSizeF(0.0, 0.0));
+        return true;
+    case ObjectKind::Line: {
+        if (index < 0 || index >= lines().size()) return false;
+        const auto &line = lines()[index];
+        if (line.a < 0 || line.b < 0 || line.a >= points().size() || line.b >= points().size()) return false;
+        auto [p1, p2] = lineEndpoints(line);
+        bounds = QRectF(p1, p2).normalized();
+        return true;
+    }
+    case ObjectKind::ExtendedLine:
+        if (index < 0 || index >= extendedLines().size()) return false;
+        bounds = QRectF(extendedLines()[index].a, extendedLines()[index].b).normalized();
+        return true;
+    case ObjectKind::Circle: {
+        if (index < 0 || index >= circles().size()) return false;
+        const auto &c = circles()[index];
+        bounds = QRectF(c.center.x() - c.radius, c.center.y() - c.radius, 2 * c.radius, 2 * c.radius);
+        return true;
+    }
     }
     return false;
 }
 
+QRect CanvasWidget::objectScreenBounds(ObjectKind kind, int index) const {
+    QRectF world;
+    if (!objectWorldBounds(kind, index, world)) {
+        return QRect();
+    }
+    // Grow by the widest selected pen / point marker.
+    const int margin = 10;
+    return viewport.worldToScreen().mapRect(world).toAlignedRect().adjusted(-margin, -margin, margin, margin);
+}
+
+QString CanvasWidget::objectLabel(ObjectIds::Kind kind, int index) const {
+    switch (kind) {
+    case ObjectIds::Point: return points()[index].label;
+    case ObjectIds::Line: return lines()[index].label;
+    case ObjectIds::ExtendedLine: return extendedLines()[index].label;
+    default: return circles()[index].label;
+    }
+}
+
+void CanvasWidget::objectAdded(ObjectIds::Kind kind, int index) {
+    switch (kind) {
+    case ObjectIds::Point:
+        journal.recordAddPoint(points()[index].positiom, points()[index].label);
+        break;
+    case ObjectIds::Line:
+        journal.recordAddLine(lines()[index].a, lines()[index].b, lines()[index].label);
+        break;
+    case ObjectIds::ExtendedLine:
+        journal.recordAddExtendedLine(extendedLines()[index].a, extendedLines()[index].b, extendedLines()[index].label);
+        break;
+    default:
+        journal.recordAddCircle(circles()[index].center, circles()[index].radius, circles()[index].label);
+        break;
+    }
+    changes.mark(kind, index);
+    if (kind == ObjectIds::Point) {
+        emit pointAdded(points()[index].positiom);
+    }
+    objectChanged(ObjectKind(kind), index, !objectLabel(kind, index).isEmpty());
+}
+
+void CanvasWidget::invalidatePointAndLines(int index) {
+    QRect bounds = objectScreenBounds(ObjectKind::Point, index);
+    for (int lineIndex : linesAtPoint(index)) {
+        bounds = bounds.united(objectScreenBounds(ObjectKind::Line, lineIndex));
+    }
+    addDirtyRect(staticDirty, bounds);
+    invalidateRect(bounds);
+}
+
+void CanvasWidget::positionAboutToChange(int index) {
+    invalidatePointAndLines(index);
+}
+
+void CanvasWidget::positionChanged(int index) {
+    // Only the point and the lines hanging off it change; everything else keeps its
+    // cached tiles, index entries and intersection pairs.
+    journal.recordMovePoint(index, points()[index].positiom);
+    changes.mark(int(ObjectKind::Point), index);
+    invalidatePointAndLines(index);
+
+    const QVector<int> &touching = linesAtPoint(index);
+    bool labelsAffected = !points()[index].label.isEmpty();
+    for (int lineIndex : touching) {
+        labelsAffected = labelsAffected || !lines()[lineIndex].label.isEmpty();
+    }
+    const quint64 previousRevision = sceneRevision;
+    ++sceneRevision;
+    if (labelsAffected) {
+        ++labelRevision;
+    }
+    if (pickIndexRevision == previousRevision) {
+        QRectF bounds;
+        objectWorldBounds(ObjectKind::Point, index, bounds);
+        pickIndex.update(int(ObjectKind::Point), index, bounds);
+        for (int lineIndex : touching) {
+            if (objectWorldBounds(ObjectKind::Line, lineIndex, bounds)) {
+                pickIndex.update(int(ObjectKind::Line), lineIndex, bounds);
+            }
+        }
+        pickIndexRevision = sceneRevision;
+    }
+    for (int lineIndex : touching) {
+        intersectionCache.invalidate(IntersectionCache::objectKey(int(ObjectKind::Line), lineIndex));
+    }
+}
+
+void CanvasWidget::labelChanged(ObjectIds::Kind kind, int index) {
+    journal.recordSetLabel(kind, index, objectLabel(kind, index));
+    changes.mark(kind, index);
+    sceneChanged();
+}
+
+void CanvasWidget::objectsRemoved(const QVector<int> (&removed)[ObjectIds::KindCount]) {
+    journal.recordRemove(removed[ObjectIds::Point], removed[ObjectIds::Line], removed[ObjectIds::ExtendedLine],
+                         removed[ObjectIds::Circle]);
+    // Everything after the first removed object of a kind moves down.
+    for (int kind = 0; kind < ObjectIds::KindCount; ++kind) {
+        if (!removed[kind].isEmpty()) changes.markFrom(kind, removed[kind].first());
+    }
+    // Lines that survive keep their place but may now name their endpoints differently.
+    if (!removed[ObjectIds::Point].isEmpty()) {
+        const int firstPoint = removed[ObjectIds::Point].first();
+        for (int i = 0; i < lines().size(); ++i) {
+            if (lines()[i].a >= firstPoint || lines()[i].b >= firstPoint) changes.mark(int(ObjectKind::Line), i);
+        }
+    }
+    intersectionCache.clear();
+    sceneChanged();
+}
+
+void CanvasWidget::sceneCleared() {
+    journal.recordClear();
+    for (int kind = 0; kind < ObjectIds::KindCount; ++kind) {
+        changes.markFrom(kind, 0);
+    }
+    intersectionCache.clear();
+    dragPoint = -1;
+    sceneChanged();
+}
+
+void CanvasWidget::sceneReplaced() {
+    intersectionCache.clear();
+    sceneChanged();
+}
+
+void CanvasWidget::selectionChanged(ObjectIds::Kind kind, int index) {
+    invalidateObject(ObjectKind(kind), index);
+}
+
+void CanvasWidget::selectionAboutToClear() {
+    invalidateSelection();
+}
+
+bool CanvasWidget::addPoint(const QPointF &point, const QString &label, bool selectNew) {
+    return materialize() && editor.addPoint(point, label, selectNew);
+}
+
+bool CanvasWidget::hasPoint(const QPointF &point) const {
+    return editor.hasPoint(point);
+}
+
 int CanvasWidget::pointCount() const {
-    return points.size();
+    return pager.isOpen() ? pager.scene().pointCount() : points().size();
 }
 
 int CanvasWidget::selectedCount() const {
-    return selectedPointIndices.size();
+    return selectedPointIndices().size();
 }
 
 int CanvasWidget::selectedLineCount() const {
-    return selectedLineIndices.size();
+    return selectedLineIndices().size();
 }
 
 int CanvasWidget::selectedCircleCount() const {
-    return selectedCircleIndices.size();
+    return selectedCircleIndices().size();
 }
 
 QString CanvasWidget::nextPointLabel() const {
-    return QString("P%1").arg(points.size() + 1);
+    return QString("P%1").arg(points().size() + 1);
 }
 
 QString CanvasWidget::nextLineLabel() const {
-    return QString("L%1").arg(lines.size() + 1);
+    return QString("L%1").arg(lines().size() + 1);
 }
 
 QString CanvasWidget::suggestedLineLabel() const {
@@ -137,56 +360,40 @@ QString CanvasWidget::suggestedLineLabel() const {
 }
 
 QString CanvasWidget::nextCircleLabel() const {
-    return QString("C%1").arg(circles.size() + 1);
+    return QString("C%1").arg(circles().size() + 1);
 }
 
-void CanvasWidget::addIntersectionPoint(const QPointF &pt) {
-    if (!hasPoint(pt)) {
-        addPoint(pt, QString(), false);
+const QVector<int> &CanvasWidget::linesAtPoint(int pointIndex) const {
+    if (pointLinesRevision != structureRevision) {
+        pointLines = QVector<QVector<int>>(points().size());
+        for (int i = 0; i < lines().size(); ++i) {
+            const auto &line = lines()[i];
+            if (line.a >= 0 && line.a < points().size()) pointLines[line.a].append(i);
+            if (line.b >= 0 && line.b < points().size() && line.b != line.a) pointLines[line.b].append(i);
+        }
+        pointLinesRevision = structureRevision;
     }
+    static const QVector<int> none;
+    return pointIndex >= 0 && pointIndex < pointLines.size() ? pointLines[pointIndex] : none;
 }
 
-bool CanvasWidget::setLabelForSelection(const QString &label) {
-    int totalSelections = selectedPointIndices.size() + selectedLineIndices.size() +
-                          selectedExtendedLineIndices.size() + selectedCircleIndices.size();
-    if (totalSelections != 1) {
-        return false;
-    }
-    bool changed = false;
-    if (!selectedPointIndices.isEmpty()) {
-        int idx = *selectedPointIndices.constBegin();
-        if (idx >= 0 && idx < points.size()) {
-            points[idx].label = label;
-            changed = true;
-        }
-    } else if (!selectedLineIndices.isEmpty()) {
-        int idx = *selectedLineIndices.constBegin();
-        if (idx >= 0 && idx < lines.size()) {
-            lines[idx].label = label;
-            changed = true;
-        }
-    } else if (!selectedExtendedLineIndices.isEmpty()) {
-        int idx = *selectedExtendedLineIndices.constBegin();
-        if (idx >= 0 && idx < extendedLines.size()) {
-            extendedLines[idx].label = label;
-            changed = true;
-        }
-    } else if (!selectedCircleIndices.isEmpty()) {
-        int idx = *selectedCircleIndices.constBegin();
-        if (idx >= 0 && idx < circles.size()) {
-            circles[idx].label = label;
-            changed = true;
+bool CanvasWidget::movePoint(int index, const QPointF &position) {
+    if (pager.isOpen()) {
+        index = sceneIndex(ObjectKind::Point, index);
+        if (!materialize()) {
+            return false;
         }
     }
-    if (changed) {
-        update();
-    }
-    return changed;
+    return editor.movePoint(index, position);
+}
+
+bool CanvasWidget::setLabelForSelection(const QString &label) {
+    return materialize() && editor.setLabelForSelection(label);
 }
 
 std::pair<QPointF, QPointF> CanvasWidget::lineEndpoints(const Line &line) const {
-    QPointF p1 = points[line.a].positiom;
-    QPointF p2 = points[line.b].positiom;
+    QPointF p1 = points()[line.a].positiom;
+    QPointF p2 = points()[line.b].positiom;
     return {p1, p2};
 }
 
@@ -195,387 +402,161 @@ std::pair<QPointF, QPointF> CanvasWidget::extendedLineEndpoints(const ExtendedLi
 }
 
 bool CanvasWidget::extendedLineEndpointsAt(int index, QPointF &a, QPointF &b) const {
-    if (index < 0 || index >= extendedLines.size()) {
+    if (index < 0 || index >= extendedLines().size()) {
         return false;
     }
-    a = extendedLines[index].a;
-    b = extendedLines[index].b;
+    a = extendedLines()[index].a;
+    b = extendedLines()[index].b;
     return true;
 }
 
 bool CanvasWidget::lineEndpointsAt(int index, QPointF &a, QPointF &b) const {
-    if (index < 0 || index >= lines.size()) {
+    if (index < 0 || index >= lines().size()) {
         return false;
     }
-    auto ends = lineEndpoints(lines[index]);
+    auto ends = lineEndpoints(lines()[index]);
     a = ends.first;
     b = ends.second;
     return true;
 }
 
 bool CanvasWidget::circleAt(int index, QPointF &center, double &radius) const {
-    if (index < 0 || index >= circles.size()) {
+    if (index < 0 || index >= circles().size()) {
         return false;
     }
-    center = circles[index].center;
-    radius = circles[index].radius;
+    center = circles()[index].center;
+    radius = circles()[index].radius;
     return true;
 }
 
 bool CanvasWidget::selectedPoint(QPointF &point) const {
-    if (selectedPointIndices.isEmpty()) {
+    if (selectedPointIndices().isEmpty()) {
         return false;
     }
-    QList<int> indices = selectedPointIndices.values();
+    QList<int> indices = selectedPointIndices().values();
     std::sort(indices.begin(), indices.end());
     int idx = indices.first();
-    if (idx < 0 || idx >= points.size()) {
+    if (idx < 0 || idx >= points().size()) {
         return false;
     }
-    point = points[idx].positiom;
+    point = points()[idx].positiom;
     return true;
 }
 
 bool CanvasWidget::addLineBetweenSelected(const QString &label) {
-    if (selectedPointIndices.size() < 2) {
-        return false;
-    }
-    QList<int> indices = selectedPointIndices.values();
-    std::sort(indices.begin(), indices.end());
-    int a = indices[0];
-    int b = indices[1];
-    if (a == b) return false;
-
-    // Avoid duplicates (order-insensitive)
-    for (const auto &line : lines) {
-        if ((line.a == a && line.b == b) || (line.a == b && line.b == a)) {
-            return false;
-        }
-    }
-    lines.append(Line(a, b, label));
-    update();
-    return true;
+    return materialize() && editor.addLineBetweenSelected(label);
 }
 
 bool CanvasWidget::extendSelectedLines() {
-    bool changed = false;
-    QVector<int> toRemove;
-    for (int idx : selectedLineIndices) {
-        if (idx >= 0 && idx < lines.size()) {
-            // Compute intersections with bounding box [-5,5] x [-5,5] to extend across the canvas.
-            const QPointF p1 = points[lines[idx].a].positiom;
-            const QPointF p2 = points[lines[idx].b].positiom;
-            const double xmin = -5.0, xmax = 5.0, ymin = -5.0, ymax = 5.0;
-            const double dx = p2.x() - p1.x();
-            const double dy = p2.y() - p1.y();
-            QVector<QPointF> hits;
-            auto addIfInside = [&](double x, double y) {
-                if (x >= xmin - 1e-9 && x <= xmax + 1e-9 && y >= ymin - 1e-9 && y <= ymax + 1e-9) {
-                    hits.append(QPointF(x, y));
-                }
-            };
-            if (std::abs(dx) > 1e-9) {
-                double t1 = (xmin - p1.x()) / dx;
-                addIfInside(xmin, p1.y() + t1 * dy);
-                double t2 = (xmax - p1.x()) / dx;
-                addIfInside(xmax, p1.y() + t2 * dy);
-            }
-            if (std::abs(dy) > 1e-9) {
-                double t3 = (ymin - p1.y()) / dy;
-                addIfInside(p1.x() + t3 * dx, ymin);
-                double t4 = (ymax - p1.y()) / dy;
-                addIfInside(p1.x() + t4 * dx, ymax);
-            }
-            // Remove duplicates
-            QVector<QPointF> uniqueHits;
-            auto isClose = [](const QPointF &a, const QPointF &b) {
-                return std::hypot(a.x() - b.x(), a.y() - b.y()) < 1e-6;
-            };
-            for (const auto &h : hits) {
-                bool dup = false;
-                for (const auto &u : uniqueHits) {
-                    if (isClose(h, u)) { dup = true; break; }
-                }
-                if (!dup) uniqueHits.append(h);
-            }
-            QPointF aPoint = p1;
-            QPointF bPoint = p2;
-            if (uniqueHits.size() >= 2) {
-                QVector<std::pair<double, QPointF>> proj;
-                if (std::abs(dx) >= std::abs(dy)) {
-                    for (const auto &h : uniqueHits) proj.append({ (h.x() - p1.x()) / dx, h });
-                } else {
-                    for (const auto &h : uniqueHits) proj.append({ (h.y() - p1.y()) / dy, h });
-                }
-                std::sort(proj.begin(), proj.end(), [](const auto &a, const auto &b){ return a.first < b.first; });
-                aPoint = proj.front().second;
-                bPoint = proj.back().second;
-            }
-            extendedLines.append(ExtendedLine(aPoint, bPoint, lines[idx].label));
-            toRemove.append(idx);
-            changed = true;
-        }
-    }
-    if (!toRemove.isEmpty()) {
-        QVector<Line> newLines;
-        for (int i = 0; i < lines.size(); ++i) {
-            if (!toRemove.contains(i)) {
-                newLines.append(lines[i]);
-            }
-        }
-        lines.swap(newLines);
-        selectedLineIndices.clear();
-    }
-    if (changed) {
-        update();
-    }
-    return changed;
+    return materialize() && editor.extendSelectedLines();
 }
 
 bool CanvasWidget::addCircle(const QPointF &center, double radius) {
-    if (radius <= 0.0) {
-        return false;
-    }
-    circles.append(Circle(center, radius, QString()));
-    update();
-    return true;
+    return materialize() && editor.addCircle(center, radius);
 }
 
-bool CanvasWidget::addNormalAtPoint(int lineIndex, const QPointF &point) {
-    if (lineIndex < 0 || lineIndex >= lines.size()) return false;
-    auto [p1, p2] = lineEndpoints(lines[lineIndex]);
-    QPointF d = p2 - p1;
-    if (std::abs(d.x()) < 1e-9 && std::abs(d.y()) < 1e-9) return false;
-    QPointF perp(-d.y(), d.x());
-    double len = std::hypot(perp.x(), perp.y());
-    if (len < 1e-9) return false;
-    QPointF dir = QPointF(perp.x() / len, perp.y() / len);
-    const double span = 20.0;  // enough to cross the -5..5 box
-    QPointF a = point + dir * span;
-    QPointF b = point - dir * span;
-    extendedLines.append(ExtendedLine(a, b, QString()));
-    update();
-    return true;
+bool CanvasWidget::addCircleFromSelected() {
+    return materialize() && editor.addCircleFromSelected();
 }
 
-bool CanvasWidget::deleteSelected() {
-    bool changed = false;
-    QSet<int> removePoints = selectedPointIndices;
-    QVector<int> indexMap(points.size(), -1);
-    QVector<Point> newPoints;
-    if (!removePoints.isEmpty()) {
-        for (int i = 0; i < points.size(); ++i) {
-            if (removePoints.contains(i)) {
-                continue;
-            }
-            indexMap[i] = newPoints.size();
-            newPoints.append(points[i]);
-        }
-    } else {
-        for (int i = 0; i < points.size(); ++i) {
-            indexMap[i] = i;
-        }
-    }
-
-    QVector<Line> newLines;
-    for (int i = 0; i < lines.size(); ++i) {
-        const auto &line = lines[i];
-        if (selectedLineIndices.contains(i)) {
-            changed = true;
-            continue;
-        }
-        if (removePoints.contains(line.a) || removePoints.contains(line.b)) {
-            changed = true;
-            continue;
-        }
-        if (line.a < 0 || line.b < 0 || line.a >= indexMap.size() || line.b >= indexMap.size()) {
-            changed = true;
-            continue;
-        }
-        int na = indexMap[line.a];
-        int nb = indexMap[line.b];
-        if (na < 0 || nb < 0) {
-            changed = true;
-            continue;
-        }
-        newLines.append(Line(na, nb, line.label));
-    }
-
-    QVector<ExtendedLine> newExtended;
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        if (selectedExtendedLineIndices.contains(i)) {
-            changed = true;
-            continue;
+bool CanvasWidget::addNormalAtPoint(int lineIndex, const QPointF &point) {
+    if (pager.isOpen()) {
+        lineIndex = sceneIndex(ObjectKind::Line, lineIndex);
+        if (!materialize()) {
+            return false;
         }
-        newExtended.append(extendedLines[i]);
     }
+    return editor.addNormalAtPoint(lineIndex, point);
+}
 
-    QVector<Circle> newCircles;
-    for (int i = 0; i < circles.size(); ++i) {
-        if (selectedCircleIndices.contains(i)) {
-            changed = true;
-            continue;
-        }
-        newCircles.append(circles[i]);
-    }
+bool CanvasWidget::addNormalFromSelected() {
+    return materialize() && editor.addNormalFromSelected();
+}
 
-    if (!removePoints.isEmpty()) {
-        points.swap(newPoints);
-        changed = true;
-    }
-    if (selectedCircleIndices.size() > 0) {
-        circles.swap(newCircles);
-    } else if (newCircles.size() != circles.size()) {
-        circles.swap(newCircles);
-    }
-    if (changed) {
-        lines.swap(newLines);
-        extendedLines.swap(newExtended);
-        selectedPointIndices.clear();
-        selectedLineIndices.clear();
-        selectedExtendedLineIndices.clear();
-        selectedCircleIndices.clear();
-        update();
-    }
-    return changed;
+bool CanvasWidget::deleteSelected() {
+    return materialize() && editor.deleteSelected();
 }
 
 void CanvasWidget::deleteAll() {
-    if (points.isEmpty() && lines.isEmpty() && circles.isEmpty()) {
+    // Clearing a paged scene needs none of its tiles, only to stop paging.
+    const bool paged = pager.isOpen();
+    pager.close();
+    residentIds = TilePager::Ids();
+    if (paged && points().isEmpty() && lines().isEmpty() && extendedLines().isEmpty() && circles().isEmpty()) {
+        // Nothing was resident, but the file behind the view still held objects.
+        sceneCleared();
         return;
     }
-    points.clear();
-    lines.clear();
-    extendedLines.clear();
-    circles.clear();
-    selectedPointIndices.clear();
-    selectedLineIndices.clear();
-    selectedExtendedLineIndices.clear();
-    selectedCircleIndices.clear();
-    update();
+    editor.deleteAll();
 }
 
 void CanvasWidget::clearSelection() {
-    selectedPointIndices.clear();
-    selectedLineIndices.clear();
-    selectedExtendedLineIndices.clear();
-    selectedCircleIndices.clear();
-    pointSelectionOrder.clear();
-    update();
+    editor.clearSelection();
 }
 
 bool CanvasWidget::selectPointByPosition(const QPointF &pt, bool additive, double tol) {
-    if (!additive) {
-        clearSelection();
-    }
-    bool found = false;
-    double bestDist = std::numeric_limits<double>::max();
-    int bestIdx = -1;
-    for (int i = 0; i < points.size(); ++i) {
-        const auto &p = points[i].positiom;
-        double d = std::hypot(p.x() - pt.x(), p.y() - pt.y());
-        if (d <= tol && d < bestDist) {
-            bestDist = d;
-            bestIdx = i;
-        }
-    }
-    if (bestIdx >= 0) {
-        selectedPointIndices.insert(bestIdx);
-        pointSelectionOrder.removeAll(bestIdx);
-        pointSelectionOrder.append(bestIdx);
-        found = true;
-    } else if (tol < 1e-3) {
-        // Retry with looser tolerance to tolerate minor rounding differences during playback.
-        return selectPointByPosition(pt, additive, 1e-3);
-    }
-    if (found) update();
-    return found;
+    return editor.selectPointByPosition(pt, additive, tol);
 }
 
 bool CanvasWidget::selectLineByEndpoints(const QPointF &a, const QPointF &b, bool additive, double tol) {
-    if (!additive) {
-        clearSelection();
-    }
-    auto close = [tol](const QPointF &p, const QPointF &q) {
-        return std::hypot(p.x() - q.x(), p.y() - q.y()) <= tol;
-    };
-    int bestIdx = -1;
-    for (int i = 0; i < lines.size(); ++i) {
-        auto [p1, p2] = lineEndpoints(lines[i]);
-        if ((close(p1, a) && close(p2, b)) || (close(p1, b) && close(p2, a))) {
-            bestIdx = i;
-            break;
-        }
-    }
-    if (bestIdx < 0 && tol < 1e-3) {
-        return selectLineByEndpoints(a, b, additive, 1e-3);
-    }
-    if (bestIdx >= 0) {
-        selectedLineIndices.insert(bestIdx);
-        update();
-        return true;
-    }
-    return false;
+    return editor.selectLineByEndpoints(a, b, additive, tol);
 }
 
 bool CanvasWidget::selectExtendedLineByEndpoints(const QPointF &a, const QPointF &b, bool additive, double tol) {
-    if (!additive) {
-        clearSelection();
-    }
-    auto close = [tol](const QPointF &p, const QPointF &q) {
-        return std::hypot(p.x() - q.x(), p.y() - q.y()) <= tol;
-    };
-    int bestIdx = -1;
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        auto [p1, p2] = extendedLineEndpoints(extendedLines[i]);
-        if ((close(p1, a) && close(p2, b)) || (close(p1, b) && close(p2, a))) {
-            bestIdx = i;
-            break;
-        }
-    }
-    if (bestIdx < 0 && tol < 1e-3) {
-        return selectExtendedLineByEndpoints(a, b, additive, 1e-3);
-    }
-    if (bestIdx >= 0) {
-        selectedExtendedLineIndices.insert(bestIdx);
-        update();
-        return true;
-    }
-    return false;
+    return editor.selectExtendedLineByEndpoints(a, b, additive, tol);
 }
 
 bool CanvasWidget::selectCircleByCenterRadius(const QPointF &center, double radius, bool additive, double tol) {
-    if (!additive) {
-        clearSelection();
-    }
-    int bestIdx = -1;
-    double bestScore = std::numeric_limits<double>::max();
-    for (int i = 0; i < circles.size(); ++i) {
-        const auto &c = circles[i];
-        double dc = std::hypot(c.center.x() - center.x(), c.center.y() - center.y());
-        double dr = std::abs(c.radius - radius);
-        double score = dc + dr;
-        if (dc <= tol && dr <= tol && score < bestScore) {
-            bestScore = score;
-            bestIdx = i;
-        }
+    return editor.selectCircleByCenterRadius(center, radius, additive, tol);
+}
+
+bool CanvasWidget::selectObject(ObjectIds::Kind kind, quint32 id, bool additive) {
+    return editor.selectObject(kind, id, additive);
+}
+
+bool CanvasWidget::runCommand(const Macro &macro, int index) {
+    // Files go through the canvas, which pages, journals and saves chunked files in place.
+    switch (macro.at(index).opcode) {
+    case Macro::Opcode::Open:
+        return loadFromFile(macro.string(index));
+    case Macro::Opcode::Save:
+        return saveToFile(macro.string(index));
+    case Macro::Opcode::DeleteAll:
+        deleteAll();
+        return true;
+    default:
+        return materialize() && editor.run(macro, index);
     }
-    if (bestIdx < 0 && tol < 1e-3) {
-        return selectCircleByCenterRadius(center, radius, additive, 1e-3);
+}
+
+void CanvasWidget::renumberObjects() {
+    // Paged-in objects already carry their scene-wide index.
+    if (pager.isOpen()) {
+        return;
     }
-    if (bestIdx >= 0) {
-        selectedCircleIndices.insert(bestIdx);
-        update();
-        return true;
+    editor.renumberObjects();
+}
+
+QVector<quint32> CanvasWidget::selectedObjectIds(ObjectIds::Kind kind) const {
+    const QSet<int> *selection = &selectedPointIndices();
+    switch (kind) {
+    case ObjectIds::Point: selection = &selectedPointIndices(); break;
+    case ObjectIds::Line: selection = &selectedLineIndices(); break;
+    case ObjectIds::ExtendedLine: selection = &selectedExtendedLineIndices(); break;
+    default: selection = &selectedCircleIndices(); break;
     }
-    return false;
+    QList<int> indices = selection->values();
+    std::sort(indices.begin(), indices.end());
+    QVector<quint32> ids;
+    for (int index : indices) ids.append(objectIds().id(kind, index));
+    return ids;
 }
 
 QVector<QPointF> CanvasWidget::selectedPointPositions() const {
     QVector<QPointF> out;
-    for (int idx : selectedPointIndices) {
-        if (idx >= 0 && idx < points.size()) {
-            out.append(points[idx].positiom);
+    for (int idx : selectedPointIndices()) {
+        if (idx >= 0 && idx < points().size()) {
+            out.append(points()[idx].positiom);
         }
     }
     return out;
@@ -583,9 +564,9 @@ QVector<QPointF> CanvasWidget::selectedPointPositions() const {
 
 QVector<QPair<QPointF, QPointF>> CanvasWidget::selectedLineEndpoints() const {
     QVector<QPair<QPointF, QPointF>> out;
-    for (int idx : selectedLineIndices) {
-        if (idx >= 0 && idx < lines.size()) {
-            auto [p1, p2] = lineEndpoints(lines[idx]);
+    for (int idx : selectedLineIndices()) {
+        if (idx >= 0 && idx < lines().size()) {
+            auto [p1, p2] = lineEndpoints(lines()[idx]);
             out.append({p1, p2});
         }
     }
@@ -594,9 +575,9 @@ QVector<QPair<QPointF, QPointF>> CanvasWidget::selectedLineEndpoints() const {
 
 QVector<QPair<QPointF, QPointF>> CanvasWidget::selectedExtendedLineEndpoints() const {
     QVector<QPair<QPointF, QPointF>> out;
-    for (int idx : selectedExtendedLineIndices) {
-        if (idx >= 0 && idx < extendedLines.size()) {
-            out.append({extendedLines[idx].a, extendedLines[idx].b});
+    for (int idx : selectedExtendedLineIndices()) {
+        if (idx >= 0 && idx < extendedLines().size()) {
+            out.append({extendedLines()[idx].a, extendedLines()[idx].b});
         }
     }
     return out;
@@ -604,453 +585,717 @@ QVector<QPair<QPointF, QPointF>> CanvasWidget::selectedExtendedLineEndpoints() c
 
 QVector<QPair<QPointF, double>> CanvasWidget::selectedCircleData() const {
     QVector<QPair<QPointF, double>> out;
-    for (int idx : selectedCircleIndices) {
-        if (idx >= 0 && idx < circles.size()) {
-            out.append({circles[idx].center, circles[idx].radius});
+    for (int idx : selectedCircleIndices()) {
+        if (idx >= 0 && idx < circles().size()) {
+            out.append({circles()[idx].center, circles()[idx].radius});
         }
     }
     return out;
 }
 
-void CanvasWidget::findIntersectionsForLine(int lineIndex) {
-    if (lineIndex < 0 || lineIndex >= lines.size()) return;
-    auto [a1, a2] = lineEndpoints(lines[lineIndex]);
-
-    // With other lines
-    for (int i = 0; i < lines.size(); ++i) {
-        if (i == lineIndex) continue;
-        auto [b1, b2] = lineEndpoints(lines[i]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) {
-            addIntersectionPoint(hit);
-        }
-    }
-    // With extended lines
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        auto [b1, b2] = extendedLineEndpoints(extendedLines[i]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) {
-            addIntersectionPoint(hit);
-        }
+void CanvasWidget::recomputeAllIntersections() {
+    if (materialize()) {
+        editor.addAllIntersections();
     }
-    // With circles
-    for (const auto &circle : circles) {
-        auto hits = segmentCircleIntersections(a1, a2, circle.center, circle.radius);
-        for (const auto &h : hits) {
-            addIntersectionPoint(h);
-        }
+}
+
+void CanvasWidget::recomputeSelectedIntersections() {
+    if (materialize()) {
+        editor.addSelectedIntersections();
     }
 }
 
-void CanvasWidget::findIntersectionsForExtendedLine(int lineIndex) {
-    if (lineIndex < 0 || lineIndex >= extendedLines.size()) return;
-    auto [a1, a2] = extendedLineEndpoints(extendedLines[lineIndex]);
+QFont CanvasWidget::labelFont() const {
+    QFont f = font();
+    f.setPointSizeF(9.0);
+    return f;
+}
 
-    // With finite lines
-    for (int i = 0; i < lines.size(); ++i) {
-        auto [b1, b2] = lineEndpoints(lines[i]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) {
-            addIntersectionPoint(hit);
-        }
+void CanvasWidget::buildLabelLayout(LabelLayout &layout, const QTransform &transform, const QRectF &area, const QFont &font) const {
+    // Points first so vertex names win over line and circle names in dense clusters.
+    layout.clear();
+    for (const auto &entry : points()) {
+        layout.add(transform.map(entry.positiom), QPointF(6, -6), entry.label);
     }
-    // With other extended lines
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        if (i == lineIndex) continue;
-        auto [b1, b2] = extendedLineEndpoints(extendedLines[i]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) {
-            addIntersectionPoint(hit);
-        }
+    for (const auto &line : lines()) {
+        if ((line.a < 0 || line.b < 0 || line.a >= points().size() || line.b >= points().size())) continue;
+        auto [p1, p2] = lineEndpoints(line);
+        layout.add(transform.map((p1 + p2) / 2.0), QPointF(6, -6), line.label);
     }
-    // With circles
-    for (const auto &circle : circles) {
-        auto hits = segmentCircleIntersections(a1, a2, circle.center, circle.radius);
-        for (const auto &h : hits) {
-            addIntersectionPoint(h);
-        }
+    for (const auto &line : extendedLines()) {
+        layout.add(transform.map((line.a + line.b) / 2.0), QPointF(6, -6), line.label);
+    }
+    for (const auto &circle : circles()) {
+        // Label near top-right of circle
+        QPointF corner(circle.center.x() + circle.radius, circle.center.y() + circle.radius);
+        layout.add(transform.map(corner), QPointF(4, -4), circle.label);
     }
+    layout.place(font, area);
 }
 
-void CanvasWidget::recomputeAllIntersections() {
-    // Rebuild points by keeping existing named points and re-adding intersection points.
-    // For simplicity, we keep current points and just add any missing intersections.
-    for (int i = 0; i < lines.size(); ++i) {
-        findIntersectionsForLine(i);
-    }
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        findIntersectionsForExtendedLine(i);
+void CanvasWidget::drawScene(QPainter &painter, const QTransform &transform, const QRectF &clip,
+                             const LabelLayout &labels, const QFont &font) const {
+    // Objects are culled against the tile using screen bounds grown by the widest pen/marker.
+    const double margin = cullMargin;
+    auto visible = [&](const QRectF &worldBounds) {
+        return transform.mapRect(worldBounds).adjusted(-margin, -margin, margin, margin).intersects(clip);
+    };
+
+    painter.setPen(QPen(Qt::blue, 2));
+    for (const auto &line : lines()) {
+        if ((line.a < 0 || line.b < 0 || line.a >= points().size() || line.b >= points().size())) continue;
+        auto [p1, p2] = lineEndpoints(line);
+        if (!visible(QRectF(p1, p2).normalized())) continue;
+        painter.drawLine(transform.map(p1), transform.map(p2));
     }
-    for (int i = 0; i < circles.size(); ++i) {
-        findIntersectionsForCircle(i);
+
+    painter.setPen(QPen(Qt::darkCyan, 2, Qt::DashLine));
+    for (const auto &line : extendedLines()) {
+        if (!visible(QRectF(line.a, line.b).normalized())) continue;
+        painter.drawLine(transform.map(line.a), transform.map(line.b));
     }
-    update();
-}
 
-void CanvasWidget::recomputeSelectedIntersections() {
-    // Only compute intersections between the selected combination of two objects.
-    if (selectedPointIndices.size() + selectedLineIndices.size() + selectedExtendedLineIndices.size() + selectedCircleIndices.size() != 2) {
-        return;
+    painter.setPen(QPen(Qt::darkGreen, 2));
+    painter.setBrush(Qt::NoBrush);
+    for (const auto &circle : circles()) {
+        QRectF bounds(circle.center.x() - circle.radius, circle.center.y() - circle.radius,
+                      2 * circle.radius, 2 * circle.radius);
+        if (!visible(bounds)) continue;
+        painter.drawEllipse(transform.mapRect(bounds));
     }
-    // Collect selected objects
-    QVector<int> pointSel = selectedPointIndices.values().toVector();
-    QVector<int> lineSel = selectedLineIndices.values().toVector();
-    QVector<int> extLineSel = selectedExtendedLineIndices.values().toVector();
-    QVector<int> circleSel = selectedCircleIndices.values().toVector();
 
-    auto addPt = [&](const QPointF &pt) {
-        addIntersectionPoint(pt);
-    };
+    const double radiusPixels = 4.0;
+    painter.setBrush(Qt::red);
+    painter.setPen(QPen(Qt::red, 2));
+    for (const auto &entry : points()) {
+        QPointF mapped = transform.map(entry.positiom);
+        if (!QRectF(mapped, mapped).adjusted(-margin, -margin, margin, margin).intersects(clip)) continue;
+        painter.drawEllipse(mapped, radiusPixels, radiusPixels);
+    }
 
-    // Cases:
-    if (lineSel.size() == 2) {
-        auto [a1, a2] = lineEndpoints(lines[lineSel[0]]);
-        auto [b1, b2] = lineEndpoints(lines[lineSel[1]]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) addPt(hit);
-    } else if (lineSel.size() == 1 && circleSel.size() == 1) {
-        auto [p1, p2] = lineEndpoints(lines[lineSel[0]]);
-        auto hits = segmentCircleIntersections(p1, p2, circles[circleSel[0]].center, circles[circleSel[0]].radius);
-        for (const auto &h : hits) addPt(h);
-    } else if (extLineSel.size() == 2) {
-        auto [a1, a2] = extendedLineEndpoints(extendedLines[extLineSel[0]]);
-        auto [b1, b2] = extendedLineEndpoints(extendedLines[extLineSel[1]]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) addPt(hit);
-    } else if (extLineSel.size() == 1 && lineSel.size() == 1) {
-        auto [a1, a2] = extendedLineEndpoints(extendedLines[extLineSel[0]]);
-        auto [b1, b2] = lineEndpoints(lines[lineSel[0]]);
-        QPointF hit;
-        if (segmentIntersection(a1, a2, b1, b2, hit)) addPt(hit);
-    } else if (extLineSel.size() == 1 && circleSel.size() == 1) {
-        auto [p1, p2] = extendedLineEndpoints(extendedLines[extLineSel[0]]);
-        auto hits = segmentCircleIntersections(p1, p2, circles[circleSel[0]].center, circles[circleSel[0]].radius);
-        for (const auto &h : hits) addPt(h);
-    } else if (circleSel.size() == 2) {
-        auto hits = circleCircleIntersections(circles[circleSel[0]].center, circles[circleSel[0]].radius,
-                                              circles[circleSel[1]].center, circles[circleSel[1]].radius);
-        for (const auto &h : hits) addPt(h);
-    } else if ((lineSel.size() == 1 || extLineSel.size() == 1) && pointSel.size() == 1) {
-        QPointF p1, p2;
-        if (extLineSel.size() == 1) {
-            std::tie(p1, p2) = extendedLineEndpoints(extendedLines[extLineSel[0]]);
-        } else {
-            std::tie(p1, p2) = lineEndpoints(lines[lineSel[0]]);
-        }
-        QPointF pt = points[pointSel[0]].positiom;
-        // Add projection if within segment (or infinite if extended)
-        QPointF d = p2 - p1;
-        double len2 = d.x() * d.x() + d.y() * d.y();
-        if (len2 > 1e-12) {
-            double t = ((pt.x() - p1.x()) * d.x() + (pt.y() - p1.y()) * d.y()) / len2;
-            if (lineSel.size() == 1) {
-                if (t < -1e-9 || t > 1.0 + 1e-9) t = std::clamp(t, 0.0, 1.0);
-            }
-            QPointF proj(p1.x() + t * d.x(), p1.y() + t * d.y());
-            addPt(proj);
-        }
-    } else if (circleSel.size() == 1 && pointSel.size() == 1) {
-        // Add point if it's on the circle (within small epsilon)
-        const auto &c = circles[circleSel[0]];
-        double dist = std::hypot(pointSel[0] < points.size() ? points[pointSel[0]].positiom.x() - c.center.x() : 0.0,
-                                 pointSel[0] < points.size() ? points[pointSel[0]].positiom.y() - c.center.y() : 0.0);
-        if (std::abs(dist - c.radius) < 1e-6) {
-            addPt(points[pointSel[0]].positiom);
-        }
+    painter.setFont(font);
+    painter.setPen(Qt::black);
+    for (const auto &label : labels.placements()) {
+        if (!label.bounds.intersects(clip)) continue;
+        painter.drawText(label.baseline, label.text);
     }
-    update();
 }
 
-void CanvasWidget::findIntersectionsForCircle(int circleIndex) {
-    if (circleIndex < 0 || circleIndex >= circles.size()) return;
-    const auto &c = circles[circleIndex];
-    // Circle with lines
-    for (const auto &line : lines) {
-        auto [p1, p2] = lineEndpoints(line);
-        auto hits = segmentCircleIntersections(p1, p2, c.center, c.radius);
-        for (const auto &h : hits) {
-            addIntersectionPoint(h);
-        }
-    }
-    // Circle with extended lines
-    for (const auto &line : extendedLines) {
-        auto [p1, p2] = extendedLineEndpoints(line);
-        auto hits = segmentCircleIntersections(p1, p2, c.center, c.radius);
-        for (const auto &h : hits) {
-            addIntersectionPoint(h);
-        }
-    }
-    // Circle with other circles
-    for (int i = 0; i < circles.size(); ++i) {
-        if (i == circleIndex) continue;
-        const auto &other = circles[i];
-        auto hits = circleCircleIntersections(c.center, c.radius, other.center, other.radius);
-        for (const auto &h : hits) {
-            addIntersectionPoint(h);
+// Tiles overlap the objects that cross them, so what a frame draws and culls
+// is counted once against the whole view rather than per tile.
+void CanvasWidget::countVisible(const QTransform &transform, const QRectF &view, int &drawn, int &culled) const {
+    drawn = 0;
+    culled = 0;
+    const int counts[] = {int(points().size()), int(lines().size()), int(extendedLines().size()), int(circles().size())};
+    for (int kind = 0; kind < 4; ++kind) {
+        for (int i = 0; i < counts[kind]; ++i) {
+            QRectF bounds;
+            if (!objectWorldBounds(ObjectKind(kind), i, bounds)) continue;
+            const bool inside =
+                transform.mapRect(bounds).adjusted(-cullMargin, -cullMargin, cullMargin, cullMargin).intersects(view);
+            ++(inside ? drawn : culled);
         }
     }
 }
 
+QImage CanvasWidget::renderToImage(const QSize &size, qreal devicePixelRatio) const {
+    Viewport view = viewport;
+    view.setWidgetSize(size);
+    const QTransform transform = view.worldToScreen();
+    const QFont font = labelFont();
+    LabelLayout labels;
+    buildLabelLayout(labels, transform, QRectF(QPointF(0, 0), QSizeF(size)), font);
+    QImage layer = tileRenderer.render(size, devicePixelRatio, [&](QPainter &painter, const QRectF &tileRect) {
+        drawScene(painter, transform, tileRect, labels, font);
+    });
+    QImage image(layer.size(), QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(devicePixelRatio);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    painter.drawImage(QPointF(0, 0), layer);
+    return image;
+}
+
 void CanvasWidget::paintEvent(QPaintEvent *event) {
     QWidget::paintEvent(event);
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    const QTransform &transform = viewport.worldToScreen();
+    const QFont font = labelFont();
+    if (labelLayoutRevision != labelRevision || labelLayoutViewport != viewport.revision()) {
+        buildLabelLayout(labelLayout, transform, rect(), font);
+        labelLayoutRevision = labelRevision;
+        labelLayoutViewport = viewport.revision();
+        staticLayerValid = false;
+        ++stats.labelMisses;
+    } else {
+        ++stats.labelHits;
+    }
+    // Unselected geometry and labels are cached in a tile-rendered layer; selection is drawn on top.
+    // Local edits only re-render the tiles under their dirty rectangles.
+    const qreal dpr = devicePixelRatioF();
+    auto drawTile = [&](QPainter &tilePainter, const QRectF &tileRect) {
+        drawScene(tilePainter, transform, tileRect, labelLayout, font);
+    };
+    bool rendered = true;
+    if (!staticLayerValid || staticLayer.devicePixelRatio() != dpr) {
+        staticLayer = tileRenderer.render(size(), dpr, drawTile);
+        staticLayerValid = true;
+        staticDirty = QRegion();
+        ++stats.layerMisses;
+    } else if (!staticDirty.isEmpty()) {
+        tileRenderer.render(staticLayer, drawTile, staticDirty);
+        staticDirty = QRegion();
+        ++stats.layerPartial;
+    } else {
+        ++stats.layerHits;
+        rendered = false;
+    }
+    // Frames served from the cached layer report the counts of its last render.
+    if (rendered) {
+        countVisible(transform, rect(), layerDrawn, layerCulled);
+    }
 
     QPainter painter(this);
+    painter.drawImage(QPointF(0, 0), staticLayer);
     painter.setRenderHint(QPainter::Antialiasing, true);
 
-    const int padding = 16;
-    QRectF area = rect().adjusted(padding, padding, -padding, -padding);
-    const double span = 10.0;  // -5 to 5 on each axis
-    const double scale = std::min(area.width(), area.height()) / span;
-    QPointF origin(area.left() + area.width() / 2.0, area.top() + area.height() / 2.0);
-
-    auto map = [&](double x, double y) -> QPointF {
-        return QPointF(origin.x() + x * scale, origin.y() - y * scale);
-    };
-
-    // Axes/ticks intentionally hidden for now
-
-    painter.setPen(QPen(Qt::blue, 2));
-    for (int i = 0; i < lines.size(); ++i) {
-        const auto &line = lines[i];
-        if ((line.a < 0 || line.b < 0 || line.a >= points.size() || line.b >= points.size())) continue;
+    for (int i : selectedLineIndices()) {
+        if (i < 0 || i >= lines().size()) continue;
+        const auto &line = lines()[i];
+        if ((line.a < 0 || line.b < 0 || line.a >= points().size() || line.b >= points().size())) continue;
         auto [p1, p2] = lineEndpoints(line);
-        bool selected = selectedLineIndices.contains(i);
-        painter.setPen(QPen(selected ? Qt::darkBlue : Qt::blue, selected ? 4 : 2));
-        painter.drawLine(map(p1.x(), p1.y()), map(p2.x(), p2.y()));
-        // Label at midpoint
-        QPointF mid = (p1 + p2) / 2.0;
-        painter.setPen(Qt::black);
-        painter.setFont([&]{
-            QFont f = painter.font();
-            f.setPointSizeF(9.0);
-            return f;
-        }());
-        painter.drawText(map(mid.x(), mid.y()) + QPointF(6, -6), line.label);
+        painter.setPen(QPen(Qt::darkBlue, 4));
+        painter.drawLine(transform.map(p1), transform.map(p2));
     }
 
-    painter.setPen(QPen(Qt::darkCyan, 2, Qt::DashLine));
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        const auto &line = extendedLines[i];
-        auto [p1, p2] = extendedLineEndpoints(line);
-        bool selected = selectedExtendedLineIndices.contains(i);
-        painter.setPen(QPen(selected ? Qt::darkCyan : Qt::darkCyan, selected ? 4 : 2, Qt::DashLine));
-        painter.drawLine(map(p1.x(), p1.y()), map(p2.x(), p2.y()));
-        QPointF mid = (p1 + p2) / 2.0;
-        painter.setPen(Qt::black);
-        painter.setFont([&]{
-            QFont f = painter.font();
-            f.setPointSizeF(9.0);
-            return f;
-        }());
-        painter.drawText(map(mid.x(), mid.y()) + QPointF(6, -6), line.label);
+    for (int i : selectedExtendedLineIndices()) {
+        if (i < 0 || i >= extendedLines().size()) continue;
+        auto [p1, p2] = extendedLineEndpoints(extendedLines()[i]);
+        painter.setPen(QPen(Qt::darkCyan, 4, Qt::DashLine));
+        painter.drawLine(transform.map(p1), transform.map(p2));
     }
 
-    painter.setPen(QPen(Qt::darkGreen, 2));
-    for (int i = 0; i < circles.size(); ++i) {
-        const auto &circle = circles[i];
-        bool selected = selectedCircleIndices.contains(i);
-        painter.setPen(QPen(selected ? Qt::darkGreen : Qt::darkGreen, selected ? 3 : 2, selected ? Qt::DashLine : Qt::SolidLine));
-        QPointF topLeft = map(circle.center.x() - circle.radius, circle.center.y() + circle.radius);
-        QPointF bottomRight = map(circle.center.x() + circle.radius, circle.center.y() - circle.radius);
+    painter.setBrush(Qt::NoBrush);
+    for (int i : selectedCircleIndices()) {
+        if (i < 0 || i >= circles().size()) continue;
+        const auto &circle = circles()[i];
+        painter.setPen(QPen(Qt::darkGreen, 3, Qt::DashLine));
+        QPointF topLeft = transform.map(QPointF(circle.center.x() - circle.radius, circle.center.y() + circle.radius));
+        QPointF bottomRight = transform.map(QPointF(circle.center.x() + circle.radius, circle.center.y() - circle.radius));
         painter.drawEllipse(QRectF(topLeft, bottomRight));
-        // Label near top-right of circle
-        painter.setPen(Qt::black);
-        painter.setFont([&]{
-            QFont f = painter.font();
-            f.setPointSizeF(9.0);
-            return f;
-        }());
-        QPointF labelPos = map(circle.center.x() + circle.radius, circle.center.y() + circle.radius);
-        painter.drawText(labelPos + QPointF(4, -4), circle.label);
     }
 
     const double radiusPixels = 4.0;
-    painter.setFont([&]{
-        QFont f = painter.font();
-        f.setPointSizeF(9.0);
-        return f;
-    }());
-    for (int i = 0; i < points.size(); ++i) {
-        const auto &entry = points[i];
-        QPointF mapped = map(entry.positiom.x(), entry.positiom.y());
-        bool selected = selectedPointIndices.contains(i);
-        painter.setBrush(selected ? Qt::yellow : Qt::red);
-        painter.setPen(QPen(selected ? Qt::darkYellow : Qt::red, selected ? 3 : 2));
-        painter.drawEllipse(mapped, selected ? radiusPixels + 2 : radiusPixels, selected ? radiusPixels + 2 : radiusPixels);
-        painter.setPen(Qt::black);
-        painter.drawText(mapped + QPointF(6, -6), entry.label);
+    for (int i : selectedPointIndices()) {
+        if (i < 0 || i >= points().size()) continue;
+        QPointF mapped = transform.map(points()[i].positiom);
+        painter.setBrush(Qt::yellow);
+        painter.setPen(QPen(Qt::darkYellow, 3));
+        painter.drawEllipse(mapped, radiusPixels + 2, radiusPixels + 2);
+    }
+
+    drawHoverHighlight(painter);
+    drawSelectionBand(painter);
+
+    const double frameMs = frameTimer.nsecsElapsed() / 1e6;
+    frameTimes.add(frameMs);
+    ++stats.frames;
+    stats.lastMs = frameMs;
+    stats.avgMs = frameTimes.average();
+    stats.p99Ms = frameTimes.percentile(0.99);
+    stats.objectsDrawn = layerDrawn + selectedPointIndices().size() + selectedLineIndices().size() +
+                         selectedExtendedLineIndices().size() + selectedCircleIndices().size();
+    stats.objectsCulled = layerCulled;
+    stats.labelsPlaced = labelLayout.placements().size();
+    stats.labelsSkipped = labelLayout.skippedCount();
+
+    // The frame presents the stamped input once nothing for it is still queued.
+    if (inputStampNs >= 0 && !inputQueued && !hoverTimer->isActive()) {
+        latency[int(inputStampKind)].add((inputClock.nsecsElapsed() - inputStampNs) / 1e6);
+        inputStampNs = -1;
+    }
+    stats.inputP95Ms = latency[int(InputKind::Motion)].percentile(0.95);
+
+    if (statsOverlay) {
+        drawStatsOverlay(painter);
     }
 }
 
-void CanvasWidget::mousePressEvent(QMouseEvent *event) {
-    const int padding = 16;
-    QRectF area = rect().adjusted(padding, padding, -padding, -padding);
-    const double span = 10.0;
-    const double scale = std::min(area.width(), area.height()) / span;
-    QPointF origin(area.left() + area.width() / 2.0, area.top() + area.height() / 2.0);
-
-    auto map = [&](const QPointF &p) -> QPointF {
-        return QPointF(origin.x() + p.x() * scale, origin.y() - p.y() * scale);
-    };
-    auto unmap = [&](const QPointF &p) -> QPointF {
-        return QPointF((p.x() - origin.x()) / scale, -(p.y() - origin.y()) / scale);
-    };
+QRect CanvasWidget::statsOverlayRect() const {
+    return QRect(8, 8, 230, 110);
+}
 
-    int hitPoint = -1;
-    double bestDist2 = std::numeric_limits<double>::max();
-    const double tolerancePx = 8.0;
-    const double tol2 = tolerancePx * tolerancePx;
-    for (int i = 0; i < points.size(); ++i) {
-        QPointF screen = map(points[i].positiom);
-        double dx = screen.x() - event->position().x();
-        double dy = screen.y() - event->position().y();
-        double d2 = dx * dx + dy * dy;
-        if (d2 <= tol2 && d2 < bestDist2) {
-            bestDist2 = d2;
-            hitPoint = i;
-        }
-    }
+void CanvasWidget::drawStatsOverlay(QPainter &painter) const {
+    const QRect box = statsOverlayRect();
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(0, 0, 0, 170));
+    painter.drawRoundedRect(box, 4, 4);
+    QFont f = font();
+    f.setPointSizeF(8.5);
+    painter.setFont(f);
+    painter.setPen(Qt::white);
+    const QString text = QStringLiteral("frame %1 ms  avg %2  p99 %3\n"
+                                        "drawn %4  culled %5\n"
+                                        "labels %6 placed, %7 skipped\n"
+                                        "layer cache %8% hit, %9 partial\n"
+                                        "label cache %10% hit\n"
+                                        "input p95 %11 ms, %12 coalesced")
+                             .arg(stats.lastMs, 0, 'f', 2)
+                             .arg(stats.avgMs, 0, 'f', 2)
+                             .arg(stats.p99Ms, 0, 'f', 2)
+                             .arg(stats.objectsDrawn)
+                             .arg(stats.objectsCulled)
+                             .arg(stats.labelsPlaced)
+                             .arg(stats.labelsSkipped)
+                             .arg(stats.layerHitRate() * 100.0, 0, 'f', 0)
+                             .arg(stats.layerPartial)
+                             .arg(stats.labelHitRate() * 100.0, 0, 'f', 0)
+                             .arg(stats.inputP95Ms, 0, 'f', 1)
+                             .arg(stats.inputCoalesced);
+    painter.drawText(box.adjusted(8, 6, -8, -6), Qt::AlignLeft | Qt::AlignTop, text);
+}
 
-    int hitLine = -1;
-    int hitExtendedLine = -1;
-    double bestLineDist = tolerancePx;  // threshold in px
-    auto pointToSegmentDistance = [](const QPointF &p, const QPointF &a, const QPointF &b, bool infinite) -> double {
-        const double dx = b.x() - a.x();
-        const double dy = b.y() - a.y();
-        const double len2 = dx * dx + dy * dy;
-        if (len2 == 0.0) {
-            double dxp = p.x() - a.x();
-            double dyp = p.y() - a.y();
-            return std::sqrt(dxp * dxp + dyp * dyp);
+void CanvasWidget::setStatsOverlayVisible(bool visible) {
+    if (statsOverlay == visible) {
+        return;
+    }
+    statsOverlay = visible;
+    // The overlay shows the previous frame, so refresh it a few times per second while visible.
+    if (!statsTimer) {
+        statsTimer = new QTimer(this);
+        statsTimer->setInterval(250);
+        connect(statsTimer, &QTimer::timeout, this, [this] { invalidateRect(statsOverlayRect()); });
+    }
+    if (visible) {
+        statsTimer->start();
+    } else {
+        statsTimer->stop();
+    }
+    invalidateRect(statsOverlayRect());
+}
+
+void CanvasWidget::resetFrameStats() {
+    stats = FrameStats();
+    frameTimes.clear();
+    for (auto &histogram : latency) {
+        histogram.clear();
+    }
+}
+
+QString CanvasWidget::inputLatencyReport() const {
+    const LatencyHistogram &press = latency[int(InputKind::Press)];
+    const LatencyHistogram &motion = latency[int(InputKind::Motion)];
+    const LatencyHistogram &wheel = latency[int(InputKind::Wheel)];
+    QString report = QStringLiteral("bucket_ms,press,motion,wheel\n");
+    for (int i = 0; i < motion.bucketCount(); ++i) {
+        const double bound = motion.bucketUpperBound(i);
+        report += QStringLiteral("%1,%2,%3,%4\n")
+                      .arg(std::isinf(bound) ? QStringLiteral("inf") : QString::number(bound))
+                      .arg(press.bucketSamples(i))
+                      .arg(motion.bucketSamples(i))
+                      .arg(wheel.bucketSamples(i));
+    }
+    auto summary = [&](const char *name, const LatencyHistogram &h) {
+        report += QStringLiteral("# %1 count=%2 avg=%3 p50=%4 p95=%5 p99=%6 max=%7\n")
+                      .arg(QLatin1String(name))
+                      .arg(h.count())
+                      .arg(h.average(), 0, 'f', 2)
+                      .arg(h.percentile(0.5))
+                      .arg(h.percentile(0.95))
+                      .arg(h.percentile(0.99))
+                      .arg(h.maxMs(), 0, 'f', 2);
+    };
+    summary("press", press);
+    summary("motion", motion);
+    summary("wheel", wheel);
+    report += QStringLiteral("# events=%1 coalesced=%2\n").arg(stats.inputEvents).arg(stats.inputCoalesced);
+    return report;
+}
+
+void CanvasWidget::resetView() {
+    viewport.reset();
+    viewportChanged();
+}
+
+void CanvasWidget::viewportChanged() {
+    staticLayerValid = false;
+    staticDirty = QRegion();
+    invalidateRect(rect());
+    pageTiles();
+}
+
+void CanvasWidget::resizeEvent(QResizeEvent *event) {
+    viewport.setWidgetSize(size());
+    staticLayerValid = false;
+    pageTiles();
+    QWidget::resizeEvent(event);
+}
+
+void CanvasWidget::wheelEvent(QWheelEvent *event) {
+    const double steps = event->angleDelta().y() / 120.0;
+    if (steps == 0.0) {
+        QWidget::wheelEvent(event);
+        return;
+    }
+    stampInput(InputKind::Wheel);
+    wheelSteps += steps;
+    wheelPosition = event->position();
+    queueInput();
+    event->accept();
+}
+
+void CanvasWidget::mouseMoveEvent(QMouseEvent *event) {
+    stampInput(InputKind::Motion);
+    motionPending = true;
+    motionPosition = event->position();
+    motionButtons = event->buttons();
+    queueInput();
+    if (panning || bandActive || dragPoint >= 0) {
+        event->accept();
+        return;
+    }
+    QWidget::mouseMoveEvent(event);
+}
+
+void CanvasWidget::stampInput(InputKind kind) {
+    ++stats.inputEvents;
+    // Latency is measured from the oldest input not yet reflected on screen.
+    if (inputStampNs < 0) {
+        inputStampNs = inputClock.nsecsElapsed();
+        inputStampKind = kind;
+    }
+}
+
+void CanvasWidget::queueInput() {
+    // Motion and wheel events only record their latest state; whatever arrives before the
+    // queued call runs is folded into one pan, zoom, drag step or hover pick.
+    if (inputQueued) {
+        ++stats.inputCoalesced;
+        return;
+    }
+    inputQueued = true;
+    QMetaObject::invokeMethod(this, &CanvasWidget::processPendingInput, Qt::QueuedConnection);
+}
+
+void CanvasWidget::processPendingInput() {
+    if (!inputQueued) {
+        return;
+    }
+    inputQueued = false;
+    if (wheelSteps != 0.0) {
+        viewport.zoomAt(wheelPosition, std::pow(1.2, wheelSteps));
+        wheelSteps = 0.0;
+        viewportChanged();
+    }
+    if (motionPending) {
+        motionPending = false;
+        const QPointF pos = motionPosition;
+        if (panning) {
+            viewport.panBy(pos - lastPanPosition);
+            lastPanPosition = pos;
+            viewportChanged();
+        } else if (bandActive && motionButtons.testFlag(Qt::LeftButton)) {
+            updateBand(pos);
+        } else if (dragPoint >= 0 && motionButtons.testFlag(Qt::LeftButton)) {
+            if (dragMoved || QLineF(dragPressPosition, pos).length() >= 3.0) {
+                dragMoved = true;
+                movePoint(dragPoint, viewport.mapToWorld(pos));
+            }
+        } else {
+            hoverPosition = pos;
+            scheduleHover();
         }
-        double t = ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / len2;
-        if (!infinite) {
-            t = std::clamp(t, 0.0, 1.0);
+    }
+    settleInputStamp();
+}
+
+void CanvasWidget::settleInputStamp() {
+    // Input that changed nothing on screen never reaches a frame, so it does not count.
+    if (inputStampNs >= 0 && !inputQueued && !hoverTimer->isActive() && pendingDirty.isEmpty()) {
+        inputStampNs = -1;
+    }
+}
+
+void CanvasWidget::leaveEvent(QEvent *event) {
+    hoverTimer->stop();
+    setHover(ObjectKind::Point, -1);
+    settleInputStamp();
+    QWidget::leaveEvent(event);
+}
+
+void CanvasWidget::scheduleHover() {
+    // Motion events arriving within one display refresh collapse into a single pick at the latest position.
+    if (hoverTimer->isActive()) {
+        return;
+    }
+    const double refreshRate = screen() ? screen()->refreshRate() : 60.0;
+    hoverTimer->start(std::max(1, int(1000.0 / std::max(1.0, refreshRate))));
+}
+
+void CanvasWidget::updateHover() {
+    if (!underMouse() || panning) {
+        setHover(ObjectKind::Point, -1);
+        settleInputStamp();
+        return;
+    }
+    const PickResult pick = pickAt(hoverPosition);
+    if (pick.point >= 0) {
+        setHover(ObjectKind::Point, pick.point);
+    } else if (pick.line >= 0) {
+        setHover(ObjectKind::Line, pick.line);
+    } else if (pick.extendedLine >= 0) {
+        setHover(ObjectKind::ExtendedLine, pick.extendedLine);
+    } else if (pick.circle >= 0) {
+        setHover(ObjectKind::Circle, pick.circle);
+    } else {
+        setHover(ObjectKind::Point, -1);
+    }
+    settleInputStamp();
+}
+
+void CanvasWidget::setHover(ObjectKind kind, int index) {
+    if (index == hoverIndex && (index < 0 || kind == hoverKind)) {
+        return;
+    }
+    if (hoverIndex >= 0) {
+        invalidateObject(hoverKind, hoverIndex);
+    }
+    hoverKind = kind;
+    hoverIndex = index;
+    if (hoverIndex >= 0) {
+        invalidateObject(hoverKind, hoverIndex);
+    }
+}
+
+void CanvasWidget::drawHoverHighlight(QPainter &painter) const {
+    if (hoverIndex < 0) {
+        return;
+    }
+    const QTransform &transform = viewport.worldToScreen();
+    painter.setPen(QPen(QColor(255, 140, 0, 160), 6, Qt::SolidLine, Qt::RoundCap));
+    painter.setBrush(Qt::NoBrush);
+    switch (hoverKind) {
+    case ObjectKind::Point:
+        if (hoverIndex < points().size()) {
+            painter.drawEllipse(transform.map(points()[hoverIndex].positiom), 6.0, 6.0);
         }
-        QPointF proj(a.x() + t * dx, a.y() + t * dy);
-        double dxp = p.x() - proj.x();
-        double dyp = p.y() - proj.y();
-        return std::sqrt(dxp * dxp + dyp * dyp);
-    };
-    for (int i = 0; i < lines.size(); ++i) {
-        const auto &line = lines[i];
-        if (line.a < 0 || line.b < 0 || line.a >= points.size() || line.b >= points.size()) continue;
-        auto [pa, pb] = lineEndpoints(line);
-        QPointF a = map(pa);
-        QPointF b = map(pb);
-        double dist = pointToSegmentDistance(event->position(), a, b, false);
-        if (dist <= bestLineDist) {
-            bestLineDist = dist;
-            hitLine = i;
+        break;
+    case ObjectKind::Line:
+        if (hoverIndex < lines().size()) {
+            const auto &line = lines()[hoverIndex];
+            if (line.a < 0 || line.b < 0 || line.a >= points().size() || line.b >= points().size()) break;
+            auto [p1, p2] = lineEndpoints(line);
+            painter.drawLine(transform.map(p1), transform.map(p2));
+        }
+        break;
+    case ObjectKind::ExtendedLine:
+        if (hoverIndex < extendedLines().size()) {
+            auto [p1, p2] = extendedLineEndpoints(extendedLines()[hoverIndex]);
+            painter.drawLine(transform.map(p1), transform.map(p2));
+        }
+        break;
+    case ObjectKind::Circle: {
+        QRectF bounds;
+        if (objectWorldBounds(ObjectKind::Circle, hoverIndex, bounds)) {
+            painter.drawEllipse(transform.mapRect(bounds));
         }
+        break;
     }
-    for (int i = 0; i < extendedLines.size(); ++i) {
-        const auto &line = extendedLines[i];
-        auto [pa, pb] = extendedLineEndpoints(line);
-        QPointF a = map(pa);
-        QPointF b = map(pb);
-        double dist = pointToSegmentDistance(event->position(), a, b, true);
-        if (dist <= bestLineDist) {
-            bestLineDist = dist;
-            hitExtendedLine = i;
-            hitLine = -1;
+    }
+}
+
+void CanvasWidget::mouseReleaseEvent(QMouseEvent *event) {
+    // Pending motion is applied first so the release sees the same state the user saw.
+    processPendingInput();
+    stampInput(InputKind::Press);
+    if (panning && event->button() == Qt::MiddleButton) {
+        panning = false;
+        unsetCursor();
+        event->accept();
+    } else if (bandActive && event->button() == Qt::LeftButton) {
+        updateBand(event->position());
+        finishBand();
+        event->accept();
+    } else if (dragPoint >= 0 && event->button() == Qt::LeftButton) {
+        const int index = dragPoint;
+        dragPoint = -1;
+        if (dragMoved && index < points().size()) {
+            // Taken first: moving a paged-in point loads the whole scene and renumbers the containers.
+            const quint32 id = objectIds().id(ObjectIds::Point, index);
+            const QPointF to = viewport.mapToWorld(event->position());
+            if (movePoint(index, to)) {
+                emit pointMoved(id, dragOrigin, to);
+            }
         }
+        event->accept();
+    } else {
+        QWidget::mouseReleaseEvent(event);
+    }
+    settleInputStamp();
+}
+
+void CanvasWidget::ensurePickIndex() const {
+    if (pickIndexRevision == sceneRevision) {
+        return;
     }
-    bool lineWasSelected = (hitLine >= 0 && selectedLineIndices.contains(hitLine)) ||
-                           (hitExtendedLine >= 0 && selectedExtendedLineIndices.contains(hitExtendedLine));
+    QVector<SpatialIndex::Item> items;
+    items.reserve(points().size() + lines().size() + extendedLines().size() + circles().size());
+    auto addKind = [&](ObjectKind kind, int count) {
+        for (int i = 0; i < count; ++i) {
+            QRectF bounds;
+            if (objectWorldBounds(kind, i, bounds)) {
+                items.append(SpatialIndex::Item{bounds, int(kind), i});
+            }
+        }
+    };
+    addKind(ObjectKind::Point, points().size());
+    addKind(ObjectKind::Line, lines().size());
+    addKind(ObjectKind::ExtendedLine, extendedLines().size());
+    addKind(ObjectKind::Circle, circles().size());
+    pickIndex.build(items);
+    pickIndexRevision = sceneRevision;
+}
 
-    int hitCircle = -1;
+CanvasWidget::PickResult CanvasWidget::pickAt(const QPointF &screenPos) const {
+    ensurePickIndex();
+    PickResult hit;
+    const double tolerancePx = 8.0;
+    const double tolWorld = tolerancePx / viewport.scale();
+    const QPointF world = viewport.mapToWorld(screenPos);
+    QVector<SpatialIndex::Item> candidates;
+    pickIndex.query(QRectF(world.x() - tolWorld, world.y() - tolWorld, 2 * tolWorld, 2 * tolWorld), candidates);
+    // Visit candidates by kind, then index, so ties resolve exactly as a linear scan would:
+    // points, then lines, then extended lines (which win ties over lines), then circles.
+    std::sort(candidates.begin(), candidates.end(), [](const SpatialIndex::Item &a, const SpatialIndex::Item &b) {
+        return a.kind != b.kind ? a.kind < b.kind : a.index < b.index;
+    });
+
+    double bestDist2 = std::numeric_limits<double>::max();
+    const double tol2 = tolerancePx * tolerancePx;
+    double bestLineDist = tolerancePx;  // threshold in px
     double bestCircleDist = tolerancePx;
-    for (int i = 0; i < circles.size(); ++i) {
-        const auto &c = circles[i];
-        QPointF mappedCenter = map(c.center);
-        double rpx = c.radius * (scale);  // radius in pixels
-        double dist = std::abs(std::hypot(event->position().x() - mappedCenter.x(),
-                                         event->position().y() - mappedCenter.y()) - rpx);
-        if (dist <= bestCircleDist) {
-            bestCircleDist = dist;
-            hitCircle = i;
+    for (const auto &candidate : candidates) {
+        const int i = candidate.index;
+        switch (ObjectKind(candidate.kind)) {
+        case ObjectKind::Point: {
+            QPointF screen = viewport.mapToScreen(points()[i].positiom);
+            double dx = screen.x() - screenPos.x();
+            double dy = screen.y() - screenPos.y();
+            double d2 = dx * dx + dy * dy;
+            if (d2 <= tol2 && d2 < bestDist2) {
+                bestDist2 = d2;
+                hit.point = i;
+            }
+            break;
+        }
+        case ObjectKind::Line: {
+            auto [pa, pb] = lineEndpoints(lines()[i]);
+            double dist = pointToSegmentDistance(screenPos, viewport.mapToScreen(pa), viewport.mapToScreen(pb), false);
+            if (dist <= bestLineDist) {
+                bestLineDist = dist;
+                hit.line = i;
+            }
+            break;
         }
+        case ObjectKind::ExtendedLine: {
+            auto [pa, pb] = extendedLineEndpoints(extendedLines()[i]);
+            double dist = pointToSegmentDistance(screenPos, viewport.mapToScreen(pa), viewport.mapToScreen(pb), true);
+            if (dist <= bestLineDist) {
+                bestLineDist = dist;
+                hit.extendedLine = i;
+                hit.line = -1;
+            }
+            break;
+        }
+        case ObjectKind::Circle: {
+            const auto &c = circles()[i];
+            QPointF mappedCenter = viewport.mapToScreen(c.center);
+            double rpx = c.radius * viewport.scale();  // radius in pixels
+            double dist = std::abs(std::hypot(screenPos.x() - mappedCenter.x(), screenPos.y() - mappedCenter.y()) - rpx);
+            if (dist <= bestCircleDist) {
+                bestCircleDist = dist;
+                hit.circle = i;
+            }
+            break;
+        }
+        }
+    }
+    return hit;
+}
+
+void CanvasWidget::mousePressEvent(QMouseEvent *event) {
+    processPendingInput();
+    stampInput(InputKind::Press);
+    // Middle-button drag pans the view.
+    if (event->button() == Qt::MiddleButton) {
+        panning = true;
+        lastPanPosition = event->position();
+        setCursor(Qt::ClosedHandCursor);
+        event->accept();
+        settleInputStamp();
+        return;
     }
 
+    auto unmap = [&](const QPointF &p) -> QPointF {
+        return viewport.mapToWorld(p);
+    };
+
+    const PickResult pick = pickAt(event->position());
+    const int hitPoint = pick.point;
+    const int hitLine = pick.line;
+    const int hitExtendedLine = pick.extendedLine;
+    const int hitCircle = pick.circle;
+    bool lineWasSelected = (hitLine >= 0 && selectedLineIndices().contains(hitLine)) ||
+                           (hitExtendedLine >= 0 && selectedExtendedLineIndices().contains(hitExtendedLine));
+
     bool ctrl = event->modifiers().testFlag(Qt::ControlModifier);
     bool shift = event->modifiers().testFlag(Qt::ShiftModifier);
+    ObjectIds::Kind hitKind = ObjectIds::Point;
+    int hitIndex = -1;
     if (hitPoint >= 0) {
-        if (ctrl) {
-            if (selectedPointIndices.contains(hitPoint)) selectedPointIndices.remove(hitPoint);
-            else selectedPointIndices.insert(hitPoint);
-            pointSelectionOrder.removeAll(hitPoint);
-            pointSelectionOrder.append(hitPoint);
-        } else {
-            selectedPointIndices.clear();
-            selectedPointIndices.insert(hitPoint);
-            selectedLineIndices.clear();
-            selectedExtendedLineIndices.clear();
-            selectedCircleIndices.clear();
-            pointSelectionOrder.clear();
-            pointSelectionOrder.append(hitPoint);
-        }
+        hitIndex = hitPoint;
     } else if (hitLine >= 0) {
-        if (ctrl) {
-            if (selectedLineIndices.contains(hitLine)) selectedLineIndices.remove(hitLine);
-            else selectedLineIndices.insert(hitLine);
-        } else {
-            selectedLineIndices.clear();
-            selectedLineIndices.insert(hitLine);
-            selectedPointIndices.clear();
-            selectedExtendedLineIndices.clear();
-            selectedCircleIndices.clear();
-            pointSelectionOrder.clear();
-        }
+        hitKind = ObjectIds::Line;
+        hitIndex = hitLine;
     } else if (hitExtendedLine >= 0) {
-        if (ctrl) {
-            if (selectedExtendedLineIndices.contains(hitExtendedLine)) selectedExtendedLineIndices.remove(hitExtendedLine);
-            else selectedExtendedLineIndices.insert(hitExtendedLine);
-        } else {
-            selectedExtendedLineIndices.clear();
-            selectedExtendedLineIndices.insert(hitExtendedLine);
-            selectedLineIndices.clear();
-            selectedPointIndices.clear();
-            selectedCircleIndices.clear();
-            pointSelectionOrder.clear();
-        }
+        hitKind = ObjectIds::ExtendedLine;
+        hitIndex = hitExtendedLine;
     } else if (hitCircle >= 0) {
-        if (ctrl) {
-            if (selectedCircleIndices.contains(hitCircle)) selectedCircleIndices.remove(hitCircle);
-            else selectedCircleIndices.insert(hitCircle);
-        } else {
-            selectedCircleIndices.clear();
-            selectedCircleIndices.insert(hitCircle);
-            selectedPointIndices.clear();
-            selectedLineIndices.clear();
-            selectedExtendedLineIndices.clear();
-            pointSelectionOrder.clear();
+        hitKind = ObjectIds::Circle;
+        hitIndex = hitCircle;
+    }
+    // Ctrl toggles the object under the cursor; a plain click selects it alone.
+    if (ctrl) {
+        if (hitIndex >= 0 && editor.isSelected(hitKind, hitIndex)) {
+            editor.deselect(hitKind, hitIndex);
+        } else if (hitIndex >= 0) {
+            editor.select(hitKind, hitIndex);
+        }
+    } else {
+        editor.clearSelection();
+        if (hitIndex >= 0) {
+            editor.select(hitKind, hitIndex);
         }
-    } else if (!ctrl) {
-        selectedPointIndices.clear();
-        selectedLineIndices.clear();
-        selectedExtendedLineIndices.clear();
-        selectedCircleIndices.clear();
-        pointSelectionOrder.clear();
     }
-    update();
 
     bool handledShiftPoint = false;
     // If clicking near a line that was already selected and Shift is held, add a point on that line near the click.
     if (lineWasSelected && shift) {
         QPointF pa, pb;
         if (hitLine >= 0) {
-            std::tie(pa, pb) = lineEndpoints(lines[hitLine]);
+            std::tie(pa, pb) = lineEndpoints(lines()[hitLine]);
         } else if (hitExtendedLine >= 0) {
-            std::tie(pa, pb) = extendedLineEndpoints(extendedLines[hitExtendedLine]);
+            std::tie(pa, pb) = extendedLineEndpoints(extendedLines()[hitExtendedLine]);
         } else {
             // fallback: use last selected line index if any
-            if (!selectedLineIndices.isEmpty()) {
-                int idx = *selectedLineIndices.constBegin();
-                std::tie(pa, pb) = lineEndpoints(lines[idx]);
-            } else if (!selectedExtendedLineIndices.isEmpty()) {
-                int idx = *selectedExtendedLineIndices.constBegin();
-                std::tie(pa, pb) = extendedLineEndpoints(extendedLines[idx]);
+            if (!selectedLineIndices().isEmpty()) {
+                int idx = *selectedLineIndices().constBegin();
+                std::tie(pa, pb) = lineEndpoints(lines()[idx]);
+            } else if (!selectedExtendedLineIndices().isEmpty()) {
+                int idx = *selectedExtendedLineIndices().constBegin();
+                std::tie(pa, pb) = extendedLineEndpoints(extendedLines()[idx]);
             } else {
                 pa = pb = QPointF();
             }
@@ -1060,7 +1305,7 @@ void CanvasWidget::mousePressEvent(QMouseEvent *event) {
         double len2 = d.x() * d.x() + d.y() * d.y();
         if (len2 > 1e-12) {
             double t = ((clickLogical.x() - pa.x()) * d.x() + (clickLogical.y() - pa.y()) * d.y()) / len2;
-            if (hitExtendedLine >= 0 || (!selectedLineIndices.isEmpty() && hitLine < 0 && !selectedExtendedLineIndices.isEmpty())) {
+            if (hitExtendedLine >= 0 || (!selectedLineIndices().isEmpty() && hitLine < 0 && !selectedExtendedLineIndices().isEmpty())) {
                 // treat as infinite
             } else {
                 t = std::clamp(t, 0.0, 1.0);
@@ -1071,166 +1316,620 @@ void CanvasWidget::mousePressEvent(QMouseEvent *event) {
         }
     }
 
-    // Shift+click anywhere adds a point at that canvas location.
+    // Shift+click anywhere adds a point at that canvas location, snapped to nearby geometry or the grid.
     if (shift && !handledShiftPoint) {
-        QPointF logical = unmap(event->position());
+        QPointF logical = snapPosition(event->position());
         addPoint(logical, QString(), true);
     }
 
+    // Dragging a point moves it once the cursor has travelled a few pixels.
+    if (event->button() == Qt::LeftButton && !shift && !ctrl && hitPoint >= 0) {
+        dragPoint = hitPoint;
+        dragMoved = false;
+        dragPressPosition = event->position();
+        dragOrigin = points()[hitPoint].positiom;
+    }
+
+    // Dragging from empty space selects by rectangle, or by lasso with Alt held.
+    bool hitAnything = hitPoint >= 0 || hitLine >= 0 || hitExtendedLine >= 0 || hitCircle >= 0;
+    if (event->button() == Qt::LeftButton && !shift && !hitAnything) {
+        bandActive = true;
+        bandLasso = event->modifiers().testFlag(Qt::AltModifier);
+        bandAdditive = ctrl;
+        bandPath = QPolygonF() << event->position() << event->position();
+    }
+
+    settleInputStamp();
     QWidget::mousePressEvent(event);
 }
 
+void CanvasWidget::setSnapToObjects(bool enabled) {
+    snapToObjects = enabled;
+}
+
+void CanvasWidget::setSnapToGrid(bool enabled) {
+    snapToGrid = enabled;
+}
+
+void CanvasWidget::setGridSpacing(double spacing) {
+    if (spacing > 0.0) {
+        gridSpacing = spacing;
+    }
+}
+
+QPointF CanvasWidget::closestPointOnObject(ObjectKind kind, int index, const QPointF &world) const {
+    if (kind == ObjectKind::Circle) {
+        const auto &c = circles()[index];
+        QPointF d = world - c.center;
+        double len = std::hypot(d.x(), d.y());
+        if (len < 1e-12) return c.center + QPointF(c.radius, 0.0);
+        return c.center + d * (c.radius / len);
+    }
+    auto [a, b] = kind == ObjectKind::Line ? lineEndpoints(lines()[index]) : extendedLineEndpoints(extendedLines()[index]);
+    QPointF d = b - a;
+    double len2 = d.x() * d.x() + d.y() * d.y();
+    if (len2 < 1e-12) return a;
+    double t = std::clamp(((world.x() - a.x()) * d.x() + (world.y() - a.y()) * d.y()) / len2, 0.0, 1.0);
+    return a + t * d;
+}
+
+QPointF CanvasWidget::snapPosition(const QPointF &screenPos) {
+    const QPointF raw = viewport.mapToWorld(screenPos);
+    const double radiusPx = 10.0;
+    auto screenDistance = [&](const QPointF &world) {
+        return QLineF(viewport.mapToScreen(world), screenPos).length();
+    };
+
+    if (snapToObjects) {
+        const double radiusWorld = radiusPx / viewport.scale();
+        ensurePickIndex();
+        QVector<SpatialIndex::Item> candidates;
+        pickIndex.query(QRectF(raw.x() - radiusWorld, raw.y() - radiusWorld, 2 * radiusWorld, 2 * radiusWorld), candidates);
+        std::sort(candidates.begin(), candidates.end(), [](const SpatialIndex::Item &a, const SpatialIndex::Item &b) {
+            return a.kind != b.kind ? a.kind < b.kind : a.index < b.index;
+        });
+
+        // Existing points win, then intersections of nearby curves, then the nearest curve.
+        double best = radiusPx;
+        bool found = false;
+        QPointF snapped;
+        auto consider = [&](const QPointF &world) {
+            double d = screenDistance(world);
+            if (d <= best) {
+                best = d;
+                snapped = world;
+                found = true;
+            }
+        };
+        QVector<SpatialIndex::Item> curves;
+        for (const auto &candidate : candidates) {
+            if (ObjectKind(candidate.kind) == ObjectKind::Point) {
+                consider(points()[candidate.index].positiom);
+            } else {
+                curves.append(candidate);
+            }
+        }
+        if (found) return snapped;
+
+        // Dense clusters are capped so a Shift+click stays instant.
+        const int maxCurves = std::min<int>(curves.size(), 32);
+        for (int i = 0; i < maxCurves; ++i) {
+            for (int j = i + 1; j < maxCurves; ++j) {
+                const auto hits = editor.pairIntersections(ObjectIds::Kind(curves[i].kind), curves[i].index,
+                                                           ObjectIds::Kind(curves[j].kind), curves[j].index);
+                for (const auto &h : hits) consider(h);
+            }
+        }
+        if (found) return snapped;
+
+        for (const auto &curve : curves) {
+            consider(closestPointOnObject(ObjectKind(curve.kind), curve.index, raw));
+        }
+        if (found) return snapped;
+    }
+
+    if (snapToGrid) {
+        QPointF grid(std::round(raw.x() / gridSpacing) * gridSpacing, std::round(raw.y() / gridSpacing) * gridSpacing);
+        if (screenDistance(grid) <= radiusPx) return grid;
+    }
+    return raw;
+}
+
+QPolygonF CanvasWidget::bandPolygon() const {
+    if (bandLasso) {
+        return bandPath;
+    }
+    if (bandPath.size() < 2) {
+        return QPolygonF();
+    }
+    return QPolygonF(QRectF(bandPath.first(), bandPath.last()).normalized());
+}
+
+void CanvasWidget::invalidateBand() {
+    invalidateRect(bandPath.boundingRect().toAlignedRect().adjusted(-2, -2, 2, 2));
+}
+
+void CanvasWidget::updateBand(const QPointF &pos) {
+    invalidateBand();
+    if (bandLasso) {
+        if (QLineF(bandPath.last(), pos).length() >= 2.0) {
+            bandPath.append(pos);
+        }
+    } else {
+        bandPath.last() = pos;
+    }
+    invalidateBand();
+}
+
+void CanvasWidget::finishBand() {
+    invalidateBand();
+    bandActive = false;
+    const QPolygonF polygon = bandPolygon();
+    const QRectF extent = polygon.boundingRect();
+    if (extent.width() >= 3.0 || extent.height() >= 3.0) {
+        selectInPolygon(polygon, bandAdditive);
+    }
+    bandPath.clear();
+}
+
+void CanvasWidget::drawSelectionBand(QPainter &painter) const {
+    if (!bandActive) {
+        return;
+    }
+    painter.setPen(QPen(QColor(30, 90, 200), 1, Qt::DashLine));
+    painter.setBrush(QColor(30, 90, 200, 40));
+    painter.drawPolygon(bandPolygon());
+}
+
+void CanvasWidget::selectInPolygon(const QPolygonF &screenPolygon, bool additive) {
+    if (screenPolygon.size() < 3) {
+        return;
+    }
+    const QPolygonF polygon = viewport.screenToWorld().map(screenPolygon);
+    ensurePickIndex();
+    QVector<SpatialIndex::Item> candidates;
+    pickIndex.query(polygon.boundingRect(), candidates);
+    std::sort(candidates.begin(), candidates.end(), [](const SpatialIndex::Item &a, const SpatialIndex::Item &b) {
+        return a.kind != b.kind ? a.kind < b.kind : a.index < b.index;
+    });
+
+    auto inside = [&](const QPointF &p) {
+        return polygon.containsPoint(p, Qt::OddEvenFill);
+    };
+    // A segment with both ends inside is contained unless it leaves through a concave part of the lasso.
+    auto segmentInside = [&](const QPointF &a, const QPointF &b) {
+        if (!inside(a) || !inside(b)) return false;
+        for (int i = 0; i < polygon.size(); ++i) {
+            QPointF hit;
+            if (Geometry::segmentIntersection(a, b, polygon[i], polygon[(i + 1) % polygon.size()], hit)) return false;
+        }
+        return true;
+    };
+    auto circleInside = [&](const QPointF &c, double r) {
+        if (!inside(c)) return false;
+        for (int i = 0; i < polygon.size(); ++i) {
+            if (pointToSegmentDistance(c, polygon[i], polygon[(i + 1) % polygon.size()], false) < r) return false;
+        }
+        return true;
+    };
+
+    if (!additive) {
+        editor.clearSelection();
+    }
+    for (const auto &candidate : candidates) {
+        const int i = candidate.index;
+        switch (ObjectKind(candidate.kind)) {
+        case ObjectKind::Point:
+            if (inside(points()[i].positiom) && !editor.isSelected(ObjectIds::Point, i)) {
+                editor.select(ObjectIds::Point, i);
+            }
+            break;
+        case ObjectKind::Line: {
+            auto [a, b] = lineEndpoints(lines()[i]);
+            if (segmentInside(a, b)) editor.select(ObjectIds::Line, i);
+            break;
+        }
+        case ObjectKind::ExtendedLine: {
+            auto [a, b] = extendedLineEndpoints(extendedLines()[i]);
+            if (segmentInside(a, b)) editor.select(ObjectIds::ExtendedLine, i);
+            break;
+        }
+        case ObjectKind::Circle:
+            if (circleInside(circles()[i].center, circles()[i].radius)) editor.select(ObjectIds::Circle, i);
+            break;
+        }
+    }
+}
+
 bool CanvasWidget::loadPointsFromFile(const QString &path) {
-    if (path.isEmpty()) {
+    Scene scene;
+    auto progress = [this](qint64 done, qint64 total) {
+        emit loadProgress(total > 0 ? int(done * 100 / total) : 100);
+    };
+    SceneFile::ReadInfo info;
+    if (!SceneFile::read(path, scene, progress, &info)) {
         return false;
     }
-    QFile file(path);
-    if (!file.exists()) {
+    // The stored index and intersections are only trusted for the geometry they were built from.
+    const quint64 hash = info.cache.isEmpty() ? 0 : SceneCache::geometryHash(scene);
+    setScene(std::move(scene));
+    if (hash && SceneCache::decode(info.cache, hash, pickIndex, intersectionCache)) {
+        pickIndexRevision = sceneRevision;
+    }
+    // A chunked file can be updated in place until something else rewrites it.
+    chunkGeneration = info.generation;
+    return true;
+}
+
+void CanvasWidget::setScene(Scene &&scene) {
+    pager.close();
+    residentIds = TilePager::Ids();
+    resetChunkedBase();
+    dragPoint = -1;
+    editor.setScene(std::move(scene));
+}
+
+bool CanvasWidget::openPaged(const QString &path) {
+    if (!pager.open(path)) {
         return false;
     }
-    if (!file.open(QIODevice::ReadOnly)) {
+    // Nothing selected carries over from the previous scene.
+    residentIds = TilePager::Ids();
+    pager.update(viewport.visibleWorldRect());
+    Scene scene;
+    TilePager::Ids ids;
+    pager.residentScene(scene, ids);
+    adoptResident(std::move(scene), &ids);
+    return true;
+}
+
+void CanvasWidget::pageTiles() {
+    if (!pager.isOpen() || !pager.update(viewport.visibleWorldRect())) {
+        return;
+    }
+    Scene scene;
+    TilePager::Ids ids;
+    pager.residentScene(scene, ids);
+    adoptResident(std::move(scene), &ids);
+}
+
+// Replaces the editor's scene with a new resident set, or with the whole
+// scene when ids is null. Selections and the dragged point follow their
+// objects by scene-wide index; objects that left the resident set drop out.
+void CanvasWidget::adoptResident(Scene &&scene, const TilePager::Ids *ids) {
+    auto mapper = [this, ids](ObjectKind kind, const QVector<quint32> &to) {
+        QHash<quint32, int> slots;
+        if (ids) {
+            slots.reserve(to.size());
+            for (int i = 0; i < to.size(); ++i) slots.insert(to[i], i);
+        }
+        return [this, ids, kind, slots](int index) {
+            const int id = sceneIndex(kind, index);
+            return id < 0 || !ids ? id : slots.value(quint32(id), -1);
+        };
+    };
+    auto remap = [](const QSet<int> &selection, const auto &map) {
+        QSet<int> mapped;
+        for (int index : selection) {
+            const int slot = map(index);
+            if (slot >= 0) mapped.insert(slot);
+        }
+        return mapped;
+    };
+    const TilePager::Ids whole;
+    const TilePager::Ids &to = ids ? *ids : whole;
+    const auto mapPoint = mapper(ObjectKind::Point, to.points);
+    QList<int> order;
+    for (int index : pointSelectionOrder()) {
+        const int slot = mapPoint(index);
+        if (slot >= 0) order.append(slot);
+    }
+    dragPoint = mapPoint(dragPoint);
+    QSet<int> kept[ObjectIds::KindCount] = {
+        remap(selectedPointIndices(), mapPoint),
+        remap(selectedLineIndices(), mapper(ObjectKind::Line, to.lines)),
+        remap(selectedExtendedLineIndices(), mapper(ObjectKind::ExtendedLine, to.extendedLines)),
+        remap(selectedCircleIndices(), mapper(ObjectKind::Circle, to.circles)),
+    };
+
+    // Paged-in objects are known by their scene-wide index, which is also their id once the whole scene loads.
+    ObjectIds sceneIds;
+    if (ids) {
+        sceneIds.assign(ObjectIds::Point, ids->points);
+        sceneIds.assign(ObjectIds::Line, ids->lines);
+        sceneIds.assign(ObjectIds::ExtendedLine, ids->extendedLines);
+        sceneIds.assign(ObjectIds::Circle, ids->circles);
+    } else {
+        sceneIds.reset(scene.points.size(), scene.lines.size(), scene.extendedLines.size(), scene.circles.size());
+    }
+    residentIds = ids ? *ids : TilePager::Ids();
+    resetChunkedBase();
+    editor.setScene(std::move(scene), sceneIds);
+    for (int index : order) {
+        editor.select(ObjectIds::Point, index);
+    }
+    for (int kind = 0; kind < ObjectIds::KindCount; ++kind) {
+        for (int index : kept[kind]) {
+            if (!editor.isSelected(ObjectIds::Kind(kind), index)) editor.select(ObjectIds::Kind(kind), index);
+        }
+    }
+}
+
+int CanvasWidget::sceneIndex(ObjectKind kind, int index) const {
+    if (!pager.isOpen()) {
+        return index;
+    }
+    const QVector<quint32> *ids = &residentIds.points;
+    switch (kind) {
+    case ObjectKind::Point: ids = &residentIds.points; break;
+    case ObjectKind::Line: ids = &residentIds.lines; break;
+    case ObjectKind::ExtendedLine: ids = &residentIds.extendedLines; break;
+    case ObjectKind::Circle: ids = &residentIds.circles; break;
+    }
+    return index >= 0 && index < ids->size() ? int((*ids)[index]) : -1;
+}
+
+// Loads every tile before the scene is edited or saved, so indices and
+// journal records refer to the whole scene.
+bool CanvasWidget::materialize() {
+    if (!pager.isOpen()) {
+        return true;
+    }
+    Scene scene;
+    if (!pager.scene().readAll(scene)) {
         return false;
     }
-    const auto data = file.readAll();
-    file.close();
-    auto doc = QJsonDocument::fromJson(data);
-    if (!doc.isObject()) {
+    // Tiles keep a line whose endpoint was missing when written; the edits index through it.
+    SceneFile::dropDanglingLines(scene);
+    adoptResident(std::move(scene), nullptr);
+    pager.close();
+    return true;
+}
+
+Scene CanvasWidget::snapshot() const {
+    // The containers are implicitly shared, so this does not copy any geometry.
+    Scene scene;
+    scene.points = points();
+    scene.lines = lines();
+    scene.extendedLines = extendedLines();
+    scene.circles = circles();
+    return scene;
+}
+
+SceneFile::WriteOptions CanvasWidget::saveOptions(const QString &path, bool compact) const {
+    SceneFile::WriteOptions options;
+    options.format = SceneFile::formatForPath(path);
+    options.compact = compact;
+    if (options.format == SceneFile::Format::Chunked) {
+        // Zero marks a file with no known base, so generations never take it.
+        options.generation = QRandomGenerator::global()->generate64() | 1;
+        options.baseGeneration = chunkGeneration;
+        options.changes = changes;
+    }
+    return options;
+}
+
+// A chunked file on disk is only a base for in-place updates while it holds
+// this scene; loading or paging in anything else starts over.
+void CanvasWidget::resetChunkedBase() {
+    changes.clear();
+    savingChanges.clear();
+    chunkGeneration = 0;
+    savingGeneration = 0;
+}
+
+// Settles the chunked bookkeeping of a background save: on success its file
+// is the new base, otherwise the changes it carried are still unsaved.
+void CanvasWidget::chunkedSaveFinished(bool ok) {
+    if (savingGeneration == 0) {
+        return;
+    }
+    if (ok) {
+        chunkGeneration = savingGeneration;
+    } else {
+        changes.merge(savingChanges);
+    }
+    savingChanges.clear();
+    savingGeneration = 0;
+}
+
+bool CanvasWidget::writePointsToPath(const QString &path, SceneFile::WriteOptions options) const {
+    const Scene scene = snapshot();
+    if (options.format == SceneFile::Format::Binary) {
+        ensurePickIndex();
+        options.cache = SceneCache::encode(SceneCache::geometryHash(scene), pickIndex, intersectionCache);
+    }
+    return SceneFile::write(path, scene, options);
+}
+
+bool CanvasWidget::loadFromFile(const QString &path, JournalRecovery recovery) {
+    if (path.isEmpty()) {
         return false;
     }
-    selectedPointIndices.clear();
-    selectedLineIndices.clear();
-    selectedExtendedLineIndices.clear();
-    selectedCircleIndices.clear();
-    pointSelectionOrder.clear();
-    points.clear();
-    lines.clear();
-    extendedLines.clear();
-    circles.clear();
-    QJsonObject root = doc.object();
-    QJsonArray pointsArr = root.value("points").toArray();
-    for (const auto &value : pointsArr) {
-        if (!value.isObject()) continue;
-        const auto obj = value.toObject();
-        double x = obj.value("x").toDouble();
-        double y = obj.value("y").toDouble();
-        QString label = obj.value("label").toString();
-        points.append(Point(QPointF(x, y), label));
-    }
-    QJsonArray linesArr = root.value("lines").toArray();
-    for (const auto &value : linesArr) {
-        if (!value.isObject()) continue;
-        const auto obj = value.toObject();
-        int a = obj.value("a").toInt(-1);
-        int b = obj.value("b").toInt(-1);
-        QString label = obj.value("label").toString();
-        if (obj.value("custom").toBool(false)) {
-            QPointF customA(obj.value("customAx").toDouble(), obj.value("customAy").toDouble());
-            QPointF customB(obj.value("customBx").toDouble(), obj.value("customBy").toDouble());
-            extendedLines.append(ExtendedLine(customA, customB, label));
-        } else if (a >= 0 && b >= 0) {
-            lines.append(Line(a, b, label));
+    const bool recoverable = SceneJournal::hasRecoverableEdits(path);
+    if (recovery == JournalRecovery::Recover && recoverable) {
+        Scene scene;
+        if (SceneJournal::recover(path, scene)) {
+            setScene(std::move(scene));
+            storagePath = path;
+            journal.resume(path);
+            closeSession();
+            return true;
+        }
+    }
+    // Tiled scenes open paged: only the tiles around the view are read now.
+    if (isTiledFile(path)) {
+        if (!openPaged(path)) {
+            return false;
         }
+    } else if (!loadPointsFromFile(path)) {
+        return false;
     }
-    QJsonArray extArr = root.value("extendedLines").toArray();
-    for (const auto &value : extArr) {
-        if (!value.isObject()) continue;
-        const auto obj = value.toObject();
-        QString label = obj.value("label").toString();
-        QPointF a(obj.value("ax").toDouble(), obj.value("ay").toDouble());
-        QPointF b(obj.value("bx").toDouble(), obj.value("by").toDouble());
-        extendedLines.append(ExtendedLine(a, b, label));
-    }
-    QJsonArray circlesArr = root.value("circles").toArray();
-    for (const auto &value : circlesArr) {
-        if (!value.isObject()) continue;
-        const auto obj = value.toObject();
-        double cx = obj.value("x").toDouble();
-        double cy = obj.value("y").toDouble();
-        double r = obj.value("r").toDouble();
-        QString label = obj.value("label").toString();
-        if (r > 0.0) {
-            circles.append(Circle(QPointF(cx, cy), r, label));
+    storagePath = path;
+    if (recovery == JournalRecovery::Keep && recoverable) {
+        // Nobody declined the earlier edits, so the document's journal is left as it is and this
+        // copy is journaled as untitled work. A paged scene has no snapshot to base that on.
+        if (isPaged()) {
+            journal.detach();
+            closeSession();
+        } else {
+            startSession(snapshot());
         }
+        return true;
     }
-    update();
+    journal.attach(path);
+    closeSession();
     return true;
 }
 
-bool CanvasWidget::writePointsToPath(const QString &path) const {
-    if (path.isEmpty()) {
+bool CanvasWidget::recoverSession(const QString &document) {
+    auto lock = std::make_unique<QLockFile>(document + ".lock");
+    Scene scene;
+    if (!lock->tryLock(0) || !SceneJournal::recover(document, scene)) {
         return false;
     }
-    QJsonArray pointsArr;
-    for (const auto &entry : points) {
-        QJsonObject obj;
-        obj.insert("x", entry.positiom.x());
-        obj.insert("y", entry.positiom.y());
-        obj.insert("label", entry.label);
-        pointsArr.append(obj);
-    }
-    QJsonArray linesArr;
-    for (const auto &line : lines) {
-        QJsonObject obj;
-        obj.insert("a", line.a);
-        obj.insert("b", line.b);
-        obj.insert("label", line.label);
-        linesArr.append(obj);
-    }
-    QJsonArray extendedArr;
-    for (const auto &line : extendedLines) {
-        QJsonObject obj;
-        obj.insert("ax", line.a.x());
-        obj.insert("ay", line.a.y());
-        obj.insert("bx", line.b.x());
-        obj.insert("by", line.b.y());
-        obj.insert("label", line.label);
-        extendedArr.append(obj);
-    }
-    QJsonArray circlesArr;
-    for (const auto &circle : circles) {
-        QJsonObject obj;
-        obj.insert("x", circle.center.x());
-        obj.insert("y", circle.center.y());
-        obj.insert("r", circle.radius);
-        obj.insert("label", circle.label);
-        circlesArr.append(obj);
-    }
-    QJsonObject root;
-    root.insert("points", pointsArr);
-    root.insert("lines", linesArr);
-    root.insert("extendedLines", extendedArr);
-    root.insert("circles", circlesArr);
-    QJsonDocument doc(root);
-
-    QDir().mkpath(QFileInfo(path).absolutePath());
-    QFile file(path);
-    bool ok = false;
-    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        file.write(doc.toJson(QJsonDocument::Indented));
-        file.close();
-        ok = true;
+    journal.detach();
+    closeSession();
+    setScene(std::move(scene));
+    storagePath.clear();
+    sessionDocument = document;
+    sessionLock = std::move(lock);
+    journal.resume(document);
+    return true;
+}
+
+void CanvasWidget::startSession(const Scene &base) {
+    journal.detach();
+    closeSession();
+    const QString directory = SceneJournal::sessionDirectory();
+    if (!QDir().mkpath(directory)) {
+        return;
+    }
+    const QString document = QDir(directory).filePath(
+        QString("untitled-%1-%2").arg(QDateTime::currentMSecsSinceEpoch()).arg(QCoreApplication::applicationPid()));
+    auto lock = std::make_unique<QLockFile>(document + ".lock");
+    if (!lock->tryLock(0)) {
+        return;
     }
-    return ok;
+    sessionDocument = document;
+    sessionLock = std::move(lock);
+    journal.attachSnapshot(document, base);
 }
 
-bool CanvasWidget::loadFromFile(const QString &path) {
+void CanvasWidget::closeSession(bool keepEdits) {
+    if (sessionDocument.isEmpty()) {
+        return;
+    }
+    // A failed rebase leaves the journal on the session, which then stays open.
+    journal.waitForWrites();
+    if (journal.documentPath() == sessionDocument) {
+        return;
+    }
+    if (!keepEdits || !SceneJournal::hasRecoverableEdits(sessionDocument)) {
+        SceneJournal::discard(sessionDocument);
+    }
+    sessionLock.reset();
+    sessionDocument.clear();
+}
+
+void CanvasWidget::compactJournal() {
+    // Replay cost grows with the journal, so fold it into a snapshot once it gets large.
+    const qint64 compactThreshold = 1 << 20;
+    if (journal.isAttached() && journal.bytesSinceCompaction() > compactThreshold) {
+        journal.compact(snapshot());
+    }
+}
+
+bool CanvasWidget::saveToFile(const QString &path, bool compact) {
     if (path.isEmpty()) {
         return false;
     }
-    if (!loadPointsFromFile(path)) {
+    if (!materialize()) {
         return false;
     }
+    // A background save of an older state must not land after this one.
+    if (saveWatcher) {
+        saveWatcher->waitForFinished();
+        chunkedSaveFinished(saveWatcher->result());
+    }
+    const SceneFile::WriteOptions options = saveOptions(path, compact);
+    if (!writePointsToPath(path, options)) {
+        return false;
+    }
+    if (options.format == SceneFile::Format::Chunked) {
+        chunkGeneration = options.generation;
+        changes.clear();
+    }
     storagePath = path;
+    journal.rebase(path);
+    closeSession();
     return true;
 }
 
-bool CanvasWidget::saveToFile(const QString &path) {
+bool CanvasWidget::saveToFileAsync(const QString &path, bool compact) {
     if (path.isEmpty()) {
         return false;
     }
-    if (!writePointsToPath(path)) {
+    if (!materialize()) {
         return false;
     }
-    storagePath = path;
+    // One save runs at a time; a request made meanwhile replaces any earlier waiting one.
+    if (isSaving()) {
+        pendingSavePath = path;
+        pendingSaveCompact = compact;
+        return true;
+    }
+    if (!saveWatcher) {
+        saveWatcher = new QFutureWatcher<bool>(this);
+        connect(saveWatcher, &QFutureWatcher<bool>::finished, this, &CanvasWidget::asyncSaveFinished);
+    }
+    SceneFile::WriteOptions options = saveOptions(path, compact);
+    if (options.format == SceneFile::Format::Chunked) {
+        // Edits made from here on are changes relative to the file this save writes.
+        savingChanges = options.changes;
+        savingGeneration = options.generation;
+        changes.clear();
+    }
+    // The worker owns a shared snapshot; later edits detach the canvas containers instead of touching it.
+    const Scene scene = snapshot();
+    // Binary files also carry the pick index and intersections; copies are shared like the scene, and
+    // hashing and encoding them happen on the worker.
+    const bool withCache = options.format == SceneFile::Format::Binary;
+    if (withCache) {
+        ensurePickIndex();
+    }
+    const SpatialIndex index = withCache ? pickIndex : SpatialIndex();
+    const IntersectionCache intersections = withCache ? intersectionCache : IntersectionCache();
+    savingPath = path;
+    saveWatcher->setFuture(QtConcurrent::run([scene, path, options, withCache, index, intersections]() mutable {
+        if (withCache) {
+            options.cache = SceneCache::encode(SceneCache::geometryHash(scene), index, intersections);
+        }
+        return SceneFile::write(path, scene, options);
+    }));
+    // Edits made while the save runs are journaled after the rebase, on top of the saved file.
+    journal.rebase(path, saveWatcher->future());
     return true;
 }
+
+bool CanvasWidget::isSaving() const {
+    return saveWatcher && saveWatcher->isRunning();
+}
+
+void CanvasWidget::asyncSaveFinished() {
+    const bool ok = saveWatcher->result();
+    chunkedSaveFinished(ok);
+    const QString path = savingPath;
+    savingPath.clear();
+    if (ok) {
+        // The journal has moved next to the saved file, leaving the untitled session behind.
+        storagePath = path;
+        closeSession();
+    }
+    emit saveFinished(path, ok);
+    if (!pendingSavePath.isEmpty()) {
+        const QString next = pendingSavePath;
+        pendingSavePath.clear();
+        saveToFileAsync(next, pendingSaveCompact);
+    }
+}
@@ -7,26 +7,62 @@
 #include <QSet>
 #include <QMouseEvent>
 #include <QPair>
+#include <QPolygonF>
+#include <memory>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QRegion>
+#include <QTransform>
 
-class CanvasWidget : public QWidget {
+#include "chunkedscene.h"
+#include "framestats.h"
+#include "intersectioncache.h"
+#include "labellayout.h"
+#include "macro.h"
+#include "objectids.h"
+#include "scene.h"
+#include "sceneeditor.h"
+#include "scenefile.h"
+#include "scenejournal.h"
+#include "spatialindex.h"
+#include "tiledscene.h"
+#include "tilerenderer.h"
+#include "viewport.h"
+
+class QLockFile;
+class QPainter;
+class QTimer;
+template <typename T>
+class QFutureWatcher;
+
+class CanvasWidget : public QWidget, private SceneEditor::Observer {
     Q_OBJECT
 
 public:
+    enum class InputKind { Press, Motion, Wheel };
+    // What loadFromFile does with edits journaled for the file by an earlier
+    // session: Keep leaves them for a later open, Discard drops them.
+    enum class JournalRecovery { Keep, Recover, Discard };
+
     explicit CanvasWidget(const QString &storagePath = QString(), QWidget *parent = nullptr);
+    ~CanvasWidget() override;
     bool addPoint(const QPointF &point, const QString &label, bool selectNew = false);
     bool hasPoint(const QPointF &point) const;
     int pointCount() const;
     bool addLineBetweenSelected(const QString &label = QString());
     bool extendSelectedLines();
     bool addCircle(const QPointF &center, double radius);
+    bool addCircleFromSelected();
     bool selectedPoint(QPointF &point) const;
     bool addNormalAtPoint(int lineIndex, const QPointF &point);
-    QList<int> selectedIndices() const { return selectedPointIndices.values(); }
-    QList<int> selectedPointsOrdered() const { return pointSelectionOrder; }
-    int selectedLineIndex() const { return selectedLineIndices.isEmpty() ? -1 : *selectedLineIndices.constBegin(); }
-    int selectedExtendedLineIndex() const { return selectedExtendedLineIndices.isEmpty() ? -1 : *selectedExtendedLineIndices.constBegin(); }
-    int selectedExtendedLineCount() const { return selectedExtendedLineIndices.size(); }
-    QPointF pointAt(int index) const { return points.at(index).positiom; }
+    bool addNormalFromSelected();
+    bool movePoint(int index, const QPointF &position);
+    QList<int> selectedIndices() const { return selectedPointIndices().values(); }
+    QList<int> selectedPointsOrdered() const { return pointSelectionOrder(); }
+    int selectedLineIndex() const { return selectedLineIndices().isEmpty() ? -1 : *selectedLineIndices().constBegin(); }
+    int selectedExtendedLineIndex() const { return selectedExtendedLineIndices().isEmpty() ? -1 : *selectedExtendedLineIndices().constBegin(); }
+    int selectedExtendedLineCount() const { return selectedExtendedLineIndices().size(); }
+    QPointF pointAt(int index) const { return points().at(index).positiom; }
     bool lineEndpointsAt(int index, QPointF &a, QPointF &b) const;
     bool extendedLineEndpointsAt(int index, QPointF &a, QPointF &b) const;
     bool circleAt(int index, QPointF &center, double &radius) const;
@@ -39,76 +75,231 @@ public:
     QString suggestedLineLabel() const;
     void recomputeAllIntersections();
     void recomputeSelectedIntersections();
-    bool loadFromFile(const QString &path);
-    bool saveToFile(const QString &path);
+    bool loadFromFile(const QString &path, JournalRecovery recovery = JournalRecovery::Keep);
+    // Continues an untitled scene from SceneJournal::abandonedSessions().
+    bool recoverSession(const QString &sessionDocument);
+    bool saveToFile(const QString &path, bool compact = false);
+    bool saveToFileAsync(const QString &path, bool compact = false);
+    bool isSaving() const;
     QString storageFilePath() const { return storagePath; }
+    // True while a tiled scene is shown from the tiles around the view; the
+    // first edit loads the rest.
+    bool isPaged() const { return pager.isOpen(); }
     void clearSelection();
     bool selectPointByPosition(const QPointF &pt, bool additive = false, double tol = 1e-4);
     bool selectLineByEndpoints(const QPointF &a, const QPointF &b, bool additive = false, double tol = 1e-4);
     bool selectExtendedLineByEndpoints(const QPointF &a, const QPointF &b, bool additive = false, double tol = 1e-4);
     bool selectCircleByCenterRadius(const QPointF &center, double radius, bool additive = false, double tol = 1e-4);
+    // Plays one macro command through the SceneEditor; false when it changed
+    // nothing. Open and Save go through loadFromFile and saveToFile.
+    bool runCommand(const Macro &macro, int index);
     QVector<QPointF> selectedPointPositions() const;
     QVector<QPair<QPointF, QPointF>> selectedLineEndpoints() const;
     QVector<QPair<QPointF, QPointF>> selectedExtendedLineEndpoints() const;
     QVector<QPair<QPointF, double>> selectedCircleData() const;
+    // Creation-order ids (see ObjectIds). Renumbering gives every object its
+    // index as id, so recording and replaying a macro from the same scene
+    // hand out the same ids.
+    void renumberObjects();
+    quint32 objectId(ObjectIds::Kind kind, int index) const { return objectIds().id(kind, index); }
+    int objectIndex(ObjectIds::Kind kind, quint32 id) const { return objectIds().indexOf(kind, id); }
+    bool selectObject(ObjectIds::Kind kind, quint32 id, bool additive = false);
+    QVector<quint32> selectedObjectIds(ObjectIds::Kind kind) const;
+    QImage renderToImage(const QSize &size, qreal devicePixelRatio = 1.0) const;
+    void resetView();
+    const FrameStats &frameStats() const { return stats; }
+    void resetFrameStats();
+    bool statsOverlayVisible() const { return statsOverlay; }
+    void setStatsOverlayVisible(bool visible);
+    const LatencyHistogram &inputLatency(InputKind kind) const { return latency[int(kind)]; }
+    QString inputLatencyReport() const;
+    bool snapsToObjects() const { return snapToObjects; }
+    void setSnapToObjects(bool enabled);
+    bool snapsToGrid() const { return snapToGrid; }
+    void setSnapToGrid(bool enabled);
+    double gridSpacingValue() const { return gridSpacing; }
+    void setGridSpacing(double spacing);
 
 signals:
     void pointAdded(const QPointF &point);
+    void pointMoved(quint32 id, const QPointF &from, const QPointF &to);
+    void loadProgress(int percent);
+    void saveFinished(const QString &path, bool ok);
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
 
 private:
-    struct Object {
-        QString label;
-        explicit Object(const QString &label = QString()) : label(label) {}
-        virtual ~Object() = default;
-    };
-    struct Point : public Object {
-        QPointF positiom;
-        Point() = default;
-        Point(const QPointF &point, const QString &label) : Object(label), positiom(point) {}
-    };
-    struct Line : public Object {
-        int a = -1;
-        int b = -1;
-        Line() = default;
-        Line(int a, int b, const QString &label) : Object(label), a(a), b(b) {}
-    };
-    struct ExtendedLine : public Object {
-        QPointF a;
-        QPointF b;
-        ExtendedLine() = default;
-        ExtendedLine(const QPointF &a, const QPointF &b, const QString &label) : Object(label), a(a), b(b) {}
-    };
-    struct Circle : public Object {
-        QPointF center;
-        double radius = 0.0;
-        Circle() = default;
-        Circle(const QPointF &center, double radius, const QString &label = QString()) : Object(label), center(center), radius(radius) {}
+    enum class ObjectKind { Point, Line, ExtendedLine, Circle };
+
+    struct PickResult {
+        int point = -1;
+        int line = -1;
+        int extendedLine = -1;
+        int circle = -1;
     };
 
-    QVector<Point> points;
-    QVector<Line> lines;
-    QVector<ExtendedLine> extendedLines;
-    QVector<Circle> circles;
+    using Object = Scene::Object;
+    using Point = Scene::Point;
+    using Line = Scene::Line;
+    using ExtendedLine = Scene::ExtendedLine;
+    using Circle = Scene::Circle;
+
+    // The scene, its ids and the selection live in the editor, which makes
+    // every edit; the canvas follows each one as its Observer.
+    SceneEditor editor;
     QString storagePath;
-    QSet<int> selectedPointIndices;
-    QSet<int> selectedLineIndices;
-    QSet<int> selectedExtendedLineIndices;
-    QSet<int> selectedCircleIndices;
-    QList<int> pointSelectionOrder;
+    SceneJournal journal;
+    // Journal document of the untitled session while the journal follows one.
+    QString sessionDocument;
+    std::unique_ptr<QLockFile> sessionLock;
+    TilePager pager;
+    TilePager::Ids residentIds;
+    QTimer *compactTimer = nullptr;
+    QFutureWatcher<bool> *saveWatcher = nullptr;
+    QString savingPath;
+    QString pendingSavePath;
+    bool pendingSaveCompact = false;
+    // Objects changed since the scene matched the chunked file with chunkGeneration.
+    ChunkedScene::Changes changes;
+    ChunkedScene::Changes savingChanges;
+    quint64 chunkGeneration = 0;
+    quint64 savingGeneration = 0;
+    quint64 sceneRevision = 0;
+    quint64 structureRevision = 0;
+    mutable QVector<QVector<int>> pointLines;
+    mutable quint64 pointLinesRevision = ~quint64(0);
+    IntersectionCache intersectionCache;
+    bool snapToObjects = true;
+    bool snapToGrid = false;
+    double gridSpacing = 0.5;
+    int dragPoint = -1;
+    bool dragMoved = false;
+    QPointF dragPressPosition;
+    QPointF dragOrigin;
+    Viewport viewport;
+    mutable SpatialIndex pickIndex;
+    mutable quint64 pickIndexRevision = ~quint64(0);
+    bool panning = false;
+    QPointF lastPanPosition;
+    quint64 labelRevision = 0;
+    LabelLayout labelLayout;
+    quint64 labelLayoutRevision = ~quint64(0);
+    quint64 labelLayoutViewport = ~quint64(0);
+    TileRenderer tileRenderer;
+    QImage staticLayer;
+    bool staticLayerValid = false;
+    QRegion staticDirty;
+    // Objects inside and outside the view when the static layer was last rendered.
+    int layerDrawn = 0;
+    int layerCulled = 0;
+    QRegion pendingDirty;
+    bool dirtyFlushQueued = false;
+    FrameStats stats;
+    FrameTimeHistory frameTimes;
+    bool statsOverlay = false;
+    QTimer *statsTimer = nullptr;
+    QTimer *hoverTimer = nullptr;
+    QElapsedTimer inputClock;
+    bool inputQueued = false;
+    bool motionPending = false;
+    QPointF motionPosition;
+    Qt::MouseButtons motionButtons;
+    double wheelSteps = 0.0;
+    QPointF wheelPosition;
+    qint64 inputStampNs = -1;
+    InputKind inputStampKind = InputKind::Motion;
+    LatencyHistogram latency[3];
+    QPointF hoverPosition;
+    ObjectKind hoverKind = ObjectKind::Point;
+    int hoverIndex = -1;
+    bool bandActive = false;
+    bool bandLasso = false;
+    bool bandAdditive = false;
+    QPolygonF bandPath;
 
+    // Read-only views of the editor's scene and selection.
+    const QVector<Point> &points() const { return editor.scene().points; }
+    const QVector<Line> &lines() const { return editor.scene().lines; }
+    const QVector<ExtendedLine> &extendedLines() const { return editor.scene().extendedLines; }
+    const QVector<Circle> &circles() const { return editor.scene().circles; }
+    const ObjectIds &objectIds() const { return editor.objectIds(); }
+    const QSet<int> &selectedPointIndices() const { return editor.selection(ObjectIds::Point); }
+    const QSet<int> &selectedLineIndices() const { return editor.selection(ObjectIds::Line); }
+    const QSet<int> &selectedExtendedLineIndices() const { return editor.selection(ObjectIds::ExtendedLine); }
+    const QSet<int> &selectedCircleIndices() const { return editor.selection(ObjectIds::Circle); }
+    const QList<int> &pointSelectionOrder() const { return editor.pointSelectionOrder(); }
+    void sceneChanged();
+    void objectChanged(ObjectKind kind, int index, bool labelsAffected = false);
+    void invalidateObject(ObjectKind kind, int index);
+    void invalidateSelection();
+    void invalidateRect(const QRect &rect);
+    void flushDirty();
+    bool objectWorldBounds(ObjectKind kind, int index, QRectF &bounds) const;
+    QRect objectScreenBounds(ObjectKind kind, int index) const;
     bool loadPointsFromFile(const QString &path);
-    void addIntersectionPoint(const QPointF &pt);
+    QString objectLabel(ObjectIds::Kind kind, int index) const;
+    void objectAdded(ObjectIds::Kind kind, int index) override;
+    void invalidatePointAndLines(int index);
+    void positionAboutToChange(int index) override;
+    void positionChanged(int index) override;
+    void labelChanged(ObjectIds::Kind kind, int index) override;
+    void objectsRemoved(const QVector<int> (&removed)[ObjectIds::KindCount]) override;
+    void sceneCleared() override;
+    void sceneReplaced() override;
+    void selectionChanged(ObjectIds::Kind kind, int index) override;
+    void selectionAboutToClear() override;
     QString nextPointLabel() const;
     QString nextLineLabel() const;
     QString nextCircleLabel() const;
     std::pair<QPointF, QPointF> lineEndpoints(const Line &line) const;
     std::pair<QPointF, QPointF> extendedLineEndpoints(const ExtendedLine &line) const;
-    void findIntersectionsForLine(int lineIndex);
-    void findIntersectionsForExtendedLine(int lineIndex);
-    void findIntersectionsForCircle(int circleIndex);
-    bool writePointsToPath(const QString &path) const;
+    const QVector<int> &linesAtPoint(int pointIndex) const;
+    SceneFile::WriteOptions saveOptions(const QString &path, bool compact) const;
+    bool writePointsToPath(const QString &path, SceneFile::WriteOptions options) const;
+    void resetChunkedBase();
+    void chunkedSaveFinished(bool ok);
+    Scene snapshot() const;
+    void setScene(Scene &&scene);
+    bool openPaged(const QString &path);
+    void pageTiles();
+    void adoptResident(Scene &&scene, const TilePager::Ids *ids);
+    int sceneIndex(ObjectKind kind, int index) const;
+    bool materialize();
+    void compactJournal();
+    void startSession(const Scene &base);
+    void closeSession(bool keepEdits = false);
+    void asyncSaveFinished();
+    void viewportChanged();
+    void ensurePickIndex() const;
+    PickResult pickAt(const QPointF &screenPos) const;
+    QPointF closestPointOnObject(ObjectKind kind, int index, const QPointF &world) const;
+    QPointF snapPosition(const QPointF &screenPos);
+    void stampInput(InputKind kind);
+    void queueInput();
+    void processPendingInput();
+    void settleInputStamp();
+    void scheduleHover();
+    void updateHover();
+    void setHover(ObjectKind kind, int index);
+    void drawHoverHighlight(QPainter &painter) const;
+    QPolygonF bandPolygon() const;
+    void invalidateBand();
+    void updateBand(const QPointF &pos);
+    void finishBand();
+    void drawSelectionBand(QPainter &painter) const;
+    void selectInPolygon(const QPolygonF &screenPolygon, bool additive);
+    QFont labelFont() const;
+    void buildLabelLayout(LabelLayout &layout, const QTransform &transform, const QRectF &area, const QFont &font) const;
+    void drawScene(QPainter &painter, const QTransform &transform, const QRectF &clip,
+                   const LabelLayout &labels, const QFont &font) const;
+    void countVisible(const QTransform &transform, const QRectF &view, int &drawn, int &culled) const;
+    QRect statsOverlayRect() const;
+    void drawStatsOverlay(QPainter &painter) const;
 };
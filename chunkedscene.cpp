@@ -0,0 +1,362 @@
+#include "chunkedscene.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QIODevice>
+#include <QPair>
+#include <QVector>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "binaryscene.h"
+#include "sceneformat.h"
+
+namespace {
+const char magic[8] = {'V', 'G', 'C', 'S', 'C', 'E', 'N', 'E'};
+
+constexpr int kindCount = ChunkedScene::Changes::kindCount;
+constexpr quint64 headerSize = 8 + 4 + 4 + 8 + 8 + 8;
+// Where the generation, index offset and index size start; an update rewrites them together.
+constexpr qint64 commitOffset = 16;
+constexpr quint64 indexEntrySize = 8 + 8;
+
+struct Entry {
+    quint64 offset = 0;
+    quint64 size = 0;
+};
+
+struct Index {
+    quint64 counts[kindCount] = {0, 0, 0, 0};
+    QVector<Entry> chunks[kindCount];
+};
+
+using SceneFormat::align8;
+using SceneFormat::at;
+using SceneFormat::padTo8;
+using SceneFormat::put;
+
+// QFile::flush() only hands the data to the OS; this waits until it is on disk.
+bool syncToDisk(QFile &file) {
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+quint64 objectCount(const Scene &scene, int kind) {
+    switch (kind) {
+    case 0: return quint64(scene.points.size());
+    case 1: return quint64(scene.lines.size());
+    case 2: return quint64(scene.extendedLines.size());
+    default: return quint64(scene.circles.size());
+    }
+}
+
+int chunkCount(quint64 objects) {
+    return int((objects + ChunkedScene::chunkObjects - 1) / ChunkedScene::chunkObjects);
+}
+
+// Number of objects chunk holds when a kind has objects in total.
+int chunkSize(quint64 objects, int chunk) {
+    return int(std::min<quint64>(ChunkedScene::chunkObjects, objects - quint64(chunk) * ChunkedScene::chunkObjects));
+}
+
+bool encodeChunk(const Scene &scene, int kind, int chunk, QByteArray &blob) {
+    const int first = chunk * ChunkedScene::chunkObjects;
+    const int count = chunkSize(objectCount(scene, kind), chunk);
+    Scene part;
+    switch (kind) {
+    case 0: part.points = scene.points.mid(first, count); break;
+    case 1: part.lines = scene.lines.mid(first, count); break;
+    case 2: part.extendedLines = scene.extendedLines.mid(first, count); break;
+    default: part.circles = scene.circles.mid(first, count); break;
+    }
+    blob.resize(0);
+    QBuffer buffer(&blob);
+    if (!buffer.open(QIODevice::WriteOnly) || !BinaryScene::write(buffer, part)) {
+        return false;
+    }
+    padTo8(blob);
+    return true;
+}
+
+QByteArray encodeIndex(const Index &index) {
+    QByteArray out;
+    for (quint64 count : index.counts) put<quint64>(out, count);
+    for (const auto &chunks : index.chunks) {
+        for (const Entry &entry : chunks) {
+            put<quint64>(out, entry.offset);
+            put<quint64>(out, entry.size);
+        }
+    }
+    return out;
+}
+
+QByteArray encodeCommit(quint64 generation, quint64 indexOffset, quint64 indexSize) {
+    QByteArray out;
+    put<quint64>(out, generation);
+    put<quint64>(out, indexOffset);
+    put<quint64>(out, indexSize);
+    return out;
+}
+
+// Checks the header and reads the index it points to; every chunk extent is validated against size.
+bool parseIndex(const uchar *header, quint64 size, quint64 &generation, quint64 &indexOffset, quint64 &indexSize) {
+    if (size < headerSize || std::memcmp(header, magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    if (at<quint32>(header, 8) != ChunkedScene::version || at<quint32>(header, 12) != quint32(ChunkedScene::chunkObjects)) {
+        return false;
+    }
+    generation = at<quint64>(header, 16);
+    indexOffset = at<quint64>(header, 24);
+    indexSize = at<quint64>(header, 32);
+    return indexOffset >= headerSize && indexOffset <= size && indexSize <= size - indexOffset;
+}
+
+bool decodeIndex(const uchar *data, quint64 dataSize, quint64 fileSize, Index &index) {
+    if (dataSize < 8 * kindCount) {
+        return false;
+    }
+    quint64 expected = 8 * kindCount;
+    for (int kind = 0; kind < kindCount; ++kind) {
+        index.counts[kind] = at<quint64>(data, 0, quint64(kind));
+        if (index.counts[kind] > fileSize) return false;
+        expected += quint64(chunkCount(index.counts[kind])) * indexEntrySize;
+    }
+    if (dataSize != expected) {
+        return false;
+    }
+    quint64 cursor = 8 * kindCount;
+    for (int kind = 0; kind < kindCount; ++kind) {
+        const int chunks = chunkCount(index.counts[kind]);
+        index.chunks[kind].resize(chunks);
+        for (int c = 0; c < chunks; ++c, cursor += indexEntrySize) {
+            Entry &entry = index.chunks[kind][c];
+            entry.offset = at<quint64>(data, cursor);
+            entry.size = at<quint64>(data, cursor + 8);
+            if (entry.offset < headerSize || entry.offset > fileSize || entry.size > fileSize - entry.offset) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+}  // namespace
+
+void ChunkedScene::Changes::mark(int kind, int index) {
+    if (kind >= 0 && kind < kindCount && index >= 0 && index < changedFrom[kind]) {
+        objects[kind].insert(index);
+    }
+}
+
+void ChunkedScene::Changes::markFrom(int kind, int index) {
+    if (kind >= 0 && kind < kindCount) {
+        changedFrom[kind] = std::min(changedFrom[kind], std::max(index, 0));
+    }
+}
+
+void ChunkedScene::Changes::merge(const Changes &other) {
+    for (int kind = 0; kind < kindCount; ++kind) {
+        objects[kind].unite(other.objects[kind]);
+        changedFrom[kind] = std::min(changedFrom[kind], other.changedFrom[kind]);
+    }
+}
+
+void ChunkedScene::Changes::clear() {
+    *this = Changes();
+}
+
+bool ChunkedScene::Changes::isEmpty() const {
+    for (int kind = 0; kind < kindCount; ++kind) {
+        if (!objects[kind].isEmpty() || changedFrom[kind] != std::numeric_limits<int>::max()) return false;
+    }
+    return true;
+}
+
+bool ChunkedScene::Changes::touches(int kind, int first, int count) const {
+    if (changedFrom[kind] < first + count) {
+        return true;
+    }
+    // Few objects change between saves, so walking them beats probing every index.
+    for (int index : objects[kind]) {
+        if (index >= first && index < first + count) return true;
+    }
+    return false;
+}
+
+bool ChunkedScene::matches(const QByteArray &head) {
+    return head.size() >= int(sizeof(magic)) && std::memcmp(head.constData(), magic, sizeof(magic)) == 0;
+}
+
+bool ChunkedScene::read(QFile &file, Scene &scene, quint64 *generation) {
+    const qint64 size = file.size();
+    if (size < qint64(headerSize)) {
+        return false;
+    }
+    uchar *base = file.map(0, size);
+    if (!base) {
+        return false;
+    }
+    auto readMapped = [&]() {
+        quint64 stamp = 0, indexOffset = 0, indexSize = 0;
+        Index index;
+        if (!parseIndex(base, quint64(size), stamp, indexOffset, indexSize) ||
+            !decodeIndex(base + indexOffset, indexSize, quint64(size), index)) {
+            return false;
+        }
+        Scene loaded;
+        for (int kind = 0; kind < kindCount; ++kind) {
+            for (int c = 0; c < index.chunks[kind].size(); ++c) {
+                const Entry &entry = index.chunks[kind][c];
+                Scene part;
+                if (!BinaryScene::read(base + entry.offset, entry.size, part) ||
+                    objectCount(part, kind) != quint64(chunkSize(index.counts[kind], c))) {
+                    return false;
+                }
+                loaded.points += part.points;
+                loaded.lines += part.lines;
+                loaded.extendedLines += part.extendedLines;
+                loaded.circles += part.circles;
+            }
+        }
+        scene = std::move(loaded);
+        if (generation) *generation = stamp;
+        return true;
+    };
+    const bool ok = readMapped();
+    file.unmap(base);
+    return ok;
+}
+
+bool ChunkedScene::write(QIODevice &device, const Scene &scene, quint64 generation) {
+    Index index;
+    quint64 offset = headerSize;
+    // The header is completed once the index location is known.
+    if (device.write(QByteArray(int(headerSize), '\0')) != qint64(headerSize)) {
+        return false;
+    }
+    QByteArray blob;
+    for (int kind = 0; kind < kindCount; ++kind) {
+        index.counts[kind] = objectCount(scene, kind);
+        for (int c = 0; c < chunkCount(index.counts[kind]); ++c) {
+            if (!encodeChunk(scene, kind, c, blob) || device.write(blob) != blob.size()) {
+                return false;
+            }
+            index.chunks[kind].append(Entry{offset, quint64(blob.size())});
+            offset += quint64(blob.size());
+        }
+    }
+    const QByteArray indexData = encodeIndex(index);
+    if (device.write(indexData) != indexData.size()) {
+        return false;
+    }
+    QByteArray header(magic, sizeof(magic));
+    put<quint32>(header, version);
+    put<quint32>(header, quint32(chunkObjects));
+    header += encodeCommit(generation, offset, quint64(indexData.size()));
+    return device.seek(0) && device.write(header) == header.size();
+}
+
+bool ChunkedScene::update(const QString &path, const Scene &scene, const Changes &changes, quint64 baseGeneration,
+                          quint64 generation) {
+    QFile file(path);
+    // ExistingOnly: a missing file must not be created empty and then fail the header check.
+    if (baseGeneration == 0 || !file.open(QIODevice::ReadWrite | QIODevice::ExistingOnly)) {
+        return false;
+    }
+    const quint64 size = quint64(file.size());
+    const QByteArray header = file.read(qint64(headerSize));
+    quint64 stamp = 0, indexOffset = 0, indexSize = 0;
+    if (header.size() != int(headerSize) ||
+        !parseIndex(reinterpret_cast<const uchar *>(header.constData()), size, stamp, indexOffset, indexSize) ||
+        stamp != baseGeneration || !file.seek(qint64(indexOffset))) {
+        return false;
+    }
+    const QByteArray indexData = file.read(qint64(indexSize));
+    Index previous;
+    if (indexData.size() != int(indexSize) ||
+        !decodeIndex(reinterpret_cast<const uchar *>(indexData.constData()), indexSize, size, previous)) {
+        return false;
+    }
+
+    // Chunks keep their place unless an object in them changed or the chunk grew or shrank.
+    Index next;
+    QVector<QPair<int, int>> rewrite;
+    quint64 kept = 0;
+    for (int kind = 0; kind < kindCount; ++kind) {
+        next.counts[kind] = objectCount(scene, kind);
+        const int chunks = chunkCount(next.counts[kind]);
+        next.chunks[kind].resize(chunks);
+        for (int c = 0; c < chunks; ++c) {
+            const int count = chunkSize(next.counts[kind], c);
+            const bool reusable = c < previous.chunks[kind].size() && chunkSize(previous.counts[kind], c) == count &&
+                                  !changes.touches(kind, c * chunkObjects, count);
+            if (reusable) {
+                next.chunks[kind][c] = previous.chunks[kind][c];
+                kept += next.chunks[kind][c].size;
+            } else {
+                rewrite.append(qMakePair(kind, c));
+            }
+        }
+    }
+    // Writing everything afresh is the only way to reclaim dropped chunks.
+    if (size - headerSize - kept > kept) {
+        return false;
+    }
+
+    // Anything appended is cut off again on failure, leaving the file as it was.
+    const auto abandon = [&file, size]() {
+        file.resize(qint64(size));
+        return false;
+    };
+    quint64 offset = align8(size);
+    if (!file.seek(qint64(size)) || file.write(QByteArray(int(offset - size), '\0')) != qint64(offset - size)) {
+        return abandon();
+    }
+    QByteArray blob;
+    for (const auto &chunk : rewrite) {
+        if (!encodeChunk(scene, chunk.first, chunk.second, blob) || file.write(blob) != blob.size()) {
+            return abandon();
+        }
+        next.chunks[chunk.first][chunk.second] = Entry{offset, quint64(blob.size())};
+        offset += quint64(blob.size());
+    }
+    const QByteArray nextIndex = encodeIndex(next);
+    // The chunks and index must be on disk before the header points at them.
+    if (file.write(nextIndex) != nextIndex.size() || !syncToDisk(file)) {
+        return abandon();
+    }
+    // Until here the header still names the previous index; this write switches to the new one.
+    // Past this point the header may already name the new index, so nothing is cut off.
+    const QByteArray commit = encodeCommit(generation, offset, quint64(nextIndex.size()));
+    if (!file.seek(commitOffset)) {
+        return abandon();
+    }
+    return file.write(commit) == commit.size() && syncToDisk(file);
+}
+
+quint64 ChunkedScene::generation(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QByteArray header = file.read(qint64(headerSize));
+    quint64 stamp = 0, indexOffset = 0, indexSize = 0;
+    if (header.size() != int(headerSize) ||
+        !parseIndex(reinterpret_cast<const uchar *>(header.constData()), quint64(file.size()), stamp, indexOffset,
+                    indexSize)) {
+        return 0;
+    }
+    return stamp;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+#include <QtGlobal>
+#include <limits>
+
+#include "scene.h"
+
+class QFile;
+class QIODevice;
+
+// Chunked scene format for large scenes that are saved often. Each object
+// type is cut into chunks of a fixed number of objects by index, and every
+// chunk is stored as a small binary scene (lines keep scene-wide point
+// indices). A footer index lists where each chunk lives, so saving after a
+// few edits appends only the chunks holding changed objects plus a new index,
+// leaving every other chunk where it is.
+//
+// Layout:
+//   header    magic "VGCSCENE", u32 version, u32 objects per chunk,
+//             u64 generation, u64 index offset, u64 index size
+//   chunks    binary scenes, each starting on an 8-byte boundary
+//   index     u64 counts[points, lines, extended lines, circles],
+//             per chunk, kinds in that order: u64 offset, u64 size
+// An update writes its chunks and index past the end of the file first and
+// only then rewrites the generation and index location in the header, so a
+// save that is cut short leaves the previous index in charge; one that fails
+// cuts the file back to its previous length. The new data is
+// synced to disk before the header write and the header after it, so this
+// holds across power loss, not just a crash of the process. Chunks no index
+// refers to are dropped when the file is next written in full, which happens
+// once they take up more than half of it.
+class ChunkedScene {
+public:
+    static constexpr quint32 version = 1;
+    static constexpr int chunkObjects = 4096;
+
+    // Objects changed since a scene was last read from or written to a chunked
+    // file. Kinds follow the Scene containers: points, lines, extended lines,
+    // circles.
+    struct Changes {
+        static constexpr int kindCount = 4;
+
+        QSet<int> objects[kindCount];
+        // Every object from this index on may have changed, e.g. after a removal.
+        int changedFrom[kindCount] = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max(),
+                                      std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+
+        void mark(int kind, int index);
+        void markFrom(int kind, int index);
+        void merge(const Changes &other);
+        void clear();
+        bool isEmpty() const;
+        // True when any object with an index in [first, first + count) changed.
+        bool touches(int kind, int first, int count) const;
+    };
+
+    static bool matches(const QByteArray &head);
+    static bool read(QFile &file, Scene &scene, quint64 *generation = nullptr);
+    static bool write(QIODevice &device, const Scene &scene, quint64 generation);
+    // Brings the file at path up to date with scene by rewriting only the
+    // chunks touched by changes. Fails without touching the file's contents
+    // when it does not carry baseGeneration, or when dropped chunks would take
+    // up most of it; the caller then writes it in full.
+    static bool update(const QString &path, const Scene &scene, const Changes &changes, quint64 baseGeneration,
+                       quint64 generation);
+    // Generation of the index the chunked file at path currently commits to, or
+    // 0 when it is missing or not a chunked scene.
+    static quint64 generation(const QString &path);
+};
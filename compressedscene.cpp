@@ -0,0 +1,338 @@
+#include "compressedscene.h"
+
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "sceneformat.h"
+
+namespace {
+const char magic[8] = {'V', 'G', 'Z', 'S', 'C', 'E', 'N', 'E'};
+constexpr int headerSize = 8 + 4 + 4;
+constexpr int chunk = 1 << 20;
+// Values per byte-plane block; bounds the scratch memory of a column.
+constexpr int block = 1 << 14;
+// zlib at its fastest level; the delta encoding already does most of the work.
+constexpr int compressionLevel = 1;
+// Larger chunks than any writer produces indicate a damaged file.
+constexpr quint32 maxChunk = 64u << 20;
+
+enum Count { PointCount, LineCount, ExtendedCount, CircleCount, StringCount, CountCount };
+
+// Maps a wrapped difference to an unsigned value that is small for small
+// differences of either sign.
+template <typename Bits>
+Bits zigzag(Bits delta) {
+    using Signed = std::make_signed_t<Bits>;
+    return Bits(delta << 1) ^ Bits(Signed(delta) >> (8 * sizeof(Bits) - 1));
+}
+
+template <typename Bits>
+Bits unzigzag(Bits value) {
+    return Bits(value >> 1) ^ Bits(Bits(0) - (value & 1));
+}
+
+// Collects the stream and writes it as independently compressed chunks.
+class ChunkWriter {
+public:
+    explicit ChunkWriter(QIODevice &device) : device(device) { raw.reserve(chunk); }
+
+    void putBytes(const char *data, int size) {
+        while (size > 0) {
+            const int n = std::min(size, chunk - int(raw.size()));
+            raw.append(data, n);
+            data += n;
+            size -= n;
+            if (raw.size() >= chunk) flushChunk();
+        }
+    }
+    void putBytes(const QByteArray &bytes) { putBytes(bytes.constData(), int(bytes.size())); }
+    template <typename T>
+    void put(T value) {
+        const T le = qToLittleEndian(value);
+        putBytes(reinterpret_cast<const char *>(&le), int(sizeof(T)));
+    }
+    bool finish() {
+        flushChunk();
+        const quint32 end = 0;
+        if (ok && device.write(reinterpret_cast<const char *>(&end), sizeof(end)) != qint64(sizeof(end))) ok = false;
+        return ok;
+    }
+
+private:
+    QIODevice &device;
+    QByteArray raw;
+    bool ok = true;
+
+    void flushChunk() {
+        if (raw.isEmpty() || !ok) return;
+        const QByteArray packed = qCompress(raw, compressionLevel);
+        const quint32 size = qToLittleEndian(quint32(packed.size()));
+        if (device.write(reinterpret_cast<const char *>(&size), sizeof(size)) != qint64(sizeof(size))
+            || device.write(packed) != packed.size()) {
+            ok = false;
+        }
+        raw.resize(0);
+    }
+};
+
+// Reads the stream back one decompressed chunk at a time.
+class ChunkReader {
+public:
+    ChunkReader(QIODevice &device, const CompressedScene::ProgressFunction &progress)
+        : device(device), progress(progress) {}
+
+    bool take(char *out, qint64 size) {
+        while (size > 0) {
+            if (cursor == raw.size() && !nextChunk()) return false;
+            const qint64 n = std::min(size, qint64(raw.size() - cursor));
+            std::memcpy(out, raw.constData() + cursor, size_t(n));
+            cursor += int(n);
+            out += n;
+            size -= n;
+        }
+        return true;
+    }
+    template <typename T>
+    bool take(T &value) {
+        if (!take(reinterpret_cast<char *>(&value), sizeof(T))) return false;
+        value = qFromLittleEndian(value);
+        return true;
+    }
+    // True once the end marker follows the last value read.
+    bool atEnd() { return cursor == raw.size() && !nextChunk() && ended; }
+
+private:
+    QIODevice &device;
+    const CompressedScene::ProgressFunction &progress;
+    QByteArray raw;
+    int cursor = 0;
+    bool ended = false;
+
+    bool nextChunk() {
+        quint32 size = 0;
+        if (ended || device.read(reinterpret_cast<char *>(&size), sizeof(size)) != qint64(sizeof(size))) return false;
+        size = qFromLittleEndian(size);
+        if (size == 0) {
+            ended = true;
+            return false;
+        }
+        if (size > maxChunk) return false;
+        const QByteArray packed = device.read(size);
+        if (packed.size() != qsizetype(size)) return false;
+        raw = qUncompress(packed);
+        cursor = 0;
+        if (progress) progress(device.pos(), device.size());
+        return !raw.isEmpty();
+    }
+};
+
+// Zig-zag deltas of one block are stored byte plane by byte plane.
+template <typename Bits, typename Get>
+void writeColumn(ChunkWriter &out, int count, Get get) {
+    Bits previous = 0;
+    QByteArray planes;
+    for (int start = 0; start < count; start += block) {
+        const int n = std::min(block, count - start);
+        planes.resize(n * int(sizeof(Bits)));
+        char *bytes = planes.data();
+        for (int i = 0; i < n; ++i) {
+            const Bits bits = get(start + i);
+            const Bits delta = zigzag<Bits>(bits - previous);
+            previous = bits;
+            for (int b = 0; b < int(sizeof(Bits)); ++b) bytes[b * n + i] = char(delta >> (8 * b));
+        }
+        out.putBytes(planes);
+    }
+}
+
+template <typename Bits, typename Set>
+bool readColumn(ChunkReader &in, int count, Set set) {
+    Bits previous = 0;
+    QByteArray planes;
+    for (int start = 0; start < count; start += block) {
+        const int n = std::min(block, count - start);
+        planes.resize(n * int(sizeof(Bits)));
+        if (!in.take(planes.data(), planes.size())) return false;
+        const uchar *bytes = reinterpret_cast<const uchar *>(planes.constData());
+        for (int i = 0; i < n; ++i) {
+            Bits delta = 0;
+            for (int b = 0; b < int(sizeof(Bits)); ++b) delta |= Bits(bytes[b * n + i]) << (8 * b);
+            previous += unzigzag(delta);
+            if (!set(start + i, previous)) return false;
+        }
+    }
+    return true;
+}
+
+quint64 doubleBits(double value) {
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double bitsDouble(quint64 bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template <typename Get>
+void writeDoubles(ChunkWriter &out, int count, Get get) {
+    writeColumn<quint64>(out, count, [&](int i) { return doubleBits(get(i)); });
+}
+
+template <typename Set>
+bool readDoubles(ChunkReader &in, int count, Set set) {
+    return readColumn<quint64>(in, count, [&](int i, quint64 bits) {
+        set(i, bitsDouble(bits));
+        return true;
+    });
+}
+
+template <typename Get>
+void writeInts(ChunkWriter &out, int count, Get get) {
+    writeColumn<quint32>(out, count, [&](int i) { return quint32(get(i)); });
+}
+
+template <typename Set>
+bool readInts(ChunkReader &in, int count, Set set) {
+    return readColumn<quint32>(in, count, [&](int i, quint32 bits) { return set(i, qint32(bits)); });
+}
+}  // namespace
+
+bool CompressedScene::matches(const QByteArray &head) {
+    return head.size() >= int(sizeof(magic)) && std::memcmp(head.constData(), magic, sizeof(magic)) == 0;
+}
+
+bool CompressedScene::write(QIODevice &device, const Scene &scene) {
+    const SceneFormat::Labels labels(scene);
+
+    QByteArray header(magic, sizeof(magic));
+    const quint32 fields[2] = {qToLittleEndian(version), 0};
+    header.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+    if (device.write(header) != header.size()) {
+        return false;
+    }
+
+    ChunkWriter out(device);
+    out.put<quint64>(quint64(scene.points.size()));
+    out.put<quint64>(quint64(scene.lines.size()));
+    out.put<quint64>(quint64(scene.extendedLines.size()));
+    out.put<quint64>(quint64(scene.circles.size()));
+    out.put<quint64>(quint64(labels.size()));
+
+    writeInts(out, labels.size(), [&](int i) { return qint32(labels.offsets[i + 1] - labels.offsets[i]); });
+    out.putBytes(labels.data);
+
+    const auto &points = scene.points;
+    writeDoubles(out, points.size(), [&](int i) { return points[i].positiom.x(); });
+    writeDoubles(out, points.size(), [&](int i) { return points[i].positiom.y(); });
+    writeInts(out, points.size(), [&](int i) { return qint32(labels.points[i]); });
+
+    const auto &lines = scene.lines;
+    writeInts(out, lines.size(), [&](int i) { return qint32(lines[i].a); });
+    writeInts(out, lines.size(), [&](int i) { return qint32(lines[i].b); });
+    writeInts(out, lines.size(), [&](int i) { return qint32(labels.lines[i]); });
+
+    const auto &extended = scene.extendedLines;
+    writeDoubles(out, extended.size(), [&](int i) { return extended[i].a.x(); });
+    writeDoubles(out, extended.size(), [&](int i) { return extended[i].a.y(); });
+    writeDoubles(out, extended.size(), [&](int i) { return extended[i].b.x(); });
+    writeDoubles(out, extended.size(), [&](int i) { return extended[i].b.y(); });
+    writeInts(out, extended.size(), [&](int i) { return qint32(labels.extendedLines[i]); });
+
+    const auto &circles = scene.circles;
+    writeDoubles(out, circles.size(), [&](int i) { return circles[i].center.x(); });
+    writeDoubles(out, circles.size(), [&](int i) { return circles[i].center.y(); });
+    writeDoubles(out, circles.size(), [&](int i) { return circles[i].radius; });
+    writeInts(out, circles.size(), [&](int i) { return qint32(labels.circles[i]); });
+    return out.finish();
+}
+
+bool CompressedScene::read(QIODevice &device, Scene &scene, const ProgressFunction &progress) {
+    const QByteArray header = device.read(headerSize);
+    if (header.size() != headerSize || !matches(header)
+        || qFromLittleEndian<quint32>(header.constData() + 8) != version) {
+        return false;
+    }
+    ChunkReader in(device, progress);
+    int counts[CountCount];
+    for (int &count : counts) {
+        quint64 value = 0;
+        if (!in.take(value) || value > quint64(std::numeric_limits<int>::max())) return false;
+        count = int(value);
+    }
+    if (counts[StringCount] < 1) {
+        return false;
+    }
+    // Counts come from the file, so containers grow as values arrive rather than up front.
+    auto reserve = [](auto &items, int count) { items.reserve(std::min(count, block * 64)); };
+
+    QVector<qint32> lengths;
+    reserve(lengths, counts[StringCount]);
+    if (!readInts(in, counts[StringCount], [&](int, qint32 length) {
+            lengths.append(length);
+            return length >= 0 && length <= int(maxChunk);
+        })) {
+        return false;
+    }
+    QVector<QString> strings;
+    reserve(strings, counts[StringCount]);
+    QByteArray text;
+    for (qint32 length : lengths) {
+        text.resize(length);
+        if (!in.take(text.data(), length)) return false;
+        strings.append(QString::fromUtf8(text));
+    }
+    auto label = [&](qint32 id, QString &out) {
+        if (id < 0 || id >= strings.size()) return false;
+        out = strings[id];
+        return true;
+    };
+
+    Scene loaded;
+    auto &points = loaded.points;
+    reserve(points, counts[PointCount]);
+    bool ok = readDoubles(in, counts[PointCount], [&](int, double x) { points.append(Scene::Point(QPointF(x, 0.0), QString())); })
+              && readDoubles(in, counts[PointCount], [&](int i, double y) { points[i].positiom.setY(y); })
+              && readInts(in, counts[PointCount], [&](int i, qint32 id) { return label(id, points[i].label); });
+
+    auto &lines = loaded.lines;
+    reserve(lines, counts[LineCount]);
+    ok = ok && readInts(in, counts[LineCount], [&](int, qint32 a) {
+             lines.append(Scene::Line(a, -1, QString()));
+             return true;
+         })
+         && readInts(in, counts[LineCount], [&](int i, qint32 b) {
+                lines[i].b = b;
+                return true;
+            })
+         && readInts(in, counts[LineCount], [&](int i, qint32 id) { return label(id, lines[i].label); });
+
+    auto &extended = loaded.extendedLines;
+    reserve(extended, counts[ExtendedCount]);
+    ok = ok && readDoubles(in, counts[ExtendedCount], [&](int, double x) { extended.append(Scene::ExtendedLine(QPointF(x, 0.0), QPointF(), QString())); })
+         && readDoubles(in, counts[ExtendedCount], [&](int i, double y) { extended[i].a.setY(y); })
+         && readDoubles(in, counts[ExtendedCount], [&](int i, double x) { extended[i].b.setX(x); })
+         && readDoubles(in, counts[ExtendedCount], [&](int i, double y) { extended[i].b.setY(y); })
+         && readInts(in, counts[ExtendedCount], [&](int i, qint32 id) { return label(id, extended[i].label); });
+
+    auto &circles = loaded.circles;
+    reserve(circles, counts[CircleCount]);
+    ok = ok && readDoubles(in, counts[CircleCount], [&](int, double x) { circles.append(Scene::Circle(QPointF(x, 0.0), 0.0)); })
+         && readDoubles(in, counts[CircleCount], [&](int i, double y) { circles[i].center.setY(y); })
+         && readDoubles(in, counts[CircleCount], [&](int i, double r) { circles[i].radius = r; })
+         && readInts(in, counts[CircleCount], [&](int i, qint32 id) { return label(id, circles[i].label); });
+
+    if (!ok || !in.atEnd()) {
+        return false;
+    }
+    scene = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <functional>
+
+#include "scene.h"
+
+class QIODevice;
+
+// Compressed scene format for archiving and moving large scenes. The scene is
+// turned into a stream of columns that compress well and fed through zlib
+// (qCompress) in independent chunks of about 1 MB, so neither writing nor
+// reading holds more than one chunk of the file in memory.
+//
+// Before compression, each column is delta-encoded against its previous
+// value: coordinates as the difference of their IEEE bit patterns, which is
+// lossless and small for nearby values, and indices and label ids as integer
+// differences. Deltas are zig-zag mapped so small ones of either sign stay
+// small, and every block of values is split into byte planes, so the
+// mostly-zero high bytes of the deltas sit together.
+//
+// Layout:
+//   header    magic "VGZSCENE", u32 version, u32 reserved
+//   chunks    u32 size, qCompress data; a zero size ends the stream
+// Stream, in order:
+//   u64 counts[points, lines, extended lines, circles, strings]
+//   strings   i32 lengths (column), UTF-8 data; string 0 is empty
+//   points    f64 x, f64 y, u32 label
+//   lines     i32 a, i32 b, u32 label
+//   extended  f64 ax, f64 ay, f64 bx, f64 by, u32 label
+//   circles   f64 x, f64 y, f64 r, u32 label
+class CompressedScene {
+public:
+    static constexpr quint32 version = 1;
+    using ProgressFunction = std::function<void(qint64 done, qint64 total)>;
+
+    static bool matches(const QByteArray &head);
+    // Line endpoints are taken as stored; SceneFile::read drops dangling lines.
+    static bool read(QIODevice &device, Scene &scene, const ProgressFunction &progress = ProgressFunction());
+    static bool write(QIODevice &device, const Scene &scene);
+};
@@ -0,0 +1,42 @@
+# Scene model, file formats, edit journal and macro playback, shared by the
+# application, the command-line batch runner and the tests. Needs QtCore and
+# QtConcurrent only.
+
+QT += concurrent
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/binaryscene.cpp \
+    $$PWD/chunkedscene.cpp \
+    $$PWD/compressedscene.cpp \
+    $$PWD/geometry.cpp \
+    $$PWD/intersectioncache.cpp \
+    $$PWD/jsonscene.cpp \
+    $$PWD/macro.cpp \
+    $$PWD/objectids.cpp \
+    $$PWD/scenecache.cpp \
+    $$PWD/sceneeditor.cpp \
+    $$PWD/scenefile.cpp \
+    $$PWD/sceneformat.cpp \
+    $$PWD/scenejournal.cpp \
+    $$PWD/spatialindex.cpp \
+    $$PWD/tiledscene.cpp
+
+HEADERS += \
+    $$PWD/binaryscene.h \
+    $$PWD/chunkedscene.h \
+    $$PWD/compressedscene.h \
+    $$PWD/geometry.h \
+    $$PWD/intersectioncache.h \
+    $$PWD/jsonscene.h \
+    $$PWD/macro.h \
+    $$PWD/objectids.h \
+    $$PWD/scene.h \
+    $$PWD/scenecache.h \
+    $$PWD/sceneeditor.h \
+    $$PWD/scenefile.h \
+    $$PWD/sceneformat.h \
+    $$PWD/scenejournal.h \
+    $$PWD/spatialindex.h \
+    $$PWD/tiledscene.h
@@ -0,0 +1,89 @@
+#include "framestats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+const double latencyBounds[] = {1, 2, 4, 8, 12, 16, 20, 25, 33, 50, 66, 100, 200, 500};
+const int latencyBoundCount = int(sizeof(latencyBounds) / sizeof(latencyBounds[0]));
+}  // namespace
+
+double FrameStats::labelHitRate() const {
+    const quint64 total = labelHits + labelMisses;
+    return total ? double(labelHits) / double(total) : 0.0;
+}
+
+FrameTimeHistory::FrameTimeHistory(int capacity)
+    : capacity(std::max(1, capacity)) {
+    samples.reserve(this->capacity);
+}
+
+void FrameTimeHistory::add(double ms) {
+    if (samples.size() < capacity) {
+        samples.append(ms);
+    } else {
+        sum -= samples[next];
+        samples[next] = ms;
+        next = (next + 1) % capacity;
+    }
+    sum += ms;
+}
+
+void FrameTimeHistory::clear() {
+    samples.clear();
+    next = 0;
+    sum = 0.0;
+}
+
+double FrameTimeHistory::average() const {
+    return samples.isEmpty() ? 0.0 : sum / samples.size();
+}
+
+double FrameTimeHistory::percentile(double p) const {
+    if (samples.isEmpty()) {
+        return 0.0;
+    }
+    QVector<double> sorted = samples;
+    const int rank = std::clamp(int(std::ceil(p * sorted.size())) - 1, 0, int(sorted.size()) - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+LatencyHistogram::LatencyHistogram()
+    : counts(latencyBoundCount + 1, 0) {
+}
+
+void LatencyHistogram::add(double ms) {
+    const double *bound = std::lower_bound(latencyBounds, latencyBounds + latencyBoundCount, ms);
+    ++counts[int(bound - latencyBounds)];
+    ++total;
+    sum += ms;
+    largest = std::max(largest, ms);
+}
+
+void LatencyHistogram::clear() {
+    counts.fill(0);
+    total = 0;
+    sum = 0.0;
+    largest = 0.0;
+}
+
+double LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+        return 0.0;
+    }
+    const quint64 rank = std::max<quint64>(1, quint64(std::ceil(p * double(total))));
+    quint64 seen = 0;
+    for (int i = 0; i < latencyBoundCount; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(latencyBounds[i], largest);
+        }
+    }
+    return largest;
+}
+
+double LatencyHistogram::bucketUpperBound(int bucket) const {
+    return bucket < latencyBoundCount ? latencyBounds[bucket] : std::numeric_limits<double>::infinity();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+// Per-frame paint statistics. Draw/cull counts are taken once against the
+// view when the static layer is rendered, plus the selection overlay; frames
+// served from the cached layer repeat the counts of its last render.
+struct FrameStats {
+    double lastMs = 0.0;
+    double avgMs = 0.0;
+    double p99Ms = 0.0;
+    int objectsDrawn = 0;
+    int objectsCulled = 0;
+    int labelsPlaced = 0;
+    int labelsSkipped = 0;
+    quint64 frames = 0;
+    quint64 layerHits = 0;
+    quint64 layerPartial = 0;
+    quint64 layerMisses = 0;
+    quint64 labelHits = 0;
+    quint64 labelMisses = 0;
+    quint64 inputEvents = 0;
+    quint64 inputCoalesced = 0;
+    double inputP95Ms = 0.0;
+
+    double layerHitRate() const { return frames ? double(layerHits) / double(frames) : 0.0; }
+    double labelHitRate() const;
+};
+
+// Rolling window of frame times used to derive the average and p99.
+class FrameTimeHistory {
+public:
+    explicit FrameTimeHistory(int capacity = 240);
+
+    void add(double ms);
+    void clear();
+    double average() const;
+    double percentile(double p) const;
+
+private:
+    QVector<double> samples;
+    int capacity;
+    int next = 0;
+    double sum = 0.0;
+};
+
+// Input-to-present latency distribution over fixed millisecond buckets, cheap
+// enough to update on every frame and never trimmed, so long sessions can be
+// exported and compared against a latency budget.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void add(double ms);
+    void clear();
+    quint64 count() const { return total; }
+    double maxMs() const { return largest; }
+    double average() const { return total ? sum / double(total) : 0.0; }
+    // Upper bound of the bucket holding the p-th sample; the overflow bucket reports the maximum.
+    double percentile(double p) const;
+    int bucketCount() const { return counts.size(); }
+    double bucketUpperBound(int bucket) const;
+    quint64 bucketSamples(int bucket) const { return counts[bucket]; }
+
+private:
+    QVector<quint64> counts;
+    quint64 total = 0;
+    double sum = 0.0;
+    double largest = 0.0;
+};
@@ -0,0 +1,143 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool Geometry::segmentIntersection(const QPointF &p, const QPointF &p2, const QPointF &q, const QPointF &q2, QPointF &out) {
+    QPointF r = p2 - p;
+    QPointF s = q2 - q;
+    double denom = r.x() * s.y() - r.y() * s.x();
+    if (std::abs(denom) < 1e-9) {
+        return false;  // parallel or colinear
+    }
+    QPointF qp = q - p;
+    double t = (qp.x() * s.y() - qp.y() * s.x()) / denom;
+    double u = (qp.x() * r.y() - qp.y() * r.x()) / denom;
+    if (t >= -1e-9 && t <= 1.0 + 1e-9 && u >= -1e-9 && u <= 1.0 + 1e-9) {
+        out = p + t * r;
+        return true;
+    }
+    return false;
+}
+
+std::vector<QPointF> Geometry::segmentCircleIntersections(const QPointF &p1, const QPointF &p2, const QPointF &c, double r) {
+    std::vector<QPointF> hits;
+    QPointF d = p2 - p1;
+    double A = d.x() * d.x() + d.y() * d.y();
+    if (A < 1e-12) return hits;
+    QPointF f = p1 - c;
+    double B = 2.0 * (f.x() * d.x() + f.y() * d.y());
+    double C = f.x() * f.x() + f.y() * f.y() - r * r;
+    double disc = B * B - 4 * A * C;
+    if (disc < 0.0) return hits;
+    double sqrtDisc = std::sqrt(std::max(0.0, disc));
+    double t1 = (-B - sqrtDisc) / (2 * A);
+    double t2 = (-B + sqrtDisc) / (2 * A);
+    auto addIf = [&](double t) {
+        if (t >= -1e-9 && t <= 1.0 + 1e-9) {
+            hits.push_back(p1 + t * d);
+        }
+    };
+    addIf(t1);
+    if (disc > 1e-12) addIf(t2);
+    return hits;
+}
+
+std::vector<QPointF> Geometry::circleCircleIntersections(const QPointF &c0, double r0, const QPointF &c1, double r1) {
+    std::vector<QPointF> hits;
+    double dx = c1.x() - c0.x();
+    double dy = c1.y() - c0.y();
+    double d = std::hypot(dx, dy);
+    if (d < 1e-9 || d > r0 + r1 || d < std::abs(r0 - r1)) {
+        return hits;
+    }
+    double a = (r0 * r0 - r1 * r1 + d * d) / (2 * d);
+    double h2 = r0 * r0 - a * a;
+    if (h2 < 0.0) return hits;
+    double h = std::sqrt(std::max(0.0, h2));
+    QPointF p2(c0.x() + a * dx / d, c0.y() + a * dy / d);
+    double rx = -dy * (h / d);
+    double ry = dx * (h / d);
+    hits.push_back(QPointF(p2.x() + rx, p2.y() + ry));
+    if (h > 1e-9) hits.push_back(QPointF(p2.x() - rx, p2.y() - ry));
+    return hits;
+}
+
+QRectF Geometry::extensionBounds(const QVector<Scene::Point> &points, const QVector<Scene::Circle> &circles,
+                                 const QRectF &seed) {
+    // QRectF::united() ignores zero-size rects, so points grow the box by their coordinates directly.
+    double left = seed.left(), top = seed.top(), right = seed.right(), bottom = seed.bottom();
+    for (const auto &p : points) {
+        left = std::min(left, p.positiom.x());
+        right = std::max(right, p.positiom.x());
+        top = std::min(top, p.positiom.y());
+        bottom = std::max(bottom, p.positiom.y());
+    }
+    QRectF box(QPointF(left, top), QPointF(right, bottom));
+    for (const auto &c : circles) {
+        box = box.united(QRectF(c.center.x() - c.radius, c.center.y() - c.radius, 2 * c.radius, 2 * c.radius));
+    }
+    return box;
+}
+
+QPair<QPointF, QPointF> Geometry::extendAcross(const QPointF &p1, const QPointF &p2, const QRectF &box) {
+    const double xmin = box.left(), xmax = box.right(), ymin = box.top(), ymax = box.bottom();
+    const double dx = p2.x() - p1.x();
+    const double dy = p2.y() - p1.y();
+    QVector<QPointF> hits;
+    auto addIfInside = [&](double x, double y) {
+        if (x >= xmin - 1e-9 && x <= xmax + 1e-9 && y >= ymin - 1e-9 && y <= ymax + 1e-9) {
+            hits.append(QPointF(x, y));
+        }
+    };
+    if (std::abs(dx) > 1e-9) {
+        double t1 = (xmin - p1.x()) / dx;
+        addIfInside(xmin, p1.y() + t1 * dy);
+        double t2 = (xmax - p1.x()) / dx;
+        addIfInside(xmax, p1.y() + t2 * dy);
+    }
+    if (std::abs(dy) > 1e-9) {
+        double t3 = (ymin - p1.y()) / dy;
+        addIfInside(p1.x() + t3 * dx, ymin);
+        double t4 = (ymax - p1.y()) / dy;
+        addIfInside(p1.x() + t4 * dx, ymax);
+    }
+    // Remove duplicates
+    QVector<QPointF> uniqueHits;
+    auto isClose = [](const QPointF &a, const QPointF &b) {
+        return std::hypot(a.x() - b.x(), a.y() - b.y()) < 1e-6;
+    };
+    for (const auto &h : hits) {
+        bool dup = false;
+        for (const auto &u : uniqueHits) {
+            if (isClose(h, u)) { dup = true; break; }
+        }
+        if (!dup) uniqueHits.append(h);
+    }
+    if (uniqueHits.size() < 2) {
+        return {p1, p2};
+    }
+    QVector<std::pair<double, QPointF>> proj;
+    if (std::abs(dx) >= std::abs(dy)) {
+        for (const auto &h : uniqueHits) proj.append({ (h.x() - p1.x()) / dx, h });
+    } else {
+        for (const auto &h : uniqueHits) proj.append({ (h.y() - p1.y()) / dy, h });
+    }
+    std::sort(proj.begin(), proj.end(), [](const auto &a, const auto &b){ return a.first < b.first; });
+    return {proj.front().second, proj.back().second};
+}
+
+bool Geometry::normalThrough(const QPointF &p1, const QPointF &p2, const QPointF &point, const QRectF &box,
+                             QPointF &a, QPointF &b) {
+    QPointF d = p2 - p1;
+    if (std::abs(d.x()) < 1e-9 && std::abs(d.y()) < 1e-9) return false;
+    QPointF perp(-d.y(), d.x());
+    double len = std::hypot(perp.x(), perp.y());
+    if (len < 1e-9) return false;
+    QPointF dir = QPointF(perp.x() / len, perp.y() / len);
+    const double span = std::hypot(box.width(), box.height()) +
+                        std::hypot(point.x() - box.center().x(), point.y() - box.center().y());
+    a = point + dir * span;
+    b = point - dir * span;
+    return true;
+}
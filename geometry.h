@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QPair>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+#include <vector>
+
+#include "scene.h"
+
+// Construction math shared by the canvas and the headless SceneEditor, so a
+// macro builds the same objects and intersection points in either. Lines are
+// segments between two points; extended lines are long segments clipped to an
+// extension box that covers the scene.
+class Geometry {
+public:
+    static bool segmentIntersection(const QPointF &p, const QPointF &p2, const QPointF &q, const QPointF &q2, QPointF &out);
+    static std::vector<QPointF> segmentCircleIntersections(const QPointF &p1, const QPointF &p2, const QPointF &c, double r);
+    static std::vector<QPointF> circleCircleIntersections(const QPointF &c0, double r0, const QPointF &c1, double r1);
+
+    // seed grown to cover every point and circle.
+    static QRectF extensionBounds(const QVector<Scene::Point> &points, const QVector<Scene::Circle> &circles,
+                                  const QRectF &seed = QRectF(-5.0, -5.0, 10.0, 10.0));
+    // The line through p1 and p2 clipped to box; p1 and p2 themselves when it misses the box.
+    static QPair<QPointF, QPointF> extendAcross(const QPointF &p1, const QPointF &p2, const QRectF &box);
+    // The perpendicular to p1-p2 through point, long enough to cross box from
+    // anywhere inside it. False for a degenerate line.
+    static bool normalThrough(const QPointF &p1, const QPointF &p2, const QPointF &point, const QRectF &box,
+                              QPointF &a, QPointF &b);
+};
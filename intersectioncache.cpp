@@ -0,0 +1,67 @@
+#include "intersectioncache.h"
+
+#include <QDataStream>
+
+bool IntersectionCache::lookup(quint64 a, quint64 b, QVector<QPointF> &hits) const {
+    auto it = pairs.constFind(pairKey(a, b));
+    if (it == pairs.constEnd()) {
+        return false;
+    }
+    hits = it.value();
+    return true;
+}
+
+void IntersectionCache::store(quint64 a, quint64 b, const QVector<QPointF> &hits) {
+    const PairKey key = pairKey(a, b);
+    if (!pairs.contains(key)) {
+        partners[a].append(b);
+        partners[b].append(a);
+    }
+    pairs.insert(key, hits);
+}
+
+void IntersectionCache::invalidate(quint64 object) {
+    auto it = partners.find(object);
+    if (it == partners.end()) {
+        return;
+    }
+    const QVector<quint64> others = it.value();
+    partners.erase(it);
+    for (quint64 other : others) {
+        pairs.remove(pairKey(object, other));
+        auto otherIt = partners.find(other);
+        if (otherIt != partners.end()) {
+            otherIt.value().removeAll(object);
+        }
+    }
+}
+
+void IntersectionCache::clear() {
+    pairs.clear();
+    partners.clear();
+}
+
+void IntersectionCache::save(QDataStream &out) const {
+    out << qint32(pairs.size());
+    for (auto it = pairs.constBegin(); it != pairs.constEnd(); ++it) {
+        out << it.key().first << it.key().second << it.value();
+    }
+}
+
+bool IntersectionCache::load(QDataStream &in) {
+    qint32 count = 0;
+    in >> count;
+    if (count < 0 || in.status() != QDataStream::Ok) {
+        return false;
+    }
+    IntersectionCache loaded;
+    for (qint32 i = 0; i < count; ++i) {
+        quint64 a = 0, b = 0;
+        QVector<QPointF> hits;
+        in >> a >> b >> hits;
+        if (in.status() != QDataStream::Ok) return false;
+        loaded.store(a, b, hits);
+    }
+    *this = loaded;
+    return true;
+}
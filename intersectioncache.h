@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QHash>
+#include <QPair>
+#include <QPointF>
+#include <QVector>
+
+class QDataStream;
+
+// Memoizes intersection points per unordered pair of objects. Objects are
+// identified by opaque 64-bit keys; invalidating an object drops every pair
+// it takes part in so only those pairs are recomputed later.
+class IntersectionCache {
+public:
+    static quint64 objectKey(int kind, int index) { return (quint64(quint32(kind)) << 32) | quint32(index); }
+
+    bool lookup(quint64 a, quint64 b, QVector<QPointF> &hits) const;
+    void store(quint64 a, quint64 b, const QVector<QPointF> &hits);
+    void invalidate(quint64 object);
+    void clear();
+    int size() const { return pairs.size(); }
+    void save(QDataStream &out) const;
+    bool load(QDataStream &in);
+
+private:
+    using PairKey = QPair<quint64, quint64>;
+
+    static PairKey pairKey(quint64 a, quint64 b) { return a < b ? PairKey(a, b) : PairKey(b, a); }
+
+    QHash<PairKey, QVector<QPointF>> pairs;
+    QHash<quint64, QVector<quint64>> partners;
+};
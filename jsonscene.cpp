@@ -0,0 +1,727 @@
+#include "jsonscene.h"
+
+#include <QFile>
+#include <QFuture>
+#include <QIODevice>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+JsonSceneWriter::JsonSceneWriter(QIODevice &device, bool compact)
+    : device(device),
+      compact(compact) {
+    buffer.reserve(chunk + 256);
+}
+
+bool JsonSceneWriter::write(const Scene &scene) {
+    // Keys are emitted in the sorted order QJsonObject used.
+    open('{');
+    key("circles");
+    open('[');
+    for (const auto &circle : scene.circles) {
+        element();
+        open('{');
+        key("label");
+        string(circle.label);
+        key("r");
+        number(circle.radius);
+        key("x");
+        number(circle.center.x());
+        key("y");
+        number(circle.center.y());
+        close('}');
+    }
+    close(']');
+    key("extendedLines");
+    open('[');
+    for (const auto &line : scene.extendedLines) {
+        element();
+        open('{');
+        key("ax");
+        number(line.a.x());
+        key("ay");
+        number(line.a.y());
+        key("bx");
+        number(line.b.x());
+        key("by");
+        number(line.b.y());
+        key("label");
+        string(line.label);
+        close('}');
+    }
+    close(']');
+    key("lines");
+    open('[');
+    for (const auto &line : scene.lines) {
+        element();
+        open('{');
+        key("a");
+        number(line.a);
+        key("b");
+        number(line.b);
+        key("label");
+        string(line.label);
+        close('}');
+    }
+    close(']');
+    key("points");
+    open('[');
+    for (const auto &point : scene.points) {
+        element();
+        open('{');
+        key("label");
+        string(point.label);
+        key("x");
+        number(point.positiom.x());
+        key("y");
+        number(point.positiom.y());
+        close('}');
+    }
+    close(']');
+    close('}');
+    if (!compact) {
+        buffer.append('\n');
+    }
+    flush();
+    return ok;
+}
+
+void JsonSceneWriter::open(char bracket) {
+    buffer.append(bracket);
+    ++depth;
+    first = true;
+}
+
+void JsonSceneWriter::close(char bracket) {
+    --depth;
+    if (!first && !compact) {
+        buffer.append('\n');
+        buffer.append(QByteArray(depth * 4, ' '));
+    }
+    buffer.append(bracket);
+    first = false;
+    if (buffer.size() >= chunk) {
+        flush();
+    }
+}
+
+void JsonSceneWriter::element() {
+    if (!first) {
+        buffer.append(',');
+    }
+    first = false;
+    if (!compact) {
+        buffer.append('\n');
+        buffer.append(QByteArray(depth * 4, ' '));
+    }
+}
+
+void JsonSceneWriter::key(const char *name) {
+    element();
+    buffer.append('"');
+    buffer.append(name);
+    buffer.append(compact ? "\":" : "\": ");
+}
+
+void JsonSceneWriter::number(double value) {
+    // JSON has no representation for NaN or infinity; QJsonDocument wrote null as well.
+    if (!std::isfinite(value)) {
+        buffer.append("null");
+        return;
+    }
+    char text[32];
+    const auto result = std::to_chars(text, text + sizeof(text), value);
+    buffer.append(text, int(result.ptr - text));
+}
+
+void JsonSceneWriter::number(int value) {
+    char text[16];
+    const auto result = std::to_chars(text, text + sizeof(text), value);
+    buffer.append(text, int(result.ptr - text));
+}
+
+void JsonSceneWriter::string(const QString &text) {
+    static const char hex[] = "0123456789abcdef";
+    buffer.append('"');
+    const QByteArray utf8 = text.toUtf8();
+    for (char c : utf8) {
+        switch (c) {
+        case '"': buffer.append("\\\""); break;
+        case '\\': buffer.append("\\\\"); break;
+        case '\b': buffer.append("\\b"); break;
+        case '\f': buffer.append("\\f"); break;
+        case '\n': buffer.append("\\n"); break;
+        case '\r': buffer.append("\\r"); break;
+        case '\t': buffer.append("\\t"); break;
+        default:
+            if (uchar(c) < 0x20) {
+                const char escape[] = {'\\', 'u', '0', '0', hex[uchar(c) >> 4], hex[uchar(c) & 0xf]};
+                buffer.append(escape, sizeof(escape));
+            } else {
+                buffer.append(c);
+            }
+        }
+    }
+    buffer.append('"');
+}
+
+void JsonSceneWriter::flush() {
+    if (!buffer.isEmpty() && device.write(buffer) != buffer.size()) {
+        ok = false;
+    }
+    buffer.resize(0);
+}
+
+JsonSceneReader::JsonSceneReader(const ProgressFunction &progress)
+    : progress(progress) {
+}
+
+int JsonSceneReader::Field::toInt(int fallback) const {
+    // Like QJsonValue::toInt, only integral numbers in range convert.
+    if (kind != Number || number != std::floor(number) || number < std::numeric_limits<int>::min() ||
+        number > std::numeric_limits<int>::max()) {
+        return fallback;
+    }
+    return int(number);
+}
+
+bool JsonSceneReader::read(QFile &file, Scene &scene) {
+    const qint64 size = file.size();
+    uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+    if (mapped) {
+        const bool ok = read(reinterpret_cast<const char *>(mapped), size, scene);
+        file.unmap(mapped);
+        return ok;
+    }
+    const QByteArray data = file.readAll();
+    return read(data.constData(), data.size(), scene);
+}
+
+bool JsonSceneReader::read(const char *data, qint64 size, Scene &scene) {
+    begin = cur = data;
+    end = data + size;
+    reportStep = std::max<qint64>(size / 100, 64 * 1024);
+    nextReport = reportStep;
+
+    Scene loaded;
+    bool ok = false;
+    QVector<Chunk> chunks;
+    if (size >= parallelThreshold && QThread::idealThreadCount() > 1 && findChunks(chunks)) {
+        ok = parseChunks(chunks, loaded);
+    } else {
+        // Small files, and documents the section scan rejects, take the single-pass path.
+        cur = begin;
+        ok = parseDocument(loaded);
+    }
+    if (!ok) {
+        return false;
+    }
+    if (progress) {
+        progress(size, size);
+    }
+    scene = std::move(loaded);
+    return true;
+}
+
+bool JsonSceneReader::parseDocument(Scene &scene) {
+    skipSpace();
+    if (cur == end || *cur != '{') {
+        return false;
+    }
+    const bool ok = parseObject([&]() {
+        const int kind = sectionKind(key);
+        if (kind < 0) return skipValue();
+        return parseObjectArray([&]() { return parseElement(kind, scene); });
+    });
+    skipSpace();
+    return ok && cur == end;
+}
+
+int JsonSceneReader::sectionKind(const std::string &name) {
+    if (name == "points") return Points;
+    if (name == "lines") return Lines;
+    if (name == "extendedLines") return ExtendedLines;
+    if (name == "circles") return Circles;
+    return -1;
+}
+
+// Parses the object at cur into scene; entries that are not objects are skipped.
+bool JsonSceneReader::parseElement(int kind, Scene &scene) {
+    if (cur == end || *cur != '{') {
+        return skipValue();
+    }
+    Field field;
+    switch (kind) {
+    case Points: {
+        double x = 0.0, y = 0.0;
+        QString label;
+        const bool parsed = parseObject([&]() {
+            if (!parseField(field)) return false;
+            if (key == "x") x = field.toDouble();
+            else if (key == "y") y = field.toDouble();
+            else if (key == "label") label = field.toString();
+            return true;
+        });
+        if (parsed) scene.points.append(Scene::Point(QPointF(x, y), label));
+        return parsed;
+    }
+    case Lines: {
+        int a = -1, b = -1;
+        bool custom = false;
+        QPointF customA, customB;
+        QString label;
+        const bool parsed = parseObject([&]() {
+            if (!parseField(field)) return false;
+            if (key == "a") a = field.toInt(-1);
+            else if (key == "b") b = field.toInt(-1);
+            else if (key == "label") label = field.toString();
+            else if (key == "custom") custom = field.toBool(false);
+            else if (key == "customAx") customA.setX(field.toDouble());
+            else if (key == "customAy") customA.setY(field.toDouble());
+            else if (key == "customBx") customB.setX(field.toDouble());
+            else if (key == "customBy") customB.setY(field.toDouble());
+            return true;
+        });
+        if (!parsed) return false;
+        if (custom) {
+            scene.extendedLines.append(Scene::ExtendedLine(customA, customB, label));
+        } else if (a >= 0 && b >= 0) {
+            scene.lines.append(Scene::Line(a, b, label));
+        }
+        return true;
+    }
+    case ExtendedLines: {
+        QPointF a, b;
+        QString label;
+        const bool parsed = parseObject([&]() {
+            if (!parseField(field)) return false;
+            if (key == "ax") a.setX(field.toDouble());
+            else if (key == "ay") a.setY(field.toDouble());
+            else if (key == "bx") b.setX(field.toDouble());
+            else if (key == "by") b.setY(field.toDouble());
+            else if (key == "label") label = field.toString();
+            return true;
+        });
+        if (parsed) scene.extendedLines.append(Scene::ExtendedLine(a, b, label));
+        return parsed;
+    }
+    default: {
+        double x = 0.0, y = 0.0, r = 0.0;
+        QString label;
+        const bool parsed = parseObject([&]() {
+            if (!parseField(field)) return false;
+            if (key == "x") x = field.toDouble();
+            else if (key == "y") y = field.toDouble();
+            else if (key == "r") r = field.toDouble();
+            else if (key == "label") label = field.toString();
+            return true;
+        });
+        if (parsed && r > 0.0) scene.circles.append(Scene::Circle(QPointF(x, y), r, label));
+        return parsed;
+    }
+    }
+}
+
+// Walks the top-level object and cuts each section array into chunks of
+// whole elements. Array contents are only scanned for brackets, strings and
+// commas here; the chunk parsers validate them.
+bool JsonSceneReader::findChunks(QVector<Chunk> &chunks) {
+    skipSpace();
+    if (cur == end || *cur != '{') {
+        return false;
+    }
+    const bool ok = parseObject([&]() {
+        const int kind = sectionKind(key);
+        if (kind < 0 || cur == end || *cur != '[') return skipValue();
+        return splitArray(kind, chunks);
+    });
+    skipSpace();
+    return ok && cur == end;
+}
+
+bool JsonSceneReader::splitArray(int kind, QVector<Chunk> &chunks) {
+    const char *first = cur + 1;
+    int depth = 0;
+    for (const char *p = first; p < end; ++p) {
+        const char c = *p;
+        if (c == '"') {
+            for (++p; p < end && *p != '"'; ++p) {
+                if (*p == '\\') ++p;
+            }
+            if (p >= end) return false;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (depth > 0) {
+                --depth;
+                continue;
+            }
+            if (c != ']') return false;
+            // An empty array has no chunk; any other tail is parsed, so a trailing comma still fails.
+            const bool blank = std::all_of(first, p, [](char ch) { return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t'; });
+            if (!blank || first != cur + 1) chunks.append(Chunk{kind, first, p});
+            cur = p + 1;
+            return true;
+        } else if (c == ',' && depth == 0 && p - first >= chunkBytes) {
+            chunks.append(Chunk{kind, first, p});
+            first = p + 1;
+        }
+    }
+    return false;
+}
+
+// Parses the chunks on the global thread pool and appends them in document
+// order, so the result matches a single pass. Progress is reported from the
+// calling thread as chunks complete in order.
+bool JsonSceneReader::parseChunks(const QVector<Chunk> &chunks, Scene &scene) {
+    struct Part {
+        Scene scene;
+        bool ok = false;
+    };
+    QVector<QFuture<Part>> parts;
+    parts.reserve(chunks.size());
+    for (const Chunk &chunk : chunks) {
+        parts.append(QtConcurrent::run([chunk]() {
+            Part part;
+            part.ok = JsonSceneReader().parseChunk(chunk, part.scene);
+            return part;
+        }));
+    }
+    // Every chunk is waited for, even after a failure, since they all read the caller's buffer.
+    bool ok = true;
+    for (int i = 0; i < parts.size(); ++i) {
+        const Part part = parts[i].result();
+        ok = ok && part.ok;
+        if (ok) {
+            scene.points += part.scene.points;
+            scene.lines += part.scene.lines;
+            scene.extendedLines += part.scene.extendedLines;
+            scene.circles += part.scene.circles;
+        }
+        if (progress) {
+            progress(chunks[i].last - begin, end - begin);
+        }
+    }
+    return ok;
+}
+
+bool JsonSceneReader::parseChunk(const Chunk &chunk, Scene &scene) {
+    begin = cur = chunk.first;
+    end = chunk.last;
+    while (true) {
+        skipSpace();
+        if (!parseElement(chunk.kind, scene)) return false;
+        skipSpace();
+        if (cur == end) return true;
+        if (*cur != ',') return false;
+        ++cur;
+    }
+}
+
+void JsonSceneReader::skipSpace() {
+    while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t')) {
+        ++cur;
+    }
+}
+
+// Finds the closing quote of the string starting at cur and leaves cur after it.
+bool JsonSceneReader::scanString(const char *&first, const char *&last, bool &escaped) {
+    if (cur == end || *cur != '"') {
+        return false;
+    }
+    first = ++cur;
+    escaped = false;
+    while (cur < end) {
+        const char c = *cur;
+        if (c == '"') {
+            last = cur++;
+            return true;
+        }
+        if (uchar(c) < 0x20) {
+            return false;
+        }
+        if (c == '\\') {
+            escaped = true;
+            if (++cur == end) return false;
+        }
+        ++cur;
+    }
+    return false;
+}
+
+void JsonSceneReader::unescape(const char *first, const char *last, std::string &out) {
+    auto hex4 = [&](const char *p, unsigned &value) {
+        if (last - p < 4) return false;
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = p[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= unsigned(c - '0');
+            else if (c >= 'a' && c <= 'f') value |= unsigned(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') value |= unsigned(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    };
+    auto appendUtf8 = [&](unsigned cp) {
+        if (cp < 0x80) {
+            out += char(cp);
+        } else if (cp < 0x800) {
+            out += char(0xC0 | (cp >> 6));
+            out += char(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += char(0xE0 | (cp >> 12));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        } else {
+            out += char(0xF0 | (cp >> 18));
+            out += char(0x80 | ((cp >> 12) & 0x3F));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+    };
+    out.clear();
+    for (const char *p = first; p < last; ++p) {
+        if (*p != '\\') {
+            out += *p;
+            continue;
+        }
+        const char c = *++p;
+        switch (c) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            unsigned cp = 0;
+            if (!hex4(p + 1, cp)) {
+                out += char(0xEF);
+                out += char(0xBF);
+                out += char(0xBD);
+                break;
+            }
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00) {
+                unsigned low = 0;
+                if (last - p > 2 && p[1] == '\\' && p[2] == 'u' && hex4(p + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else if (cp >= 0xDC00 && cp < 0xE000) {
+                cp = 0xFFFD;
+            }
+            appendUtf8(cp);
+            break;
+        }
+        default:
+            out += c;
+        }
+    }
+}
+
+bool JsonSceneReader::parseKey() {
+    const char *first = nullptr;
+    const char *last = nullptr;
+    bool escaped = false;
+    if (!scanString(first, last, escaped)) {
+        return false;
+    }
+    if (escaped) {
+        unescape(first, last, key);
+    } else {
+        key.assign(first, last);
+    }
+    return true;
+}
+
+bool JsonSceneReader::parseString(QString &out) {
+    const char *first = nullptr;
+    const char *last = nullptr;
+    bool escaped = false;
+    if (!scanString(first, last, escaped)) {
+        return false;
+    }
+    if (escaped) {
+        unescape(first, last, scratch);
+        out = QString::fromUtf8(scratch.data(), qsizetype(scratch.size()));
+    } else {
+        out = QString::fromUtf8(first, qsizetype(last - first));
+    }
+    return true;
+}
+
+bool JsonSceneReader::parseNumber(double &out) {
+    const char *digits = cur < end && *cur == '-' ? cur + 1 : cur;
+    if (digits == end || *digits < '0' || *digits > '9') {
+        return false;
+    }
+    const auto result = std::from_chars(cur, end, out);
+    if (result.ec == std::errc::result_out_of_range) {
+        // Overflow and underflow still consume the literal; let strtod pick infinity or zero.
+        char text[64];
+        const size_t length = std::min(size_t(result.ptr - cur), sizeof(text) - 1);
+        std::memcpy(text, cur, length);
+        text[length] = '\0';
+        out = std::strtod(text, nullptr);
+    } else if (result.ec != std::errc()) {
+        return false;
+    }
+    cur = result.ptr;
+    return true;
+}
+
+bool JsonSceneReader::parseField(Field &field) {
+    if (cur == end) {
+        return false;
+    }
+    switch (*cur) {
+    case '"':
+        field.kind = Field::String;
+        return parseString(field.text);
+    case 't':
+    case 'f': {
+        const bool value = *cur == 't';
+        const qint64 length = value ? 4 : 5;
+        if (end - cur < length || std::memcmp(cur, value ? "true" : "false", size_t(length)) != 0) return false;
+        cur += length;
+        field.kind = Field::Bool;
+        field.boolean = value;
+        return true;
+    }
+    case '{':
+    case '[':
+    case 'n':
+        field.kind = Field::Other;
+        return skipValue();
+    default:
+        field.kind = Field::Number;
+        return parseNumber(field.number);
+    }
+}
+
+// Skips one value of any type, iteratively so deep nesting cannot overflow the stack.
+bool JsonSceneReader::skipValue() {
+    int depth = 0;
+    do {
+        skipSpace();
+        if (cur == end) return false;
+        const char c = *cur;
+        if (c == '{' || c == '[') {
+            ++depth;
+            ++cur;
+            continue;
+        }
+        if (c == '}' || c == ']') {
+            if (depth == 0) return false;
+            --depth;
+            ++cur;
+            continue;
+        }
+        if (c == ',' || c == ':') {
+            if (depth == 0) return false;
+            ++cur;
+            continue;
+        }
+        if (c == '"') {
+            const char *first = nullptr;
+            const char *last = nullptr;
+            bool escaped = false;
+            if (!scanString(first, last, escaped)) return false;
+        } else if (c == 'n' || c == 't' || c == 'f') {
+            const char *word = c == 'n' ? "null" : c == 't' ? "true" : "false";
+            const qint64 length = qint64(std::strlen(word));
+            if (end - cur < length || std::memcmp(cur, word, size_t(length)) != 0) return false;
+            cur += length;
+        } else {
+            double ignored = 0.0;
+            if (!parseNumber(ignored)) return false;
+        }
+    } while (depth > 0);
+    return true;
+}
+
+// Walks the object at cur; onField is called with key set and cur at the value, and must consume it.
+template <typename OnField>
+bool JsonSceneReader::parseObject(OnField onField) {
+    ++cur;
+    skipSpace();
+    if (cur < end && *cur == '}') {
+        ++cur;
+        return true;
+    }
+    while (true) {
+        skipSpace();
+        if (!parseKey()) return false;
+        skipSpace();
+        if (cur == end || *cur != ':') return false;
+        ++cur;
+        skipSpace();
+        if (!onField()) return false;
+        skipSpace();
+        if (cur == end) return false;
+        if (*cur == ',') {
+            ++cur;
+            continue;
+        }
+        if (*cur == '}') {
+            ++cur;
+            return true;
+        }
+        return false;
+    }
+}
+
+template <typename OnElement>
+bool JsonSceneReader::parseArray(OnElement onElement) {
+    ++cur;
+    skipSpace();
+    if (cur < end && *cur == ']') {
+        ++cur;
+        return true;
+    }
+    while (true) {
+        skipSpace();
+        if (!onElement()) return false;
+        reportProgress();
+        skipSpace();
+        if (cur == end) return false;
+        if (*cur == ',') {
+            ++cur;
+            continue;
+        }
+        if (*cur == ']') {
+            ++cur;
+            return true;
+        }
+        return false;
+    }
+}
+
+// A section that is not an array reads as empty, and non-object entries are skipped.
+template <typename OnObject>
+bool JsonSceneReader::parseObjectArray(OnObject onObject) {
+    if (cur == end || *cur != '[') {
+        return skipValue();
+    }
+    return parseArray([&]() {
+        if (cur < end && *cur == '{') return onObject();
+        return skipValue();
+    });
+}
+
+void JsonSceneReader::reportProgress() {
+    const qint64 done = cur - begin;
+    if (progress && done >= nextReport) {
+        progress(done, end - begin);
+        nextReport = done + reportStep;
+    }
+}
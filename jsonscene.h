@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <string>
+
+#include "scene.h"
+
+class QFile;
+class QIODevice;
+
+// Streams a Scene to JSON without building a QJsonDocument. Keys, nesting
+// and key order match what QJsonDocument produced for the same scene, so
+// existing files and readers are unaffected. Output goes through a fixed-size
+// buffer, so memory use does not grow with the scene.
+class JsonSceneWriter {
+public:
+    JsonSceneWriter(QIODevice &device, bool compact = false);
+
+    bool write(const Scene &scene);
+
+private:
+    static constexpr int chunk = 1 << 20;
+
+    QIODevice &device;
+    bool compact;
+    QByteArray buffer;
+    int depth = 0;
+    bool first = true;
+    bool ok = true;
+
+    void open(char bracket);
+    void close(char bracket);
+    void element();
+    void key(const char *name);
+    void number(double value);
+    void number(int value);
+    void string(const QString &text);
+    void flush();
+};
+
+// Event-driven reader for the same schema. A small tokenizer walks the file
+// (memory-mapped when possible) and fills the geometry arrays directly as
+// each object closes, so no QJsonDocument is built. Unknown keys and
+// non-object array entries are skipped, mistyped fields fall back to the
+// defaults QJsonValue used, and legacy "custom" lines become extended lines.
+// Line endpoints are not checked here; SceneFile::read drops dangling lines
+// for every format. Progress is reported roughly every percent of the input.
+//
+// Large inputs are first scanned for the section arrays, which are cut into
+// chunks of whole elements and parsed on worker threads.
+class JsonSceneReader {
+public:
+    using ProgressFunction = std::function<void(qint64 done, qint64 total)>;
+
+    explicit JsonSceneReader(const ProgressFunction &progress = ProgressFunction());
+
+    bool read(QFile &file, Scene &scene);
+    bool read(const char *data, qint64 size, Scene &scene);
+
+private:
+    enum SectionKind { Points, Lines, ExtendedLines, Circles };
+
+    // A run of whole elements of one section array.
+    struct Chunk {
+        int kind = Points;
+        const char *first = nullptr;
+        const char *last = nullptr;
+    };
+
+    static constexpr qint64 parallelThreshold = qint64(8) << 20;
+    static constexpr qint64 chunkBytes = qint64(2) << 20;
+
+    // A scalar field value; containers in field position are skipped and read as Other.
+    struct Field {
+        enum Kind { Other, Number, String, Bool } kind = Other;
+        double number = 0.0;
+        bool boolean = false;
+        QString text;
+
+        double toDouble() const { return kind == Number ? number : 0.0; }
+        int toInt(int fallback) const;
+        bool toBool(bool fallback) const { return kind == Bool ? boolean : fallback; }
+        QString toString() const { return kind == String ? text : QString(); }
+    };
+
+    ProgressFunction progress;
+    const char *begin = nullptr;
+    const char *cur = nullptr;
+    const char *end = nullptr;
+    qint64 reportStep = 0;
+    qint64 nextReport = 0;
+    std::string key;
+    std::string scratch;
+
+    bool parseDocument(Scene &scene);
+    static int sectionKind(const std::string &name);
+    bool parseElement(int kind, Scene &scene);
+    bool findChunks(QVector<Chunk> &chunks);
+    bool splitArray(int kind, QVector<Chunk> &chunks);
+    bool parseChunks(const QVector<Chunk> &chunks, Scene &scene);
+    bool parseChunk(const Chunk &chunk, Scene &scene);
+    void skipSpace();
+    bool parseKey();
+    bool parseString(QString &out);
+    bool scanString(const char *&first, const char *&last, bool &escaped);
+    static void unescape(const char *first, const char *last, std::string &out);
+    bool parseNumber(double &out);
+    bool parseField(Field &field);
+    bool skipValue();
+    template <typename OnField>
+    bool parseObject(OnField onField);
+    template <typename OnElement>
+    bool parseArray(OnElement onElement);
+    template <typename OnObject>
+    bool parseObjectArray(OnObject onObject);
+    void reportProgress();
+};
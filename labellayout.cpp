@@ -0,0 +1,93 @@
+#include "labellayout.h"
+
+#include <QFontMetricsF>
+#include <cmath>
+
+void LabelLayout::clear() {
+    requests.clear();
+    placed.clear();
+    cells.clear();
+    skipped = 0;
+}
+
+void LabelLayout::add(const QPointF &anchor, const QPointF &offset, const QString &text) {
+    if (text.isEmpty()) {
+        return;
+    }
+    requests.append(Request{anchor, offset, text});
+}
+
+quint64 LabelLayout::cellKey(int cx, int cy) {
+    return (quint64(quint32(cx)) << 32) | quint32(cy);
+}
+
+bool LabelLayout::overlapsPlaced(const QRectF &rect) const {
+    const int x0 = int(std::floor(rect.left() / cellSize));
+    const int x1 = int(std::floor(rect.right() / cellSize));
+    const int y0 = int(std::floor(rect.top() / cellSize));
+    const int y1 = int(std::floor(rect.bottom() / cellSize));
+    for (int cx = x0; cx <= x1; ++cx) {
+        for (int cy = y0; cy <= y1; ++cy) {
+            auto it = cells.constFind(cellKey(cx, cy));
+            if (it == cells.constEnd()) continue;
+            for (int idx : it.value()) {
+                if (placed[idx].bounds.intersects(rect)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void LabelLayout::insertPlaced(const Placement &placement) {
+    const int idx = placed.size();
+    placed.append(placement);
+    const QRectF &rect = placement.bounds;
+    const int x0 = int(std::floor(rect.left() / cellSize));
+    const int x1 = int(std::floor(rect.right() / cellSize));
+    const int y0 = int(std::floor(rect.top() / cellSize));
+    const int y1 = int(std::floor(rect.bottom() / cellSize));
+    for (int cx = x0; cx <= x1; ++cx) {
+        for (int cy = y0; cy <= y1; ++cy) {
+            cells[cellKey(cx, cy)].append(idx);
+        }
+    }
+}
+
+void LabelLayout::place(const QFont &font, const QRectF &area) {
+    placed.clear();
+    cells.clear();
+    skipped = 0;
+    placed.reserve(requests.size());
+
+    QFontMetricsF metrics(font);
+    const double ascent = metrics.ascent();
+    for (const auto &req : requests) {
+        // Text bounds relative to the baseline origin.
+        const QRectF textRect = metrics.boundingRect(req.text);
+        const double w = textRect.width();
+        const double dx = req.offset.x();
+        const double dy = req.offset.y();
+        // Preferred offset first, then mirrored to the left, below, and below-left.
+        const QPointF candidates[] = {
+            QPointF(dx, dy),
+            QPointF(-dx - w, dy),
+            QPointF(dx, -dy + ascent),
+            QPointF(-dx - w, -dy + ascent),
+        };
+        bool done = false;
+        for (const auto &offset : candidates) {
+            const QPointF baseline = req.anchor + offset;
+            const QRectF bounds = textRect.translated(baseline);
+            if (!area.intersects(bounds)) continue;
+            if (overlapsPlaced(bounds)) continue;
+            insertPlaced(Placement{baseline, bounds, req.text});
+            done = true;
+            break;
+        }
+        if (!done) {
+            ++skipped;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QFont>
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+
+// Greedy screen-space label placement. Labels are tried at a few positions
+// around their anchor in request order; the first position that does not
+// overlap an already placed label wins, otherwise the label is skipped.
+class LabelLayout {
+public:
+    struct Placement {
+        QPointF baseline;
+        QRectF bounds;
+        QString text;
+    };
+
+    void clear();
+    void add(const QPointF &anchor, const QPointF &offset, const QString &text);
+    void place(const QFont &font, const QRectF &area);
+    const QVector<Placement> &placements() const { return placed; }
+    int requestCount() const { return requests.size(); }
+    int skippedCount() const { return skipped; }
+
+private:
+    struct Request {
+        QPointF anchor;
+        QPointF offset;
+        QString text;
+    };
+
+    static constexpr double cellSize = 32.0;
+
+    QVector<Request> requests;
+    QVector<Placement> placed;
+    QHash<quint64, QVector<int>> cells;
+    int skipped = 0;
+
+    bool overlapsPlaced(const QRectF &rect) const;
+    void insertPlaced(const Placement &placement);
+    static quint64 cellKey(int cx, int cy);
+};
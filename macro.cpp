@@ -0,0 +1,376 @@
+#include "macro.h"
+
+#include <cstring>
+
+namespace {
+QString number(double value) {
+    return QString::number(value, 'f', 8);
+}
+
+QString pointText(const QPointF &point) {
+    return QStringLiteral("%1,%2").arg(number(point.x()), number(point.y()));
+}
+
+QString pairText(const QPointF &a, const QPointF &b) {
+    return QStringLiteral("%1|%2").arg(pointText(a), pointText(b));
+}
+
+bool parsePoint(const QString &text, QPointF &point) {
+    const QStringList coords = text.split(',');
+    bool okX = false, okY = false;
+    const double x = coords.value(0).toDouble(&okX);
+    const double y = coords.value(1).toDouble(&okY);
+    point = QPointF(x, y);
+    return okX && okY;
+}
+
+const char kindLetters[ObjectIds::KindCount + 1] = "PLEC";
+
+QString refText(const Macro::Ref &ref) {
+    return QStringLiteral("#%1%2").arg(QChar(kindLetters[ref.kind])).arg(ref.id);
+}
+
+bool parseRef(const QString &text, Macro::Ref &ref) {
+    if (text.size() < 3 || text[0] != '#') {
+        return false;
+    }
+    const char *letter = std::strchr(kindLetters, text[1].toLatin1());
+    bool ok = false;
+    ref.id = text.mid(2).toUInt(&ok);
+    if (!letter || !*letter || !ok) {
+        return false;
+    }
+    ref.kind = ObjectIds::Kind(letter - kindLetters);
+    return true;
+}
+
+bool parseRefs(const QString &text, QChar separator, QVector<Macro::Ref> &refs) {
+    for (const QString &item : text.split(separator, Qt::SkipEmptyParts)) {
+        Macro::Ref ref;
+        if (!parseRef(item, ref)) return false;
+        refs.append(ref);
+    }
+    return true;
+}
+
+bool parsePair(const QString &text, QPointF &a, QPointF &b) {
+    const QStringList pair = text.split('|');
+    return pair.size() == 2 && parsePoint(pair[0], a) && parsePoint(pair[1], b);
+}
+
+// Items that do not parse are dropped, as playback always did.
+Macro::Selection parseSelection(const QStringList &fields) {
+    Macro::Selection selection;
+    for (const QString &field : fields) {
+        const QString items = field.mid(2);
+        if (field.startsWith("P=")) {
+            for (const QString &item : items.split('|', Qt::SkipEmptyParts)) {
+                QPointF p;
+                if (parsePoint(item, p)) selection.points.append(p);
+            }
+        } else if (field.startsWith("L=") || field.startsWith("E=")) {
+            auto &lines = field.startsWith("L=") ? selection.lines : selection.extendedLines;
+            for (const QString &item : items.split('#', Qt::SkipEmptyParts)) {
+                QPointF a, b;
+                if (parsePair(item, a, b)) lines.append(qMakePair(a, b));
+            }
+        } else if (field.startsWith("C=")) {
+            for (const QString &item : items.split('#', Qt::SkipEmptyParts)) {
+                const QStringList parts = item.split(',');
+                bool ok1 = false, ok2 = false, ok3 = false;
+                const double x = parts.value(0).toDouble(&ok1);
+                const double y = parts.value(1).toDouble(&ok2);
+                const double r = parts.value(2).toDouble(&ok3);
+                if (parts.size() == 3 && ok1 && ok2 && ok3) selection.circles.append(qMakePair(QPointF(x, y), r));
+            }
+        }
+    }
+    return selection;
+}
+}  // namespace
+
+Macro::Selection Macro::selection(int index) const {
+    Selection selection;
+    if (commands[index].opcode != Opcode::DeleteSelected) {
+        return selection;
+    }
+    const double *args = operands(index);
+    const int counts[4] = {int(args[0]), int(args[1]), int(args[2]), int(args[3])};
+    args += 4;
+    for (int i = 0; i < counts[0]; ++i, args += 2) {
+        selection.points.append(QPointF(args[0], args[1]));
+    }
+    for (int i = 0; i < counts[1]; ++i, args += 4) {
+        selection.lines.append(qMakePair(QPointF(args[0], args[1]), QPointF(args[2], args[3])));
+    }
+    for (int i = 0; i < counts[2]; ++i, args += 4) {
+        selection.extendedLines.append(qMakePair(QPointF(args[0], args[1]), QPointF(args[2], args[3])));
+    }
+    for (int i = 0; i < counts[3]; ++i, args += 3) {
+        selection.circles.append(qMakePair(QPointF(args[0], args[1]), args[2]));
+    }
+    return selection;
+}
+
+QVector<Macro::Ref> Macro::refs(int index) const {
+    QVector<Ref> out;
+    const Command &command = commands[index];
+    // Only the leading kind/id pairs; MovePointById follows its point with coordinates.
+    const int count = command.opcode == Opcode::MovePointById ? 1 : command.operandCount / 2;
+    const double *args = operands(index);
+    for (int i = 0; i < count; ++i) {
+        out.append(Ref{ObjectIds::Kind(int(args[2 * i])), quint32(args[2 * i + 1])});
+    }
+    return out;
+}
+
+void Macro::clear() {
+    commands.clear();
+    values.clear();
+    strings.clear();
+    stringIds.clear();
+}
+
+void Macro::push(Opcode opcode, std::initializer_list<double> operands, const QString *text) {
+    Command command;
+    command.opcode = opcode;
+    command.operand = values.size();
+    command.operandCount = int(operands.size());
+    command.string = text ? intern(*text) : -1;
+    for (double value : operands) values.append(value);
+    commands.append(command);
+}
+
+int Macro::intern(const QString &text) {
+    auto it = stringIds.constFind(text);
+    if (it != stringIds.constEnd()) {
+        return it.value();
+    }
+    strings.append(text);
+    stringIds.insert(text, strings.size() - 1);
+    return strings.size() - 1;
+}
+
+void Macro::append(Opcode opcode) {
+    push(opcode, {});
+}
+
+void Macro::addPoint(const QPointF &point) {
+    push(Opcode::AddPoint, {point.x(), point.y()});
+}
+
+void Macro::movePoint(const QPointF &from, const QPointF &to) {
+    push(Opcode::MovePoint, {from.x(), from.y(), to.x(), to.y()});
+}
+
+void Macro::addLine(const QPointF &a, const QPointF &b) {
+    push(Opcode::AddLine, {a.x(), a.y(), b.x(), b.y()});
+}
+
+void Macro::addCircle(const QPointF &center, const QPointF &edge) {
+    push(Opcode::AddCircle, {center.x(), center.y(), edge.x(), edge.y()});
+}
+
+void Macro::addNormal(const QPointF &a, const QPointF &b, const QPointF &point) {
+    push(Opcode::AddNormal, {a.x(), a.y(), b.x(), b.y(), point.x(), point.y()});
+}
+
+void Macro::deleteSelected(const Selection &selection) {
+    push(Opcode::DeleteSelected, {double(selection.points.size()), double(selection.lines.size()),
+                                  double(selection.extendedLines.size()), double(selection.circles.size())});
+    Command &command = commands.last();
+    for (const auto &p : selection.points) values << p.x() << p.y();
+    for (const auto &l : selection.lines) values << l.first.x() << l.first.y() << l.second.x() << l.second.y();
+    for (const auto &l : selection.extendedLines) values << l.first.x() << l.first.y() << l.second.x() << l.second.y();
+    for (const auto &c : selection.circles) values << c.first.x() << c.first.y() << c.second;
+    command.operandCount = values.size() - command.operand;
+}
+
+void Macro::setLabel(const QString &label) {
+    push(Opcode::SetLabel, {}, &label);
+}
+
+void Macro::open(const QString &path) {
+    push(Opcode::Open, {}, &path);
+}
+
+void Macro::save(const QString &path) {
+    push(Opcode::Save, {}, &path);
+}
+
+void Macro::addLine(const Ref &a, const Ref &b) {
+    push(Opcode::AddLineById, {double(a.kind), double(a.id), double(b.kind), double(b.id)});
+}
+
+void Macro::addCircle(const Ref &center, const Ref &edge) {
+    push(Opcode::AddCircleById, {double(center.kind), double(center.id), double(edge.kind), double(edge.id)});
+}
+
+void Macro::addNormal(const Ref &line, const Ref &point) {
+    push(Opcode::AddNormalById, {double(line.kind), double(line.id), double(point.kind), double(point.id)});
+}
+
+void Macro::movePoint(const Ref &point, const QPointF &to) {
+    push(Opcode::MovePointById, {double(point.kind), double(point.id), to.x(), to.y()});
+}
+
+void Macro::deleteObjects(const QVector<Ref> &objects) {
+    push(Opcode::DeleteById, {});
+    Command &command = commands.last();
+    for (const Ref &ref : objects) values << double(ref.kind) << double(ref.id);
+    command.operandCount = values.size() - command.operand;
+}
+
+void Macro::setLabel(const Ref &object, const QString &label) {
+    push(Opcode::SetLabelById, {double(object.kind), double(object.id)}, &label);
+}
+
+bool Macro::appendLine(const QString &line) {
+    auto payload = [&line](const char *prefix) { return line.mid(int(qstrlen(prefix))); };
+    QPointF a, b, p;
+    QVector<Ref> refs;
+    // By-id forms first; a payload starting with '#' cannot be a coordinate.
+    if (line.startsWith("addLine:#") || line.startsWith("addCircle:#")) {
+        const bool isLine = line.startsWith("addLine:");
+        if (!parseRefs(payload(isLine ? "addLine:" : "addCircle:"), '|', refs) || refs.size() != 2) return false;
+        if (isLine) addLine(refs[0], refs[1]); else addCircle(refs[0], refs[1]);
+        return true;
+    }
+    if (line.startsWith("addNormal:#")) {
+        if (!parseRefs(payload("addNormal:"), ';', refs) || refs.size() != 2) return false;
+        addNormal(refs[0], refs[1]);
+        return true;
+    }
+    if (line.startsWith("movePoint:#")) {
+        const QStringList parts = payload("movePoint:").split('|');
+        Ref ref;
+        if (parts.size() != 2 || !parseRef(parts[0], ref) || !parsePoint(parts[1], p)) return false;
+        movePoint(ref, p);
+        return true;
+    }
+    if (line.startsWith("deleteObjects:")) {
+        if (!parseRefs(payload("deleteObjects:"), ',', refs)) return false;
+        deleteObjects(refs);
+        return true;
+    }
+    if (line.startsWith("labelObject:")) {
+        const QString rest = payload("labelObject:");
+        const int bar = rest.indexOf('|');
+        Ref ref;
+        if (bar < 0 || !parseRef(rest.left(bar), ref)) return false;
+        setLabel(ref, rest.mid(bar + 1));
+        return true;
+    }
+    if (line == "extendLines") {
+        append(Opcode::ExtendLines);
+    } else if (line == "addCircle") {
+        append(Opcode::AddCircleSelected);
+    } else if (line.startsWith("deleteSelected")) {
+        deleteSelected(parseSelection(line.split(';').mid(1)));
+    } else if (line == "deleteAll") {
+        append(Opcode::DeleteAll);
+    } else if (line == "addNormal") {
+        append(Opcode::AddNormalSelected);
+    } else if (line == "intersections") {
+        append(Opcode::Intersections);
+    } else if (line.startsWith("addPoint:")) {
+        const QString coords = payload("addPoint:");
+        if (coords.split(',').size() != 2 || !parsePoint(coords, p)) return false;
+        addPoint(p);
+    } else if (line.startsWith("setLabel:")) {
+        setLabel(payload("setLabel:"));
+    } else if (line.startsWith("open:")) {
+        open(payload("open:"));
+    } else if (line.startsWith("save:")) {
+        save(payload("save:"));
+    } else if (line.startsWith("addNormal:")) {
+        const QStringList parts = payload("addNormal:").split(';');
+        if (parts.size() != 2 || !parsePair(parts[0], a, b) || !parsePoint(parts[1], p)) return false;
+        addNormal(a, b, p);
+    } else if (line.startsWith("addLine:")) {
+        if (!parsePair(payload("addLine:"), a, b)) return false;
+        addLine(a, b);
+    } else if (line.startsWith("movePoint:")) {
+        if (!parsePair(payload("movePoint:"), a, b)) return false;
+        movePoint(a, b);
+    } else if (line.startsWith("addCircle:")) {
+        if (!parsePair(payload("addCircle:"), a, b)) return false;
+        addCircle(a, b);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int Macro::appendLines(const QStringList &lines) {
+    int rejected = 0;
+    for (const QString &line : lines) {
+        const QString trimmed = line.trimmed();
+        if (!trimmed.isEmpty() && !appendLine(trimmed)) ++rejected;
+    }
+    return rejected;
+}
+
+QString Macro::line(int index) const {
+    const double *args = operands(index);
+    auto point = [args](int i) { return QPointF(args[i], args[i + 1]); };
+    switch (commands[index].opcode) {
+    case Opcode::ExtendLines: return QStringLiteral("extendLines");
+    case Opcode::AddCircleSelected: return QStringLiteral("addCircle");
+    case Opcode::AddNormalSelected: return QStringLiteral("addNormal");
+    case Opcode::Intersections: return QStringLiteral("intersections");
+    case Opcode::DeleteAll: return QStringLiteral("deleteAll");
+    case Opcode::AddPoint: return QStringLiteral("addPoint:%1").arg(pointText(point(0)));
+    case Opcode::MovePoint: return QStringLiteral("movePoint:%1").arg(pairText(point(0), point(2)));
+    case Opcode::AddLine: return QStringLiteral("addLine:%1").arg(pairText(point(0), point(2)));
+    case Opcode::AddCircle: return QStringLiteral("addCircle:%1").arg(pairText(point(0), point(2)));
+    case Opcode::AddNormal: return QStringLiteral("addNormal:%1;%2").arg(pairText(point(0), point(2)), pointText(point(4)));
+    case Opcode::SetLabel: return QStringLiteral("setLabel:%1").arg(string(index));
+    case Opcode::Open: return QStringLiteral("open:%1").arg(string(index));
+    case Opcode::Save: return QStringLiteral("save:%1").arg(string(index));
+    case Opcode::AddLineById:
+    case Opcode::AddCircleById: {
+        const QVector<Ref> refs = this->refs(index);
+        const QString name = commands[index].opcode == Opcode::AddLineById ? "addLine" : "addCircle";
+        return QStringLiteral("%1:%2|%3").arg(name, refText(refs[0]), refText(refs[1]));
+    }
+    case Opcode::AddNormalById: {
+        const QVector<Ref> refs = this->refs(index);
+        return QStringLiteral("addNormal:%1;%2").arg(refText(refs[0]), refText(refs[1]));
+    }
+    case Opcode::MovePointById:
+        return QStringLiteral("movePoint:%1|%2").arg(refText(refs(index)[0]), pointText(point(2)));
+    case Opcode::DeleteById: {
+        QStringList entries;
+        for (const Ref &ref : refs(index)) entries.append(refText(ref));
+        return QStringLiteral("deleteObjects:%1").arg(entries.join(','));
+    }
+    case Opcode::SetLabelById:
+        return QStringLiteral("labelObject:%1|%2").arg(refText(refs(index)[0]), string(index));
+    case Opcode::DeleteSelected: {
+        const Selection selection = this->selection(index);
+        QStringList fields{QStringLiteral("deleteSelected")};
+        QStringList entries;
+        for (const auto &p : selection.points) entries.append(pointText(p));
+        if (!entries.isEmpty()) fields.append(QStringLiteral("P=%1").arg(entries.join("|")));
+        entries.clear();
+        for (const auto &l : selection.lines) entries.append(pairText(l.first, l.second));
+        if (!entries.isEmpty()) fields.append(QStringLiteral("L=%1").arg(entries.join("#")));
+        entries.clear();
+        for (const auto &l : selection.extendedLines) entries.append(pairText(l.first, l.second));
+        if (!entries.isEmpty()) fields.append(QStringLiteral("E=%1").arg(entries.join("#")));
+        entries.clear();
+        for (const auto &c : selection.circles) entries.append(QStringLiteral("%1,%2").arg(pointText(c.first), number(c.second)));
+        if (!entries.isEmpty()) fields.append(QStringLiteral("C=%1").arg(entries.join("#")));
+        return fields.join(';');
+    }
+    }
+    return QString();
+}
+
+QStringList Macro::lines() const {
+    QStringList out;
+    out.reserve(commands.size());
+    for (int i = 0; i < commands.size(); ++i) out.append(line(i));
+    return out;
+}
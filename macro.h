@@ -0,0 +1,114 @@
+#pragma once
+
+#include <QHash>
+#include <QPair>
+#include <QPointF>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <initializer_list>
+
+#include "objectids.h"
+
+// A recorded macro in executable form. Each command is an opcode plus a run
+// of numeric operands in one shared array and, for labels and paths, an
+// entry in a string table, so playback dispatches on the opcode without
+// looking at text again. The line-based text format is kept for macro files:
+// lines are parsed once on import and written back out on export.
+//
+// Commands recorded now name the objects they act on by creation-order id
+// (see ObjectIds), written "#P3" for point 3 and L, E and C for lines,
+// extended lines and circles. Older macros locate objects by coordinates;
+// those commands are still read and replayed as before.
+class Macro {
+public:
+    enum class Opcode : quint8 {
+        ExtendLines,
+        AddCircleSelected,
+        AddNormalSelected,
+        Intersections,
+        DeleteSelected,
+        DeleteAll,
+        AddPoint,
+        MovePoint,
+        AddLine,
+        AddCircle,
+        AddNormal,
+        SetLabel,
+        Open,
+        Save,
+        // By id; operands hold a kind and an id per referenced object.
+        AddLineById,
+        AddCircleById,
+        AddNormalById,
+        MovePointById,
+        DeleteById,
+        SetLabelById
+    };
+
+    struct Ref {
+        ObjectIds::Kind kind = ObjectIds::Point;
+        quint32 id = 0;
+    };
+
+    struct Command {
+        Opcode opcode = Opcode::DeleteAll;
+        int operand = 0;
+        int operandCount = 0;
+        int string = -1;
+    };
+
+    // Operands of DeleteSelected: the number of points, lines, extended lines
+    // and circles, then x, y per point, ax, ay, bx, by per line and extended
+    // line, and x, y, r per circle.
+    struct Selection {
+        QVector<QPointF> points;
+        QVector<QPair<QPointF, QPointF>> lines;
+        QVector<QPair<QPointF, QPointF>> extendedLines;
+        QVector<QPair<QPointF, double>> circles;
+    };
+
+    bool isEmpty() const { return commands.isEmpty(); }
+    int size() const { return commands.size(); }
+    const Command &at(int index) const { return commands[index]; }
+    const double *operands(int index) const { return values.constData() + commands[index].operand; }
+    QString string(int index) const { return commands[index].string >= 0 ? strings[commands[index].string] : QString(); }
+    Selection selection(int index) const;
+    // Objects referenced by a by-id command, in operand order.
+    QVector<Ref> refs(int index) const;
+    void clear();
+
+    void append(Opcode opcode);
+    void addPoint(const QPointF &point);
+    void movePoint(const QPointF &from, const QPointF &to);
+    void addLine(const QPointF &a, const QPointF &b);
+    void addCircle(const QPointF &center, const QPointF &edge);
+    void addNormal(const QPointF &a, const QPointF &b, const QPointF &point);
+    void deleteSelected(const Selection &selection);
+    void setLabel(const QString &label);
+    void open(const QString &path);
+    void save(const QString &path);
+    void addLine(const Ref &a, const Ref &b);
+    void addCircle(const Ref &center, const Ref &edge);
+    void addNormal(const Ref &line, const Ref &point);
+    // Operands: the point, then x, y of its new position.
+    void movePoint(const Ref &point, const QPointF &to);
+    void deleteObjects(const QVector<Ref> &objects);
+    void setLabel(const Ref &object, const QString &label);
+
+    // Parses one line of the text format; false leaves the macro unchanged.
+    bool appendLine(const QString &line);
+    // Appends every non-empty line that parses and returns how many did not.
+    int appendLines(const QStringList &lines);
+    QString line(int index) const;
+    QStringList lines() const;
+
+private:
+    QVector<Command> commands;
+    QVector<double> values;
+    QStringList strings;
+    QHash<QString, int> stringIds;
+
+    void push(Opcode opcode, std::initializer_list<double> operands, const QString *text = nullptr);
+    int intern(const QString &text);
+};
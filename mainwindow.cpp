@@ -1,22 +1,28 @@
 #include "mainwindow.h"
 
+#include <QActionGroup>
+#include <QDateTime>
 #include <QDialog>
 #include <QDialogButtonBox>
 #include <QDoubleSpinBox>
 #include <QFormLayout>
 #include <QHBoxLayout>
 #include <QLineEdit>
+#include <QLocale>
 #include <QMessageBox>
 #include <QMenu>
 #include <QMenuBar>
 #include <QInputDialog>
+#include <QProgressDialog>
 #include <QPushButton>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QStatusBar>
 #include <QStyle>
 #include <QTimer>
 #include <QEventLoop>
+#include <QElapsedTimer>
 #include <QVBoxLayout>
 #include <QWidget>
 #include <QPointF>
@@ -25,6 +31,7 @@
 #include <QPrinter>
 #include <QPrintDialog>
 #include <QPainter>
+#include <QImage>
 
 #include "canvaswidget.h"
 
@@ -44,16 +51,62 @@ MainWindow::MainWindow(QWidget *parent)
     QMenu *fileMenu = menuBar()->addMenu(tr("File"));
     QAction *openAction = fileMenu->addAction(tr("Open..."));
     QAction *saveAsAction = fileMenu->addAction(tr("Save As..."));
-    QAction *openMacroAction = fileMenu->addAction(tr("Open Macro..."));
+    openMacroAction_ = fileMenu->addAction(tr("Open Macro..."));
     QAction *saveMacroAction = fileMenu->addAction(tr("Save Macro..."));
+    QMenu *playbackMenu = fileMenu->addMenu(tr("Macro Playback"));
+    auto *playbackGroup = new QActionGroup(this);
+    auto addPlaybackSpeed = [&](const QString &text, PlaybackSpeed speed) {
+        QAction *action = playbackMenu->addAction(text);
+        action->setCheckable(true);
+        action->setChecked(playbackSpeed_ == speed);
+        playbackGroup->addAction(action);
+        connect(action, &QAction::triggered, this, [this, speed]() { playbackSpeed_ = speed; });
+    };
+    addPlaybackSpeed(tr("One Command per Second"), PlaybackSpeed::Timed);
+    addPlaybackSpeed(tr("As Fast as Possible"), PlaybackSpeed::Fastest);
+    addPlaybackSpeed(tr("Step Through Commands"), PlaybackSpeed::Step);
+    stopMacroAction_ = fileMenu->addAction(tr("Stop Macro"));
+    stopMacroAction_->setShortcut(Qt::Key_Escape);
+    stopMacroAction_->setEnabled(false);
+    connect(stopMacroAction_, &QAction::triggered, this, [this]() {
+        playbackStopped_ = true;
+        if (playbackWait_) playbackWait_->quit();
+    });
     fileMenu->addSeparator();
+    QAction *exportImageAction = fileMenu->addAction(tr("Export Image..."));
     QAction *printAction = fileMenu->addAction(tr("Print..."));
     connect(openAction, &QAction::triggered, this, &MainWindow::onOpenFileClicked);
     connect(saveAsAction, &QAction::triggered, this, &MainWindow::onSaveAsClicked);
-    connect(openMacroAction, &QAction::triggered, this, &MainWindow::onOpenMacroClicked);
+    connect(openMacroAction_, &QAction::triggered, this, &MainWindow::onOpenMacroClicked);
     connect(saveMacroAction, &QAction::triggered, this, &MainWindow::onSaveMacroClicked);
+    connect(exportImageAction, &QAction::triggered, this, &MainWindow::onExportImageClicked);
     connect(printAction, &QAction::triggered, this, &MainWindow::onPrintClicked);
 
+    QMenu *viewMenu = menuBar()->addMenu(tr("View"));
+    QAction *resetViewAction = viewMenu->addAction(tr("Reset View"));
+    connect(resetViewAction, &QAction::triggered, canvas_, &CanvasWidget::resetView);
+    QAction *statsAction = viewMenu->addAction(tr("Frame Statistics"));
+    statsAction->setCheckable(true);
+    connect(statsAction, &QAction::toggled, canvas_, &CanvasWidget::setStatsOverlayVisible);
+    QAction *latencyAction = viewMenu->addAction(tr("Export Input Latency..."));
+    connect(latencyAction, &QAction::triggered, this, &MainWindow::onExportLatencyClicked);
+    viewMenu->addSeparator();
+    QAction *snapObjectsAction = viewMenu->addAction(tr("Snap to Objects"));
+    snapObjectsAction->setCheckable(true);
+    snapObjectsAction->setChecked(canvas_->snapsToObjects());
+    connect(snapObjectsAction, &QAction::toggled, canvas_, &CanvasWidget::setSnapToObjects);
+    QAction *snapGridAction = viewMenu->addAction(tr("Snap to Grid"));
+    snapGridAction->setCheckable(true);
+    snapGridAction->setChecked(canvas_->snapsToGrid());
+    connect(snapGridAction, &QAction::toggled, canvas_, &CanvasWidget::setSnapToGrid);
+    QAction *gridSpacingAction = viewMenu->addAction(tr("Grid Spacing..."));
+    connect(gridSpacingAction, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        double spacing = QInputDialog::getDouble(this, tr("Grid Spacing"), tr("Spacing:"), canvas_->gridSpacingValue(),
+                                                 1e-6, 1e6, 6, &ok);
+        if (ok) canvas_->setGridSpacing(spacing);
+    });
+
     auto *controls = new QHBoxLayout();
     controls->setSpacing(8);
     auto *addLineBtn = new QPushButton("Connect", central);
@@ -93,53 +146,49 @@ MainWindow::MainWindow(QWidget *parent)
     connect(deleteBtn, &QPushButton::clicked, this, &MainWindow::onDeleteClicked);
     connect(deleteAllBtn, &QPushButton::clicked, this, &MainWindow::onDeleteAllClicked);
     connect(canvas_, &CanvasWidget::pointAdded, this, &MainWindow::onPointAdded);
+    connect(canvas_, &CanvasWidget::pointMoved, this, &MainWindow::onPointMoved);
+    connect(canvas_, &CanvasWidget::saveFinished, this, &MainWindow::onSaveFinished);
 
     setCentralWidget(central);
+    // Asked once the window is up, so the question has a parent to sit over.
+    QTimer::singleShot(0, this, &MainWindow::offerSessionRecovery);
 }
 
 void MainWindow::onAddLineClicked() {
     if (canvas_->selectedCount() < 2) {
-        QMessageBox::information(this, "Select Points", "Select at least two points (Ctrl+click to multi-select) to add a line.");
+        inform("Select Points", "Select at least two points (Ctrl+click to multi-select) to add a line.");
         return;
     }
+    // Ids are taken before the edit, which may load a paged scene and renumber the selection.
+    QList<int> indices = canvas_->selectedIndices();
+    std::sort(indices.begin(), indices.end());
+    const Macro::Ref a = objectRef(ObjectIds::Point, indices[0]);
+    const Macro::Ref b = objectRef(ObjectIds::Point, indices[1]);
     if (!canvas_->addLineBetweenSelected()) {
-        QMessageBox::information(this, "Line Exists", "A line between those points already exists.");
+        inform("Line Exists", "A line between those points already exists.");
         return;
     }
     pointCounter_ = canvas_->pointCount() + 1;
     if (recording_) {
-        QList<int> indices = canvas_->selectedPointsOrdered();
-        if (indices.size() < 2) {
-            indices = canvas_->selectedIndices();
-            std::sort(indices.begin(), indices.end());
-        }
-        if (indices.size() >= 2) {
-            QPointF a = canvas_->pointAt(indices[0]);
-            QPointF b = canvas_->pointAt(indices[1]);
-            recordedCommands_.append(QStringLiteral("addLine:%1,%2|%3,%4")
-                                         .arg(a.x(), 0, 'f', 8)
-                                         .arg(a.y(), 0, 'f', 8)
-                                         .arg(b.x(), 0, 'f', 8)
-                                         .arg(b.y(), 0, 'f', 8));
-        }
+        macro_.addLine(a, b);
     }
 }
 
 void MainWindow::onExtendLineClicked() {
     if (canvas_->selectedLineCount() < 1) {
-        QMessageBox::information(this, "Select Line", "Select at least one line to extend (click or Ctrl+click).");
+        inform("Select Line", "Select at least one line to extend (click or Ctrl+click).");
         return;
     }
     if (!canvas_->extendSelectedLines()) {
-        QMessageBox::information(this, "Extend Line", "No lines were extended (they may already be extended).");
+        inform("Extend Line", "No lines were extended (they may already be extended).");
     }
     pointCounter_ = canvas_->pointCount() + 1;
-    if (recording_) recordedCommands_.append(QStringLiteral("extendLines"));
+    if (recording_) macro_.append(Macro::Opcode::ExtendLines);
 }
 
 void MainWindow::onAddCircleClicked() {
     if (canvas_->selectedCount() != 2) {
-        QMessageBox::information(this, "Select Points", "Select exactly two points (Ctrl+click) to define center and radius.");
+        inform("Select Points", "Select exactly two points (Ctrl+click) to define center and radius.");
         return;
     }
     QList<int> indices = canvas_->selectedPointsOrdered();
@@ -147,97 +196,66 @@ void MainWindow::onAddCircleClicked() {
         indices = canvas_->selectedIndices();
         std::sort(indices.begin(), indices.end());
     }
-    QPointF center = canvas_->pointAt(indices[0]);
-    QPointF edge = canvas_->pointAt(indices[1]);
-    double r = std::hypot(center.x() - edge.x(), center.y() - edge.y());
-    if (r <= 0.0) {
-        QMessageBox::information(this, "Invalid Radius", "The two points must not be identical.");
+    const Macro::Ref centerRef = objectRef(ObjectIds::Point, indices[0]);
+    const Macro::Ref edgeRef = objectRef(ObjectIds::Point, indices[1]);
+    if (!canvas_->addCircleFromSelected()) {
+        inform("Invalid Radius", "The two points must not be identical.");
         return;
     }
-    canvas_->addCircle(center, r);
     pointCounter_ = canvas_->pointCount() + 1;
     if (recording_) {
-        recordedCommands_.append(QStringLiteral("addCircle:%1,%2|%3,%4")
-                                     .arg(center.x(), 0, 'f', 8)
-                                     .arg(center.y(), 0, 'f', 8)
-                                     .arg(edge.x(), 0, 'f', 8)
-                                     .arg(edge.y(), 0, 'f', 8));
+        macro_.addCircle(centerRef, edgeRef);
     }
 }
 
 void MainWindow::onDeleteClicked() {
-    QString recordedCmd;
-    if (recording_) {
-        QStringList fields;
-        auto pts = canvas_->selectedPointPositions();
-        if (!pts.isEmpty()) {
-            QStringList entries;
-            for (const auto &p : pts) entries.append(QStringLiteral("%1,%2").arg(p.x(), 0, 'f', 8).arg(p.y(), 0, 'f', 8));
-            fields.append(QStringLiteral("P=%1").arg(entries.join("|")));
-        }
-        auto lines = canvas_->selectedLineEndpoints();
-        if (!lines.isEmpty()) {
-            QStringList entries;
-            for (const auto &l : lines) entries.append(QStringLiteral("%1,%2|%3,%4")
-                                                           .arg(l.first.x(), 0, 'f', 8)
-                                                           .arg(l.first.y(), 0, 'f', 8)
-                                                           .arg(l.second.x(), 0, 'f', 8)
-                                                           .arg(l.second.y(), 0, 'f', 8));
-            fields.append(QStringLiteral("L=%1").arg(entries.join("#")));
-        }
-        auto ext = canvas_->selectedExtendedLineEndpoints();
-        if (!ext.isEmpty()) {
-            QStringList entries;
-            for (const auto &l : ext) entries.append(QStringLiteral("%1,%2|%3,%4")
-                                                         .arg(l.first.x(), 0, 'f', 8)
-                                                         .arg(l.first.y(), 0, 'f', 8)
-                                                         .arg(l.second.x(), 0, 'f', 8)
-                                                         .arg(l.second.y(), 0, 'f', 8));
-            fields.append(QStringLiteral("E=%1").arg(entries.join("#")));
-        }
-        auto circs = canvas_->selectedCircleData();
-        if (!circs.isEmpty()) {
-            QStringList entries;
-            for (const auto &c : circs) entries.append(QStringLiteral("%1,%2,%3")
-                                                           .arg(c.first.x(), 0, 'f', 8)
-                                                           .arg(c.first.y(), 0, 'f', 8)
-                                                           .arg(c.second, 0, 'f', 8));
-            fields.append(QStringLiteral("C=%1").arg(entries.join("#")));
-        }
-        recordedCmd = QStringLiteral("deleteSelected");
-        if (!fields.isEmpty()) {
-            recordedCmd += QStringLiteral(";%1").arg(fields.join(";"));
-        }
-    }
-
+    // The selection is captured first; it is gone once deleted.
+    const QVector<Macro::Ref> selection = recording_ ? selectedRefs() : QVector<Macro::Ref>();
     if (!canvas_->deleteSelected()) {
-        QMessageBox::information(this, "Delete", "No selected objects to delete.");
+        inform("Delete", "No selected objects to delete.");
         return;
     }
     pointCounter_ = canvas_->pointCount() + 1;
-    if (recording_ && !recordedCmd.isEmpty()) recordedCommands_.append(recordedCmd);
+    if (recording_) macro_.deleteObjects(selection);
 }
 
 void MainWindow::onDeleteAllClicked() {
     canvas_->deleteAll();
     pointCounter_ = canvas_->pointCount() + 1;
-    if (recording_) recordedCommands_.append(QStringLiteral("deleteAll"));
+    if (recording_) macro_.append(Macro::Opcode::DeleteAll);
 }
 
 void MainWindow::onOpenFileClicked() {
     QString startPath = canvas_->storageFilePath();
     QString initialDir = startPath.isEmpty() ? QDir::currentPath() : QFileInfo(startPath).absolutePath();
     QString filePath = QFileDialog::getOpenFileName(this, tr("Open Points File"), initialDir,
-                                                    tr("JSON Files (*.json);;All Files (*.*)"));
+                                                    tr("Scene Files (*.json *.vgb *.vgt *.vgz *.vgc);;JSON Files (*.json);;Binary Scene Files (*.vgb);;"
+                                                       "Tiled Scene Files (*.vgt);;Compressed Scene Files (*.vgz);;"
+                                                       "Chunked Scene Files (*.vgc);;All Files (*.*)"));
     if (filePath.isEmpty()) {
         return;
     }
-    if (!canvas_->loadFromFile(filePath)) {
+    auto recovery = CanvasWidget::JournalRecovery::Keep;
+    if (SceneJournal::hasRecoverableEdits(filePath)) {
+        const bool recover = QMessageBox::question(this, tr("Recover Changes"),
+                                                   tr("%1 has unsaved changes from an earlier session. Recover them?")
+                                                       .arg(QFileInfo(filePath).fileName()))
+                             == QMessageBox::Yes;
+        recovery = recover ? CanvasWidget::JournalRecovery::Recover : CanvasWidget::JournalRecovery::Discard;
+    }
+    // Large files take a while to parse; the dialog only appears if loading is slow.
+    QProgressDialog progress(tr("Loading %1...").arg(QFileInfo(filePath).fileName()), QString(), 0, 100, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+    connect(canvas_, &CanvasWidget::loadProgress, &progress, &QProgressDialog::setValue);
+    const bool loaded = canvas_->loadFromFile(filePath, recovery);
+    progress.reset();
+    if (!loaded) {
         QMessageBox::warning(this, tr("Open File"), tr("Could not open or parse the selected file."));
         return;
     }
     pointCounter_ = canvas_->pointCount() + 1;
-    if (recording_) recordedCommands_.append(QStringLiteral("open:%1").arg(filePath));
+    if (recording_) macro_.open(filePath);
 }
 
 void MainWindow::onSaveAsClicked() {
@@ -245,18 +263,71 @@ void MainWindow::onSaveAsClicked() {
     if (startPath.isEmpty()) {
         startPath = QDir::currentPath();
     }
+    const QString binaryFilter = tr("Binary Scene Files (*.vgb)");
+    const QString tiledFilter = tr("Tiled Scene Files (*.vgt)");
+    const QString compressedFilter = tr("Compressed Scene Files (*.vgz)");
+    const QString chunkedFilter = tr("Chunked Scene Files (*.vgc)");
+    const QString compactFilter = tr("Compact JSON Files (*.json)");
+    QString selectedFilter;
     QString filePath = QFileDialog::getSaveFileName(this, tr("Save Points As"), startPath,
-                                                    tr("JSON Files (*.json);;All Files (*.*)"));
+                                                    tr("JSON Files (*.json);;%1;;%2;;%3;;%4;;%5;;All Files (*.*)")
+                                                        .arg(compactFilter, binaryFilter, tiledFilter, compressedFilter, chunkedFilter),
+                                                    &selectedFilter);
     if (filePath.isEmpty()) {
         return;
     }
-    if (!filePath.endsWith(".json", Qt::CaseInsensitive)) {
-        filePath += ".json";
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    if (suffix != "json" && suffix != "vgb" && suffix != "vgt" && suffix != "vgz" && suffix != "vgc") {
+        if (selectedFilter == binaryFilter) {
+            filePath += ".vgb";
+        } else if (selectedFilter == tiledFilter) {
+            filePath += ".vgt";
+        } else if (selectedFilter == compressedFilter) {
+            filePath += ".vgz";
+        } else if (selectedFilter == chunkedFilter) {
+            filePath += ".vgc";
+        } else {
+            filePath += ".json";
+        }
     }
-    if (!canvas_->saveToFile(filePath)) {
+    // The save runs in the background on a snapshot of the current scene; onSaveFinished reports the outcome.
+    if (!canvas_->saveToFileAsync(filePath, selectedFilter == compactFilter)) {
         QMessageBox::warning(this, tr("Save File"), tr("Could not save to the selected location."));
-    } else if (recording_) {
-        recordedCommands_.append(QStringLiteral("save:%1").arg(filePath));
+        return;
+    }
+    statusBar()->showMessage(tr("Saving %1...").arg(QFileInfo(filePath).fileName()));
+}
+
+void MainWindow::onSaveFinished(const QString &path, bool ok) {
+    if (!ok) {
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, tr("Save File"), tr("Could not save to %1.").arg(QDir::toNativeSeparators(path)));
+        return;
+    }
+    statusBar()->showMessage(tr("Saved %1").arg(QFileInfo(path).fileName()), 3000);
+    // Only a save that reached the disk is recorded; a failed one would fail again on replay.
+    if (recording_) {
+        macro_.save(path);
+    }
+}
+
+void MainWindow::offerSessionRecovery() {
+    // Untitled scenes left by a crash or an unsaved exit; declining one discards it.
+    const QStringList sessions = SceneJournal::abandonedSessions();
+    for (const QString &session : sessions) {
+        const QDateTime changed = QFileInfo(SceneJournal::journalPath(session)).lastModified();
+        const bool recover = QMessageBox::question(this, tr("Recover Untitled Scene"),
+                                                   tr("An untitled scene from an earlier session has unsaved changes "
+                                                      "(last changed %1). Recover it?")
+                                                       .arg(QLocale().toString(changed, QLocale::ShortFormat)))
+                             == QMessageBox::Yes;
+        if (recover && canvas_->recoverSession(session)) {
+            pointCounter_ = canvas_->pointCount() + 1;
+            return;
+        }
+        if (!recover) {
+            SceneJournal::discard(session);
+        }
     }
 }
 
@@ -272,13 +343,16 @@ void MainWindow::onOpenMacroClicked() {
     }
     QStringList lines;
     while (!file.atEnd()) {
-        QString line = QString::fromUtf8(file.readLine()).trimmed();
-        if (!line.isEmpty()) {
-            lines.append(line);
-        }
+        lines.append(QString::fromUtf8(file.readLine()));
     }
     file.close();
-    recordedCommands_ = lines;
+    // Commands are parsed once here; playback only dispatches on the parsed form.
+    Macro macro;
+    const int rejected = macro.appendLines(lines);
+    macro_ = macro;
+    if (rejected > 0) {
+        statusBar()->showMessage(tr("Skipped %1 unrecognized macro lines").arg(rejected), 5000);
+    }
     lastScriptPath_ = filePath;
 }
 
@@ -293,7 +367,7 @@ void MainWindow::onSaveMacroClicked() {
         return;
     }
     QTextStream out(&file);
-    for (const auto &cmd : recordedCommands_) {
+    for (const auto &cmd : macro_.lines()) {
         out << cmd << "\n";
     }
     file.close();
@@ -307,11 +381,18 @@ void MainWindow::onRecordClicked() {
         recordBtn_->setIcon(style()->standardIcon(recording_ ? QStyle::SP_MediaStop : QStyle::SP_DialogYesButton));
     }
     if (recording_) {
-        recordedCommands_.clear();
+        macro_.clear();
+        // Playback renumbers the same way, so ids recorded from here on match on replay.
+        canvas_->renumberObjects();
     }
 }
 
 void MainWindow::onRunClicked() {
+    // While playback waits between commands, Run moves on to the next one.
+    if (playbackWait_) {
+        playbackWait_->quit();
+        return;
+    }
     if (recording_) {
         recording_ = false;
         if (recordBtn_) {
@@ -320,235 +401,109 @@ void MainWindow::onRunClicked() {
             recordBtn_->setIcon(style()->standardIcon(QStyle::SP_DialogYesButton));
         }
     }
-    if (recordedCommands_.isEmpty()) {
+    if (macro_.isEmpty()) {
         QMessageBox::information(this, tr("Run"), tr("No recorded commands to run."));
         return;
     }
 
-    // Prevent re-recording during playback
-    const bool wasRecording = recording_;
-    recording_ = false;
-    for (int i = 0; i < recordedCommands_.size(); ++i) {
-        const QString &cmd = recordedCommands_[i];
-        if (cmd == "extendLines") {
-            onExtendLineClicked();
-        } else if (cmd == "addCircle") {
-            onAddCircleClicked();
-        } else if (cmd.startsWith("deleteSelected")) {
-            canvas_->clearSelection();
-            QStringList parts = cmd.split(';');
-            if (parts.size() > 1) {
-                auto toPoint = [](const QString &s, bool &okOut) {
-                    const QStringList coords = s.split(',');
-                    bool ok1 = false, ok2 = false;
-                    double x = coords.value(0).toDouble(&ok1);
-                    double y = coords.value(1).toDouble(&ok2);
-                    okOut = ok1 && ok2;
-                    return QPointF(x, y);
-                };
-                for (int idx = 1; idx < parts.size(); ++idx) {
-                    const QString &field = parts[idx];
-                    if (field.startsWith("P=")) {
-                        const QStringList items = field.mid(2).split('|', Qt::SkipEmptyParts);
-                        for (const QString &it : items) {
-                            bool ok = false;
-                            QPointF p = toPoint(it, ok);
-                            if (ok) canvas_->selectPointByPosition(p, true);
-                        }
-                    } else if (field.startsWith("L=")) {
-                        const QStringList items = field.mid(2).split('#', Qt::SkipEmptyParts);
-                        for (const QString &it : items) {
-                            const QStringList pair = it.split('|');
-                            if (pair.size() == 2) {
-                                bool okA = false, okB = false;
-                                QPointF a = toPoint(pair[0], okA);
-                                QPointF b = toPoint(pair[1], okB);
-                                if (okA && okB) canvas_->selectLineByEndpoints(a, b, true);
-                            }
-                        }
-                    } else if (field.startsWith("E=")) {
-                        const QStringList items = field.mid(2).split('#', Qt::SkipEmptyParts);
-                        for (const QString &it : items) {
-                            const QStringList pair = it.split('|');
-                            if (pair.size() == 2) {
-                                bool okA = false, okB = false;
-                                QPointF a = toPoint(pair[0], okA);
-                                QPointF b = toPoint(pair[1], okB);
-                                if (okA && okB) canvas_->selectExtendedLineByEndpoints(a, b, true);
-                            }
-                        }
-                    } else if (field.startsWith("C=")) {
-                        const QStringList items = field.mid(2).split('#', Qt::SkipEmptyParts);
-                        for (const QString &it : items) {
-                            const QStringList partsC = it.split(',');
-                            if (partsC.size() == 3) {
-                                bool ok1 = false, ok2 = false, ok3 = false;
-                                double cx = partsC.value(0).toDouble(&ok1);
-                                double cy = partsC.value(1).toDouble(&ok2);
-                                double r = partsC.value(2).toDouble(&ok3);
-                                if (ok1 && ok2 && ok3) {
-                                    canvas_->selectCircleByCenterRadius(QPointF(cx, cy), r, true);
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            canvas_->deleteSelected();
-            pointCounter_ = canvas_->pointCount() + 1;
-        } else if (cmd == "deleteAll") {
-            onDeleteAllClicked();
-        } else if (cmd == "addNormal") {
-            onIntersectClicked();
-        } else if (cmd == "intersections") {
-            onIntersectionsClicked();
-        } else if (cmd.startsWith("addPoint:")) {
-            const QString coords = cmd.mid(QStringLiteral("addPoint:").size());
-            const QStringList parts = coords.split(',');
-            if (parts.size() == 2) {
-                bool okX = false, okY = false;
-                double x = parts[0].toDouble(&okX);
-                double y = parts[1].toDouble(&okY);
-                if (okX && okY) {
-                    canvas_->addPoint(QPointF(x, y), QString(), true);
-                    pointCounter_ = canvas_->pointCount() + 1;
-                }
-            }
-        } else if (cmd.startsWith("setLabel:")) {
-            const QString label = cmd.mid(QStringLiteral("setLabel:").size());
-            canvas_->setLabelForSelection(label);
-        } else if (cmd.startsWith("open:")) {
-            const QString path = cmd.mid(QStringLiteral("open:").size());
-            canvas_->loadFromFile(path);
-            pointCounter_ = canvas_->pointCount() + 1;
-        } else if (cmd.startsWith("save:")) {
-            const QString path = cmd.mid(QStringLiteral("save:").size());
-            canvas_->saveToFile(path);
-        } else if (cmd.startsWith("addNormal:")) {
-            const QString payload = cmd.mid(QStringLiteral("addNormal:").size());
-            const QStringList parts = payload.split(';');
-            if (parts.size() == 2) {
-                const QStringList lineParts = parts[0].split('|');
-                if (lineParts.size() == 2) {
-                    const auto toPt = [](const QString &s, bool &okOut) {
-                        const QStringList coords = s.split(',');
-                        bool ok1 = false, ok2 = false;
-                        double x = coords.value(0).toDouble(&ok1);
-                        double y = coords.value(1).toDouble(&ok2);
-                        okOut = ok1 && ok2;
-                        return QPointF(x, y);
-                    };
-                    bool okA = false, okB = false, okP = false;
-                    QPointF a = toPt(lineParts[0], okA);
-                    QPointF b = toPt(lineParts[1], okB);
-                    QPointF p = toPt(parts[1], okP);
-                    if (okA && okB && okP) {
-                        canvas_->clearSelection();
-                        bool selLine = canvas_->selectLineByEndpoints(a, b, false);
-                        bool selPoint = canvas_->selectPointByPosition(p, true);
-                        if (selLine && selPoint) {
-                            onIntersectClicked();
-                            pointCounter_ = canvas_->pointCount() + 1;
-                        }
-                    }
-                }
-            }
-        } else if (cmd.startsWith("addLine:")) {
-            const QString coords = cmd.mid(QStringLiteral("addLine:").size());
-            const QStringList pair = coords.split('|');
-            if (pair.size() == 2) {
-                const auto toPt = [](const QString &s, bool &okOut) {
-                    const QStringList parts = s.split(',');
-                    bool ok1 = false, ok2 = false;
-                    double x = parts.value(0).toDouble(&ok1);
-                    double y = parts.value(1).toDouble(&ok2);
-                    okOut = ok1 && ok2;
-                    return QPointF(x, y);
-                };
-                bool okA = false, okB = false;
-                QPointF a = toPt(pair[0], okA);
-                QPointF b = toPt(pair[1], okB);
-                if (okA && okB) {
-                    canvas_->clearSelection();
-                    bool selA = canvas_->selectPointByPosition(a, false);
-                    if (!selA) {
-                        canvas_->addPoint(a, QString(), false);
-                        selA = canvas_->selectPointByPosition(a, false);
-                    }
-                    bool selB = canvas_->selectPointByPosition(b, true);
-                    if (!selB) {
-                        canvas_->addPoint(b, QString(), true);
-                        selB = canvas_->selectPointByPosition(b, true);
-                    }
-                    if (selA && selB) {
-                        canvas_->addLineBetweenSelected();
-                        pointCounter_ = canvas_->pointCount() + 1;
-                    }
-                }
-            }
-        } else if (cmd.startsWith("addCircle:")) {
-            const QString coords = cmd.mid(QStringLiteral("addCircle:").size());
-            const QStringList pair = coords.split('|');
-            if (pair.size() == 2) {
-                const auto toPt = [](const QString &s, bool &okOut) {
-                    const QStringList parts = s.split(',');
-                    bool ok1 = false, ok2 = false;
-                    double x = parts.value(0).toDouble(&ok1);
-                    double y = parts.value(1).toDouble(&ok2);
-                    okOut = ok1 && ok2;
-                    return QPointF(x, y);
-                };
-                bool okA = false, okB = false;
-                QPointF a = toPt(pair[0], okA);
-                QPointF b = toPt(pair[1], okB);
-                if (okA && okB) {
-                    canvas_->clearSelection();
-                    bool selA = canvas_->selectPointByPosition(a, false);
-                    bool selB = canvas_->selectPointByPosition(b, true);
-                    if (selA && selB) {
-                        onAddCircleClicked();
-                        pointCounter_ = canvas_->pointCount() + 1;
-                    }
-                }
-            }
+    // The speed, the macro and the recording state stay as they are until playback ends.
+    const PlaybackSpeed speed = playbackSpeed_;
+    playbackStopped_ = false;
+    stopMacroAction_->setEnabled(true);
+    openMacroAction_->setEnabled(false);
+    recordBtn_->setEnabled(false);
+    if (speed == PlaybackSpeed::Step) {
+        runBtn_->setText(tr("Step"));
+    }
+    // Fast playback repaints once at the end.
+    const bool fastest = speed == PlaybackSpeed::Fastest;
+    if (fastest) {
+        canvas_->setUpdatesEnabled(false);
+    }
+    canvas_->renumberObjects();
+    QElapsedTimer playbackTimer;
+    playbackTimer.start();
+    int executed = 0;
+    int unchanged = 0;
+    for (int i = 0; i < macro_.size(); ++i) {
+        if (!waitForCommand(i, speed)) {
+            break;
         }
-        // 1s delay between commands during playback
-        if (i + 1 < recordedCommands_.size()) {
-            QEventLoop loop;
-            QTimer::singleShot(1000, &loop, &QEventLoop::quit);
-            loop.exec();
+        ++executed;
+        if (!runCommand(i)) {
+            ++unchanged;
         }
     }
-    recording_ = wasRecording;
+    if (fastest) {
+        canvas_->setUpdatesEnabled(true);
+        canvas_->update();
+    }
+    stopMacroAction_->setEnabled(false);
+    openMacroAction_->setEnabled(true);
+    recordBtn_->setEnabled(true);
+    runBtn_->setText(tr("Run"));
+    QString summary = tr("Ran %1 of %2 commands in %3 ms")
+                          .arg(executed)
+                          .arg(macro_.size())
+                          .arg(playbackTimer.elapsed());
+    if (unchanged > 0) {
+        summary += tr(", %1 changed nothing").arg(unchanged);
+    }
+    statusBar()->showMessage(summary, 5000);
+}
+
+// Holds playback before a command: one second between commands when timed,
+// until Run is pressed when stepping. False once playback has been stopped.
+bool MainWindow::waitForCommand(int index, PlaybackSpeed speed) {
+    if (playbackStopped_) {
+        return false;
+    }
+    if (speed == PlaybackSpeed::Fastest || (speed == PlaybackSpeed::Timed && index == 0)) {
+        return true;
+    }
+    QEventLoop loop;
+    playbackWait_ = &loop;
+    if (speed == PlaybackSpeed::Timed) {
+        QTimer::singleShot(1000, &loop, &QEventLoop::quit);
+    } else {
+        statusBar()->showMessage(tr("Step %1 of %2: %3").arg(index + 1).arg(macro_.size()).arg(macro_.line(index)));
+    }
+    loop.exec();
+    playbackWait_ = nullptr;
+    return !playbackStopped_;
+}
+
+// Plays one command through the canvas's SceneEditor, the same code the
+// batch tool runs; false when it changed nothing.
+bool MainWindow::runCommand(int index) {
+    const bool changed = canvas_->runCommand(macro_, index);
+    pointCounter_ = canvas_->pointCount() + 1;
+    return changed;
+}
+
+void MainWindow::inform(const QString &title, const QString &text) {
+    QMessageBox::information(this, title, text);
 }
 
 void MainWindow::onIntersectClicked() {
     if (canvas_->selectedLineCount() != 1 || canvas_->selectedCount() != 1) {
-        QMessageBox::information(this, "Select Line and Point", "Select exactly one line and one point.");
+        inform("Select Line and Point", "Select exactly one line and one point.");
         return;
     }
     int lineIdx = canvas_->selectedLineIndex();
     int pointIdx = canvas_->selectedIndices().first();
     if (lineIdx < 0 || pointIdx < 0) {
-        QMessageBox::information(this, "Selection", "Invalid selection.");
+        inform("Selection", "Invalid selection.");
         return;
     }
-    QPointF p = canvas_->pointAt(pointIdx);
-    if (!canvas_->addNormalAtPoint(lineIdx, p)) {
-        QMessageBox::information(this, "Intersect", "Could not add normal line.");
+    const Macro::Ref lineRef = objectRef(ObjectIds::Line, lineIdx);
+    const Macro::Ref pointRef = objectRef(ObjectIds::Point, pointIdx);
+    if (!canvas_->addNormalFromSelected()) {
+        inform("Intersect", "Could not add normal line.");
     } else {
         pointCounter_ = canvas_->pointCount() + 1;
         if (recording_) {
-            QPointF a, b;
-            if (canvas_->lineEndpointsAt(lineIdx, a, b)) {
-                recordedCommands_.append(QStringLiteral("addNormal:%1,%2|%3,%4;%5,%6")
-                                             .arg(a.x(), 0, 'f', 8)
-                                             .arg(a.y(), 0, 'f', 8)
-                                             .arg(b.x(), 0, 'f', 8)
-                                             .arg(b.y(), 0, 'f', 8)
-                                             .arg(p.x(), 0, 'f', 8)
-                                             .arg(p.y(), 0, 'f', 8));
-            }
+            macro_.addNormal(lineRef, pointRef);
         }
     }
 }
@@ -556,29 +511,47 @@ void MainWindow::onIntersectClicked() {
 void MainWindow::onIntersectionsClicked() {
     canvas_->recomputeSelectedIntersections();
     pointCounter_ = canvas_->pointCount() + 1;
-    if (recording_) recordedCommands_.append(QStringLiteral("intersections"));
+    if (recording_) macro_.append(Macro::Opcode::Intersections);
 }
 
 void MainWindow::onEditLabelClicked() {
     int totalSelections = canvas_->selectedCount() + canvas_->selectedLineCount() +
                           canvas_->selectedExtendedLineCount() + canvas_->selectedCircleCount();
     if (totalSelections != 1) {
-        QMessageBox::information(this, "Label", "Select exactly one item to edit its label.");
+        inform("Label", "Select exactly one item to edit its label.");
         return;
     }
     bool ok = false;
     QString text = QInputDialog::getText(this, "Edit Label", "Label:", QLineEdit::Normal, QString(), &ok);
     if (!ok) return;
+    const QVector<Macro::Ref> target = selectedRefs();
     if (!canvas_->setLabelForSelection(text)) {
-        QMessageBox::information(this, "Label", "Could not update the label.");
-    } else if (recording_) {
-        recordedCommands_.append(QStringLiteral("setLabel:%1").arg(text));
+        inform("Label", "Could not update the label.");
+    } else if (recording_ && target.size() == 1) {
+        macro_.setLabel(target.first(), text);
     }
 }
 
 void MainWindow::onPointAdded(const QPointF &pt) {
     if (!recording_) return;
-    recordedCommands_.append(QStringLiteral("addPoint:%1,%2").arg(pt.x(), 0, 'f', 8).arg(pt.y(), 0, 'f', 8));
+    macro_.addPoint(pt);
+}
+
+void MainWindow::onPointMoved(quint32 id, const QPointF &, const QPointF &to) {
+    if (!recording_) return;
+    macro_.movePoint(Macro::Ref{ObjectIds::Point, id}, to);
+}
+
+Macro::Ref MainWindow::objectRef(ObjectIds::Kind kind, int index) const {
+    return Macro::Ref{kind, canvas_->objectId(kind, index)};
+}
+
+QVector<Macro::Ref> MainWindow::selectedRefs() const {
+    QVector<Macro::Ref> refs;
+    for (ObjectIds::Kind kind : {ObjectIds::Point, ObjectIds::Line, ObjectIds::ExtendedLine, ObjectIds::Circle}) {
+        for (quint32 id : canvas_->selectedObjectIds(kind)) refs.append(Macro::Ref{kind, id});
+    }
+    return refs;
 }
 
 void MainWindow::onPrintClicked() {
@@ -599,3 +572,37 @@ void MainWindow::onPrintClicked() {
         canvas_->render(&painter);
     }
 }
+
+void MainWindow::onExportImageClicked() {
+    QString initial = canvas_->storageFilePath().isEmpty() ? QDir::currentPath() : QFileInfo(canvas_->storageFilePath()).absolutePath();
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Export Image"), initial,
+                                                    tr("PNG Images (*.png);;All Files (*.*)"));
+    if (filePath.isEmpty()) return;
+    if (!filePath.endsWith(".png", Qt::CaseInsensitive)) {
+        filePath += ".png";
+    }
+    bool ok = false;
+    int scale = QInputDialog::getInt(this, tr("Export Image"), tr("Scale factor:"), 4, 1, 16, 1, &ok);
+    if (!ok) return;
+    // Rendering at a device pixel ratio keeps pens and labels proportional to the on-screen view.
+    QImage image = canvas_->renderToImage(canvas_->size(), scale);
+    image.setDevicePixelRatio(1.0);
+    if (!image.save(filePath, "PNG")) {
+        QMessageBox::warning(this, tr("Export Image"), tr("Could not write the image file."));
+    }
+}
+
+void MainWindow::onExportLatencyClicked() {
+    QString initial = canvas_->storageFilePath().isEmpty() ? QDir::currentPath() : QFileInfo(canvas_->storageFilePath()).absolutePath();
+    QString filePath = QFileDialog::getSaveFileName(this, tr("Export Input Latency"), initial,
+                                                    tr("CSV Files (*.csv);;All Files (*.*)"));
+    if (filePath.isEmpty()) return;
+    if (!filePath.endsWith(".csv", Qt::CaseInsensitive)) {
+        filePath += ".csv";
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) ||
+        file.write(canvas_->inputLatencyReport().toUtf8()) < 0) {
+        QMessageBox::warning(this, tr("Export Input Latency"), tr("Could not write the latency file."));
+    }
+}
@@ -3,7 +3,11 @@
 #include <QMainWindow>
 #include <QPointF>
 
+#include "macro.h"
+
 class CanvasWidget;
+class QAction;
+class QEventLoop;
 class QPushButton;
 
 class MainWindow : public QMainWindow {
@@ -14,13 +18,22 @@ public:
     ~MainWindow() override = default;
 
 private:
+    // How a macro is replayed: one command per second, all at once with a
+    // single repaint at the end, or one command per press of Run.
+    enum class PlaybackSpeed { Timed, Fastest, Step };
+
     CanvasWidget *canvas_ = nullptr;
     int pointCounter_ = 1;
     bool recording_ = false;
     QPushButton *recordBtn_ = nullptr;
     QPushButton *runBtn_ = nullptr;
     QString lastScriptPath_;
-    QStringList recordedCommands_;
+    Macro macro_;
+    PlaybackSpeed playbackSpeed_ = PlaybackSpeed::Timed;
+    QAction *openMacroAction_ = nullptr;
+    QAction *stopMacroAction_ = nullptr;
+    QEventLoop *playbackWait_ = nullptr;
+    bool playbackStopped_ = false;
     void onAddLineClicked();
     void onExtendLineClicked();
     void onAddCircleClicked();
@@ -31,10 +44,20 @@ private:
     void onDeleteAllClicked();
     void onOpenFileClicked();
     void onSaveAsClicked();
+    void onSaveFinished(const QString &path, bool ok);
+    void offerSessionRecovery();
     void onRecordClicked();
     void onRunClicked();
+    bool waitForCommand(int index, PlaybackSpeed speed);
+    bool runCommand(int index);
+    void inform(const QString &title, const QString &text);
     void onOpenMacroClicked();
     void onSaveMacroClicked();
     void onPointAdded(const QPointF &pt);
+    void onPointMoved(quint32 id, const QPointF &from, const QPointF &to);
+    Macro::Ref objectRef(ObjectIds::Kind kind, int index) const;
+    QVector<Macro::Ref> selectedRefs() const;
     void onPrintClicked();
+    void onExportImageClicked();
+    void onExportLatencyClicked();
 };
@@ -0,0 +1,74 @@
+#include "objectids.h"
+
+#include <algorithm>
+
+void ObjectIds::reset(int points, int lines, int extendedLines, int circles) {
+    const int counts[KindCount] = {points, lines, extendedLines, circles};
+    for (int kind = 0; kind < KindCount; ++kind) {
+        ids[kind].resize(counts[kind]);
+        for (int i = 0; i < counts[kind]; ++i) ids[kind][i] = quint32(i);
+        next[kind] = quint32(counts[kind]);
+        slots[kind].clear();
+        slotsValid[kind] = false;
+    }
+}
+
+void ObjectIds::assign(Kind kind, const QVector<quint32> &assigned) {
+    ids[kind] = assigned;
+    next[kind] = assigned.isEmpty() ? 0 : *std::max_element(assigned.begin(), assigned.end()) + 1;
+    slots[kind].clear();
+    slotsValid[kind] = false;
+}
+
+quint32 ObjectIds::append(Kind kind) {
+    const quint32 id = next[kind]++;
+    if (slotsValid[kind]) {
+        slots[kind].insert(id, ids[kind].size());
+    }
+    ids[kind].append(id);
+    return id;
+}
+
+void ObjectIds::remove(Kind kind, const QVector<int> &indices) {
+    if (indices.isEmpty()) {
+        return;
+    }
+    QVector<quint32> kept;
+    kept.reserve(ids[kind].size() - indices.size());
+    int r = 0;
+    for (int i = 0; i < ids[kind].size(); ++i) {
+        if (r < indices.size() && indices[r] == i) {
+            ++r;
+            continue;
+        }
+        kept.append(ids[kind][i]);
+    }
+    ids[kind].swap(kept);
+    slots[kind].clear();
+    slotsValid[kind] = false;
+}
+
+void ObjectIds::clear(Kind kind) {
+    ids[kind].clear();
+    slots[kind].clear();
+    slotsValid[kind] = false;
+}
+
+quint32 ObjectIds::id(Kind kind, int index) const {
+    return index >= 0 && index < ids[kind].size() ? ids[kind][index] : ~quint32(0);
+}
+
+int ObjectIds::indexOf(Kind kind, quint32 id) const {
+    const QVector<quint32> &list = ids[kind];
+    // Nothing before the object was removed yet, so its index is its id.
+    if (id < quint32(list.size()) && list[int(id)] == id) {
+        return int(id);
+    }
+    if (!slotsValid[kind]) {
+        slots[kind].clear();
+        slots[kind].reserve(list.size());
+        for (int i = 0; i < list.size(); ++i) slots[kind].insert(list[i], i);
+        slotsValid[kind] = true;
+    }
+    return slots[kind].value(id, -1);
+}
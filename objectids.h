@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QHash>
+#include <QVector>
+#include <QtGlobal>
+
+// Stable creation-order ids for scene objects, one sequence per kind. An
+// object keeps its id while objects before it are removed and ids are never
+// handed out twice, so a recorded reference finds the same object later.
+// Kinds follow the Scene containers: points, lines, extended lines, circles.
+class ObjectIds {
+public:
+    enum Kind { Point, Line, ExtendedLine, Circle, KindCount };
+
+    // Numbers every object by its index, as in a freshly loaded scene.
+    void reset(int points, int lines, int extendedLines, int circles);
+    // Takes ids chosen elsewhere, e.g. scene-wide indices of paged-in objects.
+    void assign(Kind kind, const QVector<quint32> &ids);
+    quint32 append(Kind kind);
+    // indices must be ascending.
+    void remove(Kind kind, const QVector<int> &indices);
+    void clear(Kind kind);
+
+    quint32 id(Kind kind, int index) const;
+    // Index of the object with id, or -1 once it is gone.
+    int indexOf(Kind kind, quint32 id) const;
+
+private:
+    QVector<quint32> ids[KindCount];
+    quint32 next[KindCount] = {0, 0, 0, 0};
+    // Built on the first lookup whose id is not also its index.
+    mutable QHash<quint32, int> slots[KindCount];
+    mutable bool slotsValid[KindCount] = {false, false, false, false};
+};
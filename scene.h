@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+// Plain geometry store shared by the canvas and the scene file formats. Lines
+// refer to points by index; extended lines and circles carry their own
+// coordinates. The containers are implicitly shared, so copying a Scene is
+// cheap until one of the copies is modified.
+struct Scene {
+    struct Object {
+        QString label;
+        explicit Object(const QString &label = QString()) : label(label) {}
+        virtual ~Object() = default;
+    };
+    struct Point : public Object {
+        QPointF positiom;
+        Point() = default;
+        Point(const QPointF &point, const QString &label) : Object(label), positiom(point) {}
+    };
+    struct Line : public Object {
+        int a = -1;
+        int b = -1;
+        Line() = default;
+        Line(int a, int b, const QString &label) : Object(label), a(a), b(b) {}
+    };
+    struct ExtendedLine : public Object {
+        QPointF a;
+        QPointF b;
+        ExtendedLine() = default;
+        ExtendedLine(const QPointF &a, const QPointF &b, const QString &label) : Object(label), a(a), b(b) {}
+    };
+    struct Circle : public Object {
+        QPointF center;
+        double radius = 0.0;
+        Circle() = default;
+        Circle(const QPointF &center, double radius, const QString &label = QString()) : Object(label), center(center), radius(radius) {}
+    };
+
+    QVector<Point> points;
+    QVector<Line> lines;
+    QVector<ExtendedLine> extendedLines;
+    QVector<Circle> circles;
+
+    void clear() {
+        points.clear();
+        lines.clear();
+        extendedLines.clear();
+        circles.clear();
+    }
+};
@@ -0,0 +1,96 @@
+#include "scenecache.h"
+
+#include <QDataStream>
+#include <cstring>
+
+#include "intersectioncache.h"
+#include "spatialindex.h"
+
+namespace {
+const char magic[8] = {'V', 'G', 'C', 'A', 'C', 'H', 'E', '1'};
+
+// Folds 64-bit words into a running hash; the finalizer is splitmix64's.
+class GeometryHasher {
+public:
+    void add(quint64 word) {
+        state = (state ^ word) * 0x100000001b3ULL;
+        state ^= state >> 29;
+    }
+    void add(double value) {
+        // Both zeros compare equal and build the same index.
+        if (value == 0.0) value = 0.0;
+        quint64 bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        add(bits);
+    }
+    void add(const QPointF &point) {
+        add(point.x());
+        add(point.y());
+    }
+    quint64 result() const {
+        quint64 z = state + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        return z ? z : 1;
+    }
+
+private:
+    quint64 state = 0xcbf29ce484222325ULL;
+};
+}  // namespace
+
+quint64 SceneCache::geometryHash(const Scene &scene) {
+    GeometryHasher hasher;
+    hasher.add(quint64(scene.points.size()));
+    hasher.add(quint64(scene.lines.size()));
+    hasher.add(quint64(scene.extendedLines.size()));
+    hasher.add(quint64(scene.circles.size()));
+    for (const auto &p : scene.points) hasher.add(p.positiom);
+    for (const auto &l : scene.lines) hasher.add((quint64(quint32(l.a)) << 32) | quint32(l.b));
+    for (const auto &l : scene.extendedLines) {
+        hasher.add(l.a);
+        hasher.add(l.b);
+    }
+    for (const auto &c : scene.circles) {
+        hasher.add(c.center);
+        hasher.add(c.radius);
+    }
+    return hasher.result();
+}
+
+QByteArray SceneCache::encode(quint64 hash, const SpatialIndex &index, const IntersectionCache &intersections) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(magic, sizeof(magic));
+    out << version << hash;
+    index.save(out);
+    intersections.save(out);
+    return data;
+}
+
+bool SceneCache::decode(const QByteArray &data, quint64 expectedHash, SpatialIndex &index, IntersectionCache &intersections) {
+    if (data.size() < int(sizeof(magic)) || std::memcmp(data.constData(), magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_0);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.skipRawData(sizeof(magic));
+    quint32 storedVersion = 0;
+    quint64 hash = 0;
+    in >> storedVersion >> hash;
+    if (in.status() != QDataStream::Ok || storedVersion != version || hash != expectedHash) {
+        return false;
+    }
+    SpatialIndex loadedIndex;
+    IntersectionCache loadedIntersections;
+    if (!loadedIndex.load(in) || !loadedIntersections.load(in) || !in.atEnd()) {
+        return false;
+    }
+    index = loadedIndex;
+    intersections = loadedIntersections;
+    return true;
+}
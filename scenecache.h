@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include "scene.h"
+
+class IntersectionCache;
+class SpatialIndex;
+
+// Derived data saved alongside a scene so a load can skip rebuilding it: the
+// pick index and the pair-intersection cache. Both are tagged with a hash of
+// the geometry they were built from, and are only adopted when the loaded
+// scene hashes the same. Labels do not affect either, so they are left out of
+// the hash.
+class SceneCache {
+public:
+    static constexpr quint32 version = 1;
+
+    // Stable across runs and platforms; zero is never returned.
+    static quint64 geometryHash(const Scene &scene);
+    static QByteArray encode(quint64 hash, const SpatialIndex &index, const IntersectionCache &intersections);
+    // False, leaving the outputs alone, unless data is intact and was built for expectedHash.
+    static bool decode(const QByteArray &data, quint64 expectedHash, SpatialIndex &index, IntersectionCache &intersections);
+};
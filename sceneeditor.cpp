@@ -0,0 +1,575 @@
+#include "sceneeditor.h"
+
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "geometry.h"
+#include "intersectioncache.h"
+
+void SceneEditor::setScene(Scene &&scene) {
+    ObjectIds fresh;
+    fresh.reset(scene.points.size(), scene.lines.size(), scene.extendedLines.size(), scene.circles.size());
+    setScene(std::move(scene), fresh);
+}
+
+void SceneEditor::setScene(Scene &&scene, const ObjectIds &sceneIds) {
+    clearSelection();
+    current = std::move(scene);
+    ids = sceneIds;
+    if (observer) observer->sceneReplaced();
+}
+
+void SceneEditor::renumberObjects() {
+    ids.reset(current.points.size(), current.lines.size(), current.extendedLines.size(), current.circles.size());
+}
+
+bool SceneEditor::open(const QString &path) {
+    Scene scene;
+    if (!SceneFile::read(path, scene)) {
+        return false;
+    }
+    setScene(std::move(scene));
+    return true;
+}
+
+bool SceneEditor::save(const QString &path, const SceneFile::WriteOptions &options) const {
+    return SceneFile::write(path, current, options);
+}
+
+bool SceneEditor::hasPoint(const QPointF &point) const {
+    for (const auto &p : current.points) {
+        if (qFuzzyCompare(p.positiom.x(), point.x()) && qFuzzyCompare(p.positiom.y(), point.y())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SceneEditor::addPoint(const QPointF &point, const QString &label, bool selectNew) {
+    if (hasPoint(point)) {
+        return false;
+    }
+    current.points.append(Scene::Point(point, label));
+    ids.append(ObjectIds::Point);
+    if (observer) observer->objectAdded(ObjectIds::Point, current.points.size() - 1);
+    if (selectNew) {
+        select(ObjectIds::Point, current.points.size() - 1);
+    }
+    return true;
+}
+
+bool SceneEditor::addIntersectionPoint(const QPointF &point) {
+    return addPoint(point);
+}
+
+bool SceneEditor::movePoint(int index, const QPointF &position) {
+    if (index < 0 || index >= current.points.size()) {
+        return false;
+    }
+    if (current.points[index].positiom == position) {
+        return true;
+    }
+    if (observer) observer->positionAboutToChange(index);
+    current.points[index].positiom = position;
+    if (observer) observer->positionChanged(index);
+    return true;
+}
+
+bool SceneEditor::addLineBetweenSelected(const QString &label) {
+    if (selected[ObjectIds::Point].size() < 2) {
+        return false;
+    }
+    QList<int> indices = selected[ObjectIds::Point].values();
+    std::sort(indices.begin(), indices.end());
+    const int a = indices[0];
+    const int b = indices[1];
+    for (const auto &line : current.lines) {
+        if ((line.a == a && line.b == b) || (line.a == b && line.b == a)) {
+            return false;
+        }
+    }
+    current.lines.append(Scene::Line(a, b, label));
+    ids.append(ObjectIds::Line);
+    if (observer) observer->objectAdded(ObjectIds::Line, current.lines.size() - 1);
+    return true;
+}
+
+bool SceneEditor::extendSelectedLines() {
+    QList<int> extend = selected[ObjectIds::Line].values();
+    std::sort(extend.begin(), extend.end());
+    extend.erase(std::remove_if(extend.begin(), extend.end(),
+                                [this](int idx) { return idx < 0 || idx >= current.lines.size(); }),
+                 extend.end());
+    if (extend.isEmpty()) {
+        return false;
+    }
+    const QRectF box = Geometry::extensionBounds(current.points, current.circles);
+    for (int idx : extend) {
+        const Scene::Line &line = current.lines[idx];
+        const auto [a, b] =
+            Geometry::extendAcross(current.points[line.a].positiom, current.points[line.b].positiom, box);
+        current.extendedLines.append(Scene::ExtendedLine(a, b, line.label));
+        ids.append(ObjectIds::ExtendedLine);
+        if (observer) observer->objectAdded(ObjectIds::ExtendedLine, current.extendedLines.size() - 1);
+    }
+    // The extended lines replace the originals.
+    QVector<int> removed[ObjectIds::KindCount];
+    removed[ObjectIds::Line] = QVector<int>(extend.begin(), extend.end());
+    selected[ObjectIds::Line].clear();
+    for (int i = extend.size() - 1; i >= 0; --i) {
+        current.lines.removeAt(extend[i]);
+    }
+    ids.remove(ObjectIds::Line, removed[ObjectIds::Line]);
+    if (observer) observer->objectsRemoved(removed);
+    return true;
+}
+
+bool SceneEditor::addCircleFromSelected() {
+    if (selected[ObjectIds::Point].size() != 2) {
+        return false;
+    }
+    QList<int> indices = pointOrder;
+    if (indices.size() != 2) {
+        indices = selected[ObjectIds::Point].values();
+        std::sort(indices.begin(), indices.end());
+    }
+    const QPointF center = current.points[indices[0]].positiom;
+    const QPointF edge = current.points[indices[1]].positiom;
+    return addCircle(center, std::hypot(center.x() - edge.x(), center.y() - edge.y()));
+}
+
+bool SceneEditor::addCircle(const QPointF &center, double radius) {
+    if (radius <= 0.0) {
+        return false;
+    }
+    current.circles.append(Scene::Circle(center, radius));
+    ids.append(ObjectIds::Circle);
+    if (observer) observer->objectAdded(ObjectIds::Circle, current.circles.size() - 1);
+    return true;
+}
+
+bool SceneEditor::addNormalFromSelected() {
+    if (selected[ObjectIds::Line].size() != 1 || selected[ObjectIds::Point].size() != 1) {
+        return false;
+    }
+    const int pointIndex = *selected[ObjectIds::Point].constBegin();
+    if (pointIndex < 0 || pointIndex >= current.points.size()) {
+        return false;
+    }
+    return addNormalAtPoint(*selected[ObjectIds::Line].constBegin(), current.points[pointIndex].positiom);
+}
+
+bool SceneEditor::addNormalAtPoint(int lineIndex, const QPointF &point) {
+    if (lineIndex < 0 || lineIndex >= current.lines.size()) {
+        return false;
+    }
+    const auto [p1, p2] = segment(ObjectIds::Line, lineIndex);
+    QPointF a, b;
+    if (!Geometry::normalThrough(p1, p2, point, Geometry::extensionBounds(current.points, current.circles), a, b)) {
+        return false;
+    }
+    current.extendedLines.append(Scene::ExtendedLine(a, b, QString()));
+    ids.append(ObjectIds::ExtendedLine);
+    if (observer) observer->objectAdded(ObjectIds::ExtendedLine, current.extendedLines.size() - 1);
+    return true;
+}
+
+bool SceneEditor::deleteSelected() {
+    const QSet<int> &removePoints = selected[ObjectIds::Point];
+    QVector<int> indexMap(current.points.size(), -1);
+    QVector<Scene::Point> newPoints;
+    for (int i = 0; i < current.points.size(); ++i) {
+        if (removePoints.contains(i)) continue;
+        indexMap[i] = newPoints.size();
+        newPoints.append(current.points[i]);
+    }
+
+    // Lines go with either endpoint; the rest keep their place under new endpoint indices.
+    QVector<int> removed[ObjectIds::KindCount];
+    QVector<Scene::Line> newLines;
+    for (int i = 0; i < current.lines.size(); ++i) {
+        const auto &line = current.lines[i];
+        const bool valid = line.a >= 0 && line.b >= 0 && line.a < indexMap.size() && line.b < indexMap.size();
+        if (selected[ObjectIds::Line].contains(i) || !valid || indexMap[line.a] < 0 || indexMap[line.b] < 0) {
+            removed[ObjectIds::Line].append(i);
+            continue;
+        }
+        newLines.append(Scene::Line(indexMap[line.a], indexMap[line.b], line.label));
+    }
+    QVector<Scene::ExtendedLine> newExtended;
+    for (int i = 0; i < current.extendedLines.size(); ++i) {
+        if (selected[ObjectIds::ExtendedLine].contains(i)) {
+            removed[ObjectIds::ExtendedLine].append(i);
+            continue;
+        }
+        newExtended.append(current.extendedLines[i]);
+    }
+    QVector<Scene::Circle> newCircles;
+    for (int i = 0; i < current.circles.size(); ++i) {
+        if (selected[ObjectIds::Circle].contains(i)) {
+            removed[ObjectIds::Circle].append(i);
+            continue;
+        }
+        newCircles.append(current.circles[i]);
+    }
+
+    removed[ObjectIds::Point] = QVector<int>(removePoints.begin(), removePoints.end());
+    std::sort(removed[ObjectIds::Point].begin(), removed[ObjectIds::Point].end());
+    bool changed = false;
+    for (int kind = 0; kind < ObjectIds::KindCount; ++kind) {
+        changed = changed || !removed[kind].isEmpty();
+        ids.remove(ObjectIds::Kind(kind), removed[kind]);
+    }
+    if (!changed) {
+        return false;
+    }
+    clearSelection();
+    current.points.swap(newPoints);
+    current.lines.swap(newLines);
+    current.extendedLines.swap(newExtended);
+    current.circles.swap(newCircles);
+    if (observer) observer->objectsRemoved(removed);
+    return true;
+}
+
+void SceneEditor::deleteAll() {
+    if (current.points.isEmpty() && current.lines.isEmpty() && current.extendedLines.isEmpty() &&
+        current.circles.isEmpty()) {
+        return;
+    }
+    clearSelection();
+    current.clear();
+    for (int kind = 0; kind < ObjectIds::KindCount; ++kind) {
+        ids.clear(ObjectIds::Kind(kind));
+    }
+    if (observer) observer->sceneCleared();
+}
+
+bool SceneEditor::setLabelForSelection(const QString &label) {
+    if (selectionCount() != 1) {
+        return false;
+    }
+    for (int kind = 0; kind < ObjectIds::KindCount; ++kind) {
+        if (selected[kind].isEmpty()) continue;
+        const int idx = *selected[kind].constBegin();
+        switch (ObjectIds::Kind(kind)) {
+        case ObjectIds::Point:
+            if (idx < 0 || idx >= current.points.size()) return false;
+            current.points[idx].label = label;
+            break;
+        case ObjectIds::Line:
+            if (idx < 0 || idx >= current.lines.size()) return false;
+            current.lines[idx].label = label;
+            break;
+        case ObjectIds::ExtendedLine:
+            if (idx < 0 || idx >= current.extendedLines.size()) return false;
+            current.extendedLines[idx].label = label;
+            break;
+        default:
+            if (idx < 0 || idx >= current.circles.size()) return false;
+            current.circles[idx].label = label;
+            break;
+        }
+        if (observer) observer->labelChanged(ObjectIds::Kind(kind), idx);
+    }
+    return true;
+}
+
+QPair<QPointF, QPointF> SceneEditor::segment(ObjectIds::Kind kind, int index) const {
+    if (kind == ObjectIds::Line) {
+        const auto &line = current.lines[index];
+        return {current.points[line.a].positiom, current.points[line.b].positiom};
+    }
+    return {current.extendedLines[index].a, current.extendedLines[index].b};
+}
+
+QVector<QPointF> SceneEditor::pairIntersections(ObjectIds::Kind kindA, int indexA, ObjectIds::Kind kindB, int indexB) const {
+    const quint64 keyA = IntersectionCache::objectKey(kindA, indexA);
+    const quint64 keyB = IntersectionCache::objectKey(kindB, indexB);
+    QVector<QPointF> hits;
+    if (cache && cache->lookup(keyA, keyB, hits)) {
+        return hits;
+    }
+    if (kindA == ObjectIds::Circle && kindB == ObjectIds::Circle) {
+        const auto &c0 = current.circles[indexA];
+        const auto &c1 = current.circles[indexB];
+        for (const auto &h : Geometry::circleCircleIntersections(c0.center, c0.radius, c1.center, c1.radius)) hits.append(h);
+    } else if (kindA == ObjectIds::Circle || kindB == ObjectIds::Circle) {
+        const bool circleFirst = kindA == ObjectIds::Circle;
+        const auto &c = current.circles[circleFirst ? indexA : indexB];
+        const auto [p1, p2] = circleFirst ? segment(kindB, indexB) : segment(kindA, indexA);
+        for (const auto &h : Geometry::segmentCircleIntersections(p1, p2, c.center, c.radius)) hits.append(h);
+    } else {
+        const auto [a1, a2] = segment(kindA, indexA);
+        const auto [b1, b2] = segment(kindB, indexB);
+        QPointF hit;
+        if (Geometry::segmentIntersection(a1, a2, b1, b2, hit)) hits.append(hit);
+    }
+    if (cache) cache->store(keyA, keyB, hits);
+    return hits;
+}
+
+bool SceneEditor::addSelectedIntersections() {
+    if (selectionCount() != 2) {
+        return false;
+    }
+    QVector<QPair<ObjectIds::Kind, int>> objects;
+    for (int kind = ObjectIds::Line; kind < ObjectIds::KindCount; ++kind) {
+        QList<int> indices = selected[kind].values();
+        std::sort(indices.begin(), indices.end());
+        for (int index : indices) objects.append({ObjectIds::Kind(kind), index});
+    }
+    bool added = false;
+    if (objects.size() == 2) {
+        for (const QPointF &h : pairIntersections(objects[0].first, objects[0].second, objects[1].first, objects[1].second)) {
+            added = addIntersectionPoint(h) || added;
+        }
+        return added;
+    }
+    // One point and one object: its foot on a line, or the point itself when it lies on a circle.
+    const int pointIndex = *selected[ObjectIds::Point].constBegin();
+    if (objects.size() != 1 || pointIndex < 0 || pointIndex >= current.points.size()) {
+        return false;
+    }
+    const QPointF pt = current.points[pointIndex].positiom;
+    if (objects[0].first == ObjectIds::Circle) {
+        const auto &c = current.circles[objects[0].second];
+        const double dist = std::hypot(pt.x() - c.center.x(), pt.y() - c.center.y());
+        return std::abs(dist - c.radius) < 1e-6 && addIntersectionPoint(pt);
+    }
+    const auto [p1, p2] = segment(objects[0].first, objects[0].second);
+    const QPointF d = p2 - p1;
+    const double len2 = d.x() * d.x() + d.y() * d.y();
+    if (len2 <= 1e-12) {
+        return false;
+    }
+    double t = ((pt.x() - p1.x()) * d.x() + (pt.y() - p1.y()) * d.y()) / len2;
+    if (objects[0].first == ObjectIds::Line) {
+        t = std::clamp(t, 0.0, 1.0);
+    }
+    return addIntersectionPoint(QPointF(p1.x() + t * d.x(), p1.y() + t * d.y()));
+}
+
+int SceneEditor::addAllIntersections() {
+    // Each unordered pair once, in the order the canvas first meets it, so new
+    // points get the same indices as an interactive recompute.
+    const int counts[ObjectIds::KindCount] = {0, int(current.lines.size()), int(current.extendedLines.size()),
+                                              int(current.circles.size())};
+    int added = 0;
+    for (int kindA = ObjectIds::Line; kindA < ObjectIds::KindCount; ++kindA) {
+        for (int i = 0; i < counts[kindA]; ++i) {
+            for (int kindB = kindA; kindB < ObjectIds::KindCount; ++kindB) {
+                for (int j = kindB == kindA ? i + 1 : 0; j < counts[kindB]; ++j) {
+                    for (const QPointF &h : pairIntersections(ObjectIds::Kind(kindA), i, ObjectIds::Kind(kindB), j)) {
+                        if (addIntersectionPoint(h)) ++added;
+                    }
+                }
+            }
+        }
+    }
+    return added;
+}
+
+void SceneEditor::clearSelection() {
+    if (observer && selectionCount() > 0) observer->selectionAboutToClear();
+    for (auto &set : selected) set.clear();
+    pointOrder.clear();
+}
+
+void SceneEditor::select(ObjectIds::Kind kind, int index) {
+    selected[kind].insert(index);
+    if (kind == ObjectIds::Point) {
+        pointOrder.removeAll(index);
+        pointOrder.append(index);
+    }
+    if (observer) observer->selectionChanged(kind, index);
+}
+
+void SceneEditor::deselect(ObjectIds::Kind kind, int index) {
+    if (!selected[kind].remove(index)) {
+        return;
+    }
+    if (kind == ObjectIds::Point) {
+        pointOrder.removeAll(index);
+    }
+    if (observer) observer->selectionChanged(kind, index);
+}
+
+int SceneEditor::selectionCount() const {
+    int count = 0;
+    for (const auto &set : selected) count += set.size();
+    return count;
+}
+
+bool SceneEditor::selectPointByPosition(const QPointF &pt, bool additive, double tol) {
+    if (!additive) {
+        clearSelection();
+    }
+    double bestDist = std::numeric_limits<double>::max();
+    int bestIdx = -1;
+    for (int i = 0; i < current.points.size(); ++i) {
+        const auto &p = current.points[i].positiom;
+        const double d = std::hypot(p.x() - pt.x(), p.y() - pt.y());
+        if (d <= tol && d < bestDist) {
+            bestDist = d;
+            bestIdx = i;
+        }
+    }
+    if (bestIdx < 0) {
+        // Retry with looser tolerance to tolerate minor rounding differences during playback.
+        return tol < 1e-3 && selectPointByPosition(pt, true, 1e-3);
+    }
+    select(ObjectIds::Point, bestIdx);
+    return true;
+}
+
+bool SceneEditor::selectLineByEndpoints(const QPointF &a, const QPointF &b, bool additive, double tol) {
+    if (!additive) {
+        clearSelection();
+    }
+    auto close = [tol](const QPointF &p, const QPointF &q) {
+        return std::hypot(p.x() - q.x(), p.y() - q.y()) <= tol;
+    };
+    for (int i = 0; i < current.lines.size(); ++i) {
+        const auto [p1, p2] = segment(ObjectIds::Line, i);
+        if ((close(p1, a) && close(p2, b)) || (close(p1, b) && close(p2, a))) {
+            select(ObjectIds::Line, i);
+            return true;
+        }
+    }
+    return tol < 1e-3 && selectLineByEndpoints(a, b, true, 1e-3);
+}
+
+bool SceneEditor::selectExtendedLineByEndpoints(const QPointF &a, const QPointF &b, bool additive, double tol) {
+    if (!additive) {
+        clearSelection();
+    }
+    auto close = [tol](const QPointF &p, const QPointF &q) {
+        return std::hypot(p.x() - q.x(), p.y() - q.y()) <= tol;
+    };
+    for (int i = 0; i < current.extendedLines.size(); ++i) {
+        const auto &line = current.extendedLines[i];
+        if ((close(line.a, a) && close(line.b, b)) || (close(line.a, b) && close(line.b, a))) {
+            select(ObjectIds::ExtendedLine, i);
+            return true;
+        }
+    }
+    return tol < 1e-3 && selectExtendedLineByEndpoints(a, b, true, 1e-3);
+}
+
+bool SceneEditor::selectCircleByCenterRadius(const QPointF &center, double radius, bool additive, double tol) {
+    if (!additive) {
+        clearSelection();
+    }
+    int bestIdx = -1;
+    double bestScore = std::numeric_limits<double>::max();
+    for (int i = 0; i < current.circles.size(); ++i) {
+        const auto &c = current.circles[i];
+        const double dc = std::hypot(c.center.x() - center.x(), c.center.y() - center.y());
+        const double dr = std::abs(c.radius - radius);
+        if (dc <= tol && dr <= tol && dc + dr < bestScore) {
+            bestScore = dc + dr;
+            bestIdx = i;
+        }
+    }
+    if (bestIdx < 0) {
+        return tol < 1e-3 && selectCircleByCenterRadius(center, radius, true, 1e-3);
+    }
+    select(ObjectIds::Circle, bestIdx);
+    return true;
+}
+
+bool SceneEditor::selectObject(ObjectIds::Kind kind, quint32 id, bool additive) {
+    if (!additive) {
+        clearSelection();
+    }
+    const int index = ids.indexOf(kind, id);
+    if (index < 0) {
+        return false;
+    }
+    select(kind, index);
+    return true;
+}
+
+bool SceneEditor::selectRefs(const QVector<Macro::Ref> &refs) {
+    clearSelection();
+    bool all = true;
+    for (const Macro::Ref &ref : refs) {
+        all = selectObject(ref.kind, ref.id, true) && all;
+    }
+    return all;
+}
+
+bool SceneEditor::run(const Macro &macro, int index) {
+    const double *args = macro.operands(index);
+    auto point = [args](int i) { return QPointF(args[i], args[i + 1]); };
+    switch (macro.at(index).opcode) {
+    case Macro::Opcode::ExtendLines:
+        return extendSelectedLines();
+    case Macro::Opcode::AddCircleSelected:
+        return addCircleFromSelected();
+    case Macro::Opcode::AddNormalSelected:
+        return addNormalFromSelected();
+    case Macro::Opcode::Intersections:
+        return addSelectedIntersections();
+    case Macro::Opcode::DeleteAll:
+        deleteAll();
+        return true;
+    case Macro::Opcode::DeleteSelected: {
+        const Macro::Selection selection = macro.selection(index);
+        clearSelection();
+        for (const auto &p : selection.points) selectPointByPosition(p, true);
+        for (const auto &l : selection.lines) selectLineByEndpoints(l.first, l.second, true);
+        for (const auto &l : selection.extendedLines) selectExtendedLineByEndpoints(l.first, l.second, true);
+        for (const auto &c : selection.circles) selectCircleByCenterRadius(c.first, c.second, true);
+        return deleteSelected();
+    }
+    case Macro::Opcode::AddPoint:
+        return addPoint(point(0), QString(), true);
+    case Macro::Opcode::SetLabel:
+        return setLabelForSelection(macro.string(index));
+    case Macro::Opcode::Open:
+        return open(macro.string(index));
+    case Macro::Opcode::Save: {
+        SceneFile::WriteOptions options;
+        options.format = SceneFile::formatForPath(macro.string(index));
+        return save(macro.string(index), options);
+    }
+    case Macro::Opcode::AddNormal:
+        return selectLineByEndpoints(point(0), point(2), false) && selectPointByPosition(point(4), true) &&
+               addNormalFromSelected();
+    case Macro::Opcode::AddLine: {
+        // Missing endpoints are created, as the recording canvas had them.
+        clearSelection();
+        if (!selectPointByPosition(point(0), false)) {
+            addPoint(point(0), QString(), true);
+        }
+        if (!selectPointByPosition(point(2), true)) {
+            addPoint(point(2), QString(), true);
+        }
+        return addLineBetweenSelected();
+    }
+    case Macro::Opcode::MovePoint:
+        clearSelection();
+        return selectPointByPosition(point(0), false) && movePoint(pointOrder.first(), point(2));
+    case Macro::Opcode::AddCircle:
+        return selectPointByPosition(point(0), false) && selectPointByPosition(point(2), true) && addCircleFromSelected();
+    case Macro::Opcode::AddLineById:
+        return selectRefs(macro.refs(index)) && addLineBetweenSelected();
+    case Macro::Opcode::AddCircleById:
+        return selectRefs(macro.refs(index)) && addCircleFromSelected();
+    case Macro::Opcode::AddNormalById:
+        return selectRefs(macro.refs(index)) && addNormalFromSelected();
+    case Macro::Opcode::MovePointById:
+        return movePoint(ids.indexOf(ObjectIds::Point, macro.refs(index).first().id), point(2));
+    case Macro::Opcode::DeleteById:
+        // Objects already gone, e.g. with a deleted endpoint, are simply skipped.
+        selectRefs(macro.refs(index));
+        return deleteSelected();
+    case Macro::Opcode::SetLabelById:
+        return selectRefs(macro.refs(index)) && setLabelForSelection(macro.string(index));
+    }
+    return false;
+}
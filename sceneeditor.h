@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QList>
+#include <QPointF>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "macro.h"
+#include "objectids.h"
+#include "scene.h"
+#include "scenefile.h"
+
+class IntersectionCache;
+
+// The construction commands over a Scene with its own selection and object
+// ids. The canvas makes every edit through one, keeping its views, journal and
+// caches in step as an Observer; on its own it plays a Macro headless.
+class SceneEditor {
+public:
+    // Told about each change as it is made. Indices are those after the
+    // change unless noted; the default implementations ignore it.
+    class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void objectAdded(ObjectIds::Kind, int) {}
+        virtual void positionAboutToChange(int) {}
+        virtual void positionChanged(int) {}
+        virtual void labelChanged(ObjectIds::Kind, int) {}
+        // Ascending indices from before the removal, per kind. Surviving lines
+        // already refer to the surviving points.
+        virtual void objectsRemoved(const QVector<int> (&)[ObjectIds::KindCount]) {}
+        virtual void sceneCleared() {}
+        // The whole scene was swapped for another; the selection is empty.
+        virtual void sceneReplaced() {}
+        // The object joined or left the selection.
+        virtual void selectionChanged(ObjectIds::Kind, int) {}
+        // Called while the selection still holds the objects being deselected.
+        virtual void selectionAboutToClear() {}
+    };
+
+    const Scene &scene() const { return current; }
+    // Takes a scene as if freshly loaded: ids renumbered, selection cleared.
+    void setScene(Scene &&scene);
+    // The same keeping ids chosen elsewhere, e.g. the scene-wide ones of the
+    // paged-in part of a scene.
+    void setScene(Scene &&scene, const ObjectIds &sceneIds);
+    bool open(const QString &path);
+    bool save(const QString &path, const SceneFile::WriteOptions &options) const;
+    void setObserver(Observer *newObserver) { observer = newObserver; }
+    // Pair intersections are memoized there when set; the owner invalidates it.
+    void setIntersectionCache(IntersectionCache *newCache) { cache = newCache; }
+    // Gives every object its index as id, as in a freshly loaded scene.
+    void renumberObjects();
+
+    const ObjectIds &objectIds() const { return ids; }
+    const QSet<int> &selection(ObjectIds::Kind kind) const { return selected[kind]; }
+    // Selected points in the order they were selected.
+    const QList<int> &pointSelectionOrder() const { return pointOrder; }
+
+    bool hasPoint(const QPointF &point) const;
+    bool addPoint(const QPointF &point, const QString &label = QString(), bool selectNew = false);
+    bool movePoint(int index, const QPointF &position);
+    // Between the two lowest selected points.
+    bool addLineBetweenSelected(const QString &label = QString());
+    bool extendSelectedLines();
+    bool addCircle(const QPointF &center, double radius);
+    // Normal to line lineIndex through point, across the extension box.
+    bool addNormalAtPoint(int lineIndex, const QPointF &point);
+    // Center and edge point are the two selected points in selection order.
+    bool addCircleFromSelected();
+    // Normal to the one selected line through the one selected point.
+    bool addNormalFromSelected();
+    bool deleteSelected();
+    // Does nothing to a scene that is already empty.
+    void deleteAll();
+    bool setLabelForSelection(const QString &label);
+    QVector<QPointF> pairIntersections(ObjectIds::Kind kindA, int indexA, ObjectIds::Kind kindB, int indexB) const;
+    // Points where the two selected objects meet; false if none was added.
+    bool addSelectedIntersections();
+    // Adds every missing intersection point of lines, extended lines and
+    // circles; returns how many points were added.
+    int addAllIntersections();
+
+    void clearSelection();
+    // A point also moves to the end of the selection order.
+    void select(ObjectIds::Kind kind, int index);
+    void deselect(ObjectIds::Kind kind, int index);
+    bool isSelected(ObjectIds::Kind kind, int index) const { return selected[kind].contains(index); }
+    bool selectPointByPosition(const QPointF &pt, bool additive, double tol = 1e-4);
+    bool selectLineByEndpoints(const QPointF &a, const QPointF &b, bool additive, double tol = 1e-4);
+    bool selectExtendedLineByEndpoints(const QPointF &a, const QPointF &b, bool additive, double tol = 1e-4);
+    bool selectCircleByCenterRadius(const QPointF &center, double radius, bool additive, double tol = 1e-4);
+    bool selectObject(ObjectIds::Kind kind, quint32 id, bool additive);
+
+    // Plays one command; false when it changed nothing. Open and Save read and
+    // write the file directly, so a front end with its own file handling
+    // plays those itself.
+    bool run(const Macro &macro, int index);
+
+private:
+    Scene current;
+    ObjectIds ids;
+    QSet<int> selected[ObjectIds::KindCount];
+    QList<int> pointOrder;
+    Observer *observer = nullptr;
+    IntersectionCache *cache = nullptr;
+
+    bool addIntersectionPoint(const QPointF &point);
+    QPair<QPointF, QPointF> segment(ObjectIds::Kind kind, int index) const;
+    bool selectRefs(const QVector<Macro::Ref> &refs);
+    int selectionCount() const;
+};
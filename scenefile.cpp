@@ -0,0 +1,119 @@
+#include "scenefile.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+
+#include "binaryscene.h"
+#include "compressedscene.h"
+#include "jsonscene.h"
+#include "tiledscene.h"
+
+SceneFile::Format SceneFile::formatForPath(const QString &path) {
+    if (path.endsWith(".vgb", Qt::CaseInsensitive)) {
+        return Format::Binary;
+    }
+    if (path.endsWith(".vgz", Qt::CaseInsensitive)) {
+        return Format::Compressed;
+    }
+    if (path.endsWith(".vgc", Qt::CaseInsensitive)) {
+        return Format::Chunked;
+    }
+    return path.endsWith(".vgt", Qt::CaseInsensitive) ? Format::Tiled : Format::Json;
+}
+
+bool SceneFile::read(const QString &path, Scene &scene, const ProgressFunction &progress, ReadInfo *info) {
+    if (path.isEmpty()) {
+        return false;
+    }
+    QFile file(path);
+    if (!file.exists()) {
+        return false;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (info) {
+        *info = ReadInfo();
+    }
+    const QByteArray head = file.peek(8);
+    if (BinaryScene::matches(head) || TiledScene::matches(head) || ChunkedScene::matches(head)) {
+        // Mapped columns load too quickly to need intermediate reports.
+        bool ok = false;
+        if (BinaryScene::matches(head)) {
+            ok = BinaryScene::read(file, scene, info ? &info->cache : nullptr);
+        } else if (ChunkedScene::matches(head)) {
+            ok = ChunkedScene::read(file, scene, info ? &info->generation : nullptr);
+        } else {
+            ok = TiledScene::read(file, scene);
+        }
+        if (ok && progress) {
+            progress(file.size(), file.size());
+        }
+        if (ok && dropDanglingLines(scene) && info) {
+            // Line indices moved, so neither the stored cache nor the chunks on disk match any more.
+            *info = ReadInfo();
+        }
+        return ok;
+    }
+    const bool ok = CompressedScene::matches(head) ? CompressedScene::read(file, scene, progress)
+                                                   : JsonSceneReader(progress).read(file, scene);
+    if (ok) {
+        dropDanglingLines(scene);
+    }
+    return ok;
+}
+
+bool SceneFile::dropDanglingLines(Scene &scene) {
+    const int pointCount = scene.points.size();
+    const auto dangling = [pointCount](const Scene::Line &line) {
+        return line.a < 0 || line.b < 0 || line.a >= pointCount || line.b >= pointCount;
+    };
+    const auto kept = std::remove_if(scene.lines.begin(), scene.lines.end(), dangling);
+    if (kept == scene.lines.end()) {
+        return false;
+    }
+    scene.lines.erase(kept, scene.lines.end());
+    return true;
+}
+
+bool SceneFile::write(const QString &path, const Scene &scene) {
+    WriteOptions options;
+    options.format = formatForPath(path);
+    return write(path, scene, options);
+}
+
+bool SceneFile::write(const QString &path, const Scene &scene, const WriteOptions &options) {
+    if (path.isEmpty()) {
+        return false;
+    }
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    // Updating in place keeps unchanged chunks where they are; a full write is the fallback.
+    if (options.format == Format::Chunked && options.baseGeneration != 0 &&
+        ChunkedScene::update(path, scene, options.changes, options.baseGeneration, options.generation)) {
+        return true;
+    }
+    // The scene is written to a temporary file that replaces the target only once complete.
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    bool ok = false;
+    if (options.format == Format::Binary) {
+        ok = BinaryScene::write(file, scene, options.cache);
+    } else if (options.format == Format::Tiled) {
+        ok = TiledScene::write(file, scene);
+    } else if (options.format == Format::Compressed) {
+        ok = CompressedScene::write(file, scene);
+    } else if (options.format == Format::Chunked) {
+        ok = ChunkedScene::write(file, scene, options.generation);
+    } else {
+        ok = JsonSceneWriter(file, options.compact).write(scene);
+    }
+    if (!ok) {
+        file.cancelWriting();
+    }
+    return file.commit() && ok;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+
+#include "chunkedscene.h"
+#include "scene.h"
+
+// Reads and writes scene files. JSON stays the interchange format; files
+// ending in .vgb use the binary format, .vgt the tiled one, .vgz the
+// compressed one and .vgc the chunked one. Reading detects the format from the
+// file contents, so a renamed file still opens. Writes replace the target
+// atomically, and only touch their arguments, so they may run on any thread.
+class SceneFile {
+public:
+    enum class Format { Json, Binary, Tiled, Compressed, Chunked };
+    using ProgressFunction = std::function<void(qint64 done, qint64 total)>;
+
+    struct WriteOptions {
+        Format format = Format::Json;
+        // JSON only: one line without indentation.
+        bool compact = false;
+        // Binary only: derived data stored after the scene (see SceneCache).
+        QByteArray cache;
+        // Chunked only: stamped into the file so a later save can tell it is unchanged on disk.
+        quint64 generation = 0;
+        // Chunked only: when the file already at the path still carries
+        // baseGeneration, just the chunks holding objects in changes are rewritten.
+        quint64 baseGeneration = 0;
+        ChunkedScene::Changes changes;
+    };
+
+    // What a read found besides the scene.
+    struct ReadInfo {
+        // Binary only: derived data stored after the scene.
+        QByteArray cache;
+        // Chunked only: the generation the file was written with.
+        quint64 generation = 0;
+    };
+
+    static Format formatForPath(const QString &path);
+    // Whatever the format, lines whose endpoints are not points of the scene are dropped.
+    static bool read(const QString &path, Scene &scene, const ProgressFunction &progress = ProgressFunction(),
+                     ReadInfo *info = nullptr);
+    // Drops lines with an endpoint outside the scene's points; true if any were.
+    static bool dropDanglingLines(Scene &scene);
+    static bool write(const QString &path, const Scene &scene);
+    static bool write(const QString &path, const Scene &scene, const WriteOptions &options);
+};
@@ -0,0 +1,30 @@
+#include "sceneformat.h"
+
+#include <QHash>
+#include <QString>
+
+namespace SceneFormat {
+
+Labels::Labels(const Scene &scene) : offsets{0, 0} {
+    QHash<QString, quint32> ids;
+    ids.insert(QString(), 0);
+    auto intern = [&](const QString &text) -> quint32 {
+        auto it = ids.constFind(text);
+        if (it != ids.constEnd()) return it.value();
+        const quint32 id = quint32(ids.size());
+        ids.insert(text, id);
+        data.append(text.toUtf8());
+        offsets.append(quint64(data.size()));
+        return id;
+    };
+    points.reserve(scene.points.size());
+    for (const auto &p : scene.points) points.append(intern(p.label));
+    lines.reserve(scene.lines.size());
+    for (const auto &l : scene.lines) lines.append(intern(l.label));
+    extendedLines.reserve(scene.extendedLines.size());
+    for (const auto &l : scene.extendedLines) extendedLines.append(intern(l.label));
+    circles.reserve(scene.circles.size());
+    for (const auto &c : scene.circles) circles.append(intern(c.label));
+}
+
+}  // namespace SceneFormat
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+#include <QtEndian>
+#include <QtGlobal>
+
+#include "scene.h"
+
+// Internal helpers shared by the binary scene formats: little-endian access
+// to mapped data and byte buffers, 8-byte alignment, and the label string
+// table. Not part of any format's interface.
+namespace SceneFormat {
+
+inline quint64 align8(quint64 offset) {
+    return (offset + 7) & ~quint64(7);
+}
+
+// The i-th T from base + offset.
+template <typename T>
+T at(const uchar *base, quint64 offset, quint64 i = 0) {
+    return qFromLittleEndian<T>(base + offset + i * sizeof(T));
+}
+
+template <typename T>
+void put(QByteArray &out, T value) {
+    const T le = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char *>(&le), sizeof(T));
+}
+
+inline void padTo8(QByteArray &out) {
+    out.append(QByteArray(int(align8(quint64(out.size())) - quint64(out.size())), '\0'));
+}
+
+// A scene's labels interned into one string table: repeated labels share an
+// entry and entry 0 is the empty label. Entry i is the UTF-8 text from
+// offsets[i] to offsets[i + 1] in data.
+struct Labels {
+    explicit Labels(const Scene &scene);
+
+    int size() const { return offsets.size() - 1; }
+
+    // Entry of each object's label, per kind.
+    QVector<quint32> points, lines, extendedLines, circles;
+    QVector<quint64> offsets;
+    QByteArray data;
+};
+
+}  // namespace SceneFormat
@@ -0,0 +1,558 @@
+#include "scenejournal.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "chunkedscene.h"
+#include "scenefile.h"
+
+namespace {
+const char magic[8] = {'V', 'G', 'J', 'O', 'U', 'R', 'N', 'L'};
+const QLatin1String journalSuffix(".journal");
+const QLatin1String autosaveSuffix(".autosave.vgb");
+const QLatin1String lockSuffix(".lock");
+const quint32 journalVersion = 2;
+const int headerSize = 8 + 4 + 1 + 1 + 8 + 8 + 8;
+const int frameSize = 4 + 2;
+
+enum Op : quint8 { AddPoint = 1, AddLine, AddExtendedLine, AddCircle, MovePoint, SetLabel, Remove, Clear };
+
+struct Header {
+    quint8 baseKind = 0;
+    bool baseHoldsEdits = false;
+    qint64 baseSize = 0;
+    qint64 baseModified = 0;
+    // Commit generation when the base is a chunked scene, which is what identifies it then.
+    quint64 baseGeneration = 0;
+};
+
+void prepare(QDataStream &stream) {
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+}
+
+qint64 modifiedMs(const QFileInfo &info) {
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+bool parseHeader(const QByteArray &data, Header &header) {
+    if (data.size() < headerSize || std::memcmp(data.constData(), magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    QDataStream in(data.mid(sizeof(magic), headerSize - int(sizeof(magic))));
+    prepare(in);
+    quint32 version = 0;
+    quint8 holdsEdits = 0;
+    in >> version >> header.baseKind >> holdsEdits >> header.baseSize >> header.baseModified >> header.baseGeneration;
+    header.baseHoldsEdits = holdsEdits != 0;
+    return in.status() == QDataStream::Ok && version == journalVersion && header.baseKind <= 1;
+}
+
+// Resolves the base file the journal was started from and checks it is unchanged since.
+// A chunked base grows and is touched by updates that never commit, so only its
+// generation tells whether it still holds the scene the journal builds on.
+bool resolveBase(const QString &documentPath, const Header &header, QString &basePath) {
+    basePath = header.baseKind == 0 ? documentPath : SceneJournal::autosavePath(documentPath);
+    if (header.baseGeneration != 0) {
+        return ChunkedScene::generation(basePath) == header.baseGeneration;
+    }
+    const QFileInfo info(basePath);
+    return info.exists() && info.size() == header.baseSize && modifiedMs(info) == header.baseModified;
+}
+
+// Calls onRecord with the payload of every intact record; returns the offset after the last one.
+template <typename OnRecord>
+qint64 scanRecords(const QByteArray &data, OnRecord onRecord) {
+    qint64 offset = headerSize;
+    while (data.size() - offset >= frameSize) {
+        QDataStream frame(data.mid(int(offset), frameSize));
+        prepare(frame);
+        quint32 length = 0;
+        quint16 checksum = 0;
+        frame >> length >> checksum;
+        if (length == 0 || qint64(length) > data.size() - offset - frameSize) break;
+        const QByteArray payload = data.mid(int(offset + frameSize), int(length));
+        if (qChecksum(payload) != checksum || !onRecord(payload)) break;
+        offset += frameSize + length;
+    }
+    return offset;
+}
+
+template <typename T>
+void removeIndices(QVector<T> &items, QVector<int> indices) {
+    std::sort(indices.begin(), indices.end());
+    QVector<T> kept;
+    kept.reserve(items.size());
+    int next = 0;
+    for (int i = 0; i < items.size(); ++i) {
+        while (next < indices.size() && indices[next] < i) ++next;
+        if (next < indices.size() && indices[next] == i) continue;
+        kept.append(items[i]);
+    }
+    items.swap(kept);
+}
+
+bool apply(Scene &scene, const QByteArray &payload) {
+    QDataStream in(payload);
+    prepare(in);
+    quint8 op = 0;
+    in >> op;
+    switch (op) {
+    case AddPoint: {
+        QPointF position;
+        QString label;
+        in >> position >> label;
+        scene.points.append(Scene::Point(position, label));
+        break;
+    }
+    case AddLine: {
+        qint32 a = -1, b = -1;
+        QString label;
+        in >> a >> b >> label;
+        scene.lines.append(Scene::Line(a, b, label));
+        break;
+    }
+    case AddExtendedLine: {
+        QPointF a, b;
+        QString label;
+        in >> a >> b >> label;
+        scene.extendedLines.append(Scene::ExtendedLine(a, b, label));
+        break;
+    }
+    case AddCircle: {
+        QPointF center;
+        double radius = 0.0;
+        QString label;
+        in >> center >> radius >> label;
+        scene.circles.append(Scene::Circle(center, radius, label));
+        break;
+    }
+    case MovePoint: {
+        qint32 index = -1;
+        QPointF position;
+        in >> index >> position;
+        if (index < 0 || index >= scene.points.size()) return false;
+        scene.points[index].positiom = position;
+        break;
+    }
+    case SetLabel: {
+        quint8 kind = 0;
+        qint32 index = -1;
+        QString label;
+        in >> kind >> index >> label;
+        Scene::Object *object = nullptr;
+        if (kind == 0 && index >= 0 && index < scene.points.size()) object = &scene.points[index];
+        else if (kind == 1 && index >= 0 && index < scene.lines.size()) object = &scene.lines[index];
+        else if (kind == 2 && index >= 0 && index < scene.extendedLines.size()) object = &scene.extendedLines[index];
+        else if (kind == 3 && index >= 0 && index < scene.circles.size()) object = &scene.circles[index];
+        if (!object) return false;
+        object->label = label;
+        break;
+    }
+    case Remove: {
+        QVector<int> points, lines, extendedLines, circles;
+        in >> points >> lines >> extendedLines >> circles;
+        QVector<int> pointMap(scene.points.size(), 0);
+        for (int i : points) {
+            if (i >= 0 && i < pointMap.size()) pointMap[i] = -1;
+        }
+        int next = 0;
+        for (int &mapped : pointMap) {
+            mapped = mapped < 0 ? -1 : next++;
+        }
+        removeIndices(scene.points, points);
+        removeIndices(scene.lines, lines);
+        QVector<Scene::Line> remapped;
+        remapped.reserve(scene.lines.size());
+        for (const auto &line : scene.lines) {
+            if (line.a < 0 || line.b < 0 || line.a >= pointMap.size() || line.b >= pointMap.size()) continue;
+            if (pointMap[line.a] < 0 || pointMap[line.b] < 0) continue;
+            remapped.append(Scene::Line(pointMap[line.a], pointMap[line.b], line.label));
+        }
+        scene.lines.swap(remapped);
+        removeIndices(scene.extendedLines, extendedLines);
+        removeIndices(scene.circles, circles);
+        break;
+    }
+    case Clear:
+        scene.clear();
+        break;
+    default:
+        return false;
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+QByteArray payloadFor(quint8 op, const std::function<void(QDataStream &)> &fields) {
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    prepare(out);
+    out << op;
+    fields(out);
+    return payload;
+}
+}  // namespace
+
+SceneJournal::SceneJournal() {
+    pool.setMaxThreadCount(1);
+}
+
+SceneJournal::~SceneJournal() {
+    waitForWrites();
+    file.close();
+}
+
+QString SceneJournal::journalPath(const QString &documentPath) {
+    return documentPath + journalSuffix;
+}
+
+QString SceneJournal::autosavePath(const QString &documentPath) {
+    return documentPath + autosaveSuffix;
+}
+
+bool SceneJournal::hasRecoverableEdits(const QString &documentPath) {
+    QFile journal(journalPath(documentPath));
+    if (!journal.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = journal.readAll();
+    Header header;
+    QString basePath;
+    if (!parseHeader(data, header) || !resolveBase(documentPath, header, basePath)) {
+        return false;
+    }
+    return header.baseHoldsEdits || scanRecords(data, [](const QByteArray &) { return true; }) > headerSize;
+}
+
+bool SceneJournal::recover(const QString &documentPath, Scene &scene) {
+    QFile journal(journalPath(documentPath));
+    if (!journal.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = journal.readAll();
+    Header header;
+    QString basePath;
+    if (!parseHeader(data, header) || !resolveBase(documentPath, header, basePath)) {
+        return false;
+    }
+    Scene recovered;
+    if (!SceneFile::read(basePath, recovered)) {
+        return false;
+    }
+    scanRecords(data, [&](const QByteArray &payload) { return apply(recovered, payload); });
+    scene = std::move(recovered);
+    return true;
+}
+
+void SceneJournal::discard(const QString &documentPath) {
+    QFile::remove(journalPath(documentPath));
+    QFile::remove(autosavePath(documentPath));
+}
+
+QString SceneJournal::sessionDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/sessions";
+}
+
+QStringList SceneJournal::abandonedSessions() {
+    QStringList sessions;
+    const QFileInfoList journals =
+        QDir(sessionDirectory()).entryInfoList({QString("*") + journalSuffix}, QDir::Files, QDir::Time);
+    for (const QFileInfo &info : journals) {
+        const QString document = info.filePath().chopped(journalSuffix.size());
+        // The lock is only probed; it is released again when the probe goes out of scope.
+        QLockFile lock(document + lockSuffix);
+        if (!lock.tryLock(0)) {
+            continue;
+        }
+        if (hasRecoverableEdits(document)) {
+            sessions.append(document);
+        } else {
+            discard(document);
+        }
+    }
+    return sessions;
+}
+
+bool SceneJournal::attach(const QString &documentPath) {
+    waitForWrites();
+    QFile::remove(autosavePath(documentPath));
+    if (!writeHeader(documentPath, documentPath, false)) {
+        detach();
+        return false;
+    }
+    setDocument(documentPath);
+    sinceCompaction = 0;
+    return true;
+}
+
+bool SceneJournal::resume(const QString &documentPath) {
+    waitForWrites();
+    file.close();
+    file.setFileName(journalPath(documentPath));
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    // Drop a torn tail so new records follow the last intact one.
+    const QByteArray data = file.readAll();
+    Header header;
+    if (!parseHeader(data, header)) {
+        file.close();
+        return attach(documentPath);
+    }
+    const qint64 end = scanRecords(data, [](const QByteArray &) { return true; });
+    if (!file.resize(end) || !file.seek(end)) {
+        file.close();
+        return false;
+    }
+    setDocument(documentPath);
+    sinceCompaction = end - headerSize;
+    return true;
+}
+
+void SceneJournal::attachSnapshot(const QString &documentPath, const Scene &scene) {
+    waitForWrites();
+    // Until the snapshot is on disk there is no base for records, so they are dropped.
+    file.close();
+    setDocument(documentPath);
+    Task task;
+    task.type = TaskType::Compact;
+    task.snapshot = scene;
+    task.documentPath = documentPath;
+    task.holdsEdits = false;
+    enqueue(std::move(task));
+    sinceCompaction = 0;
+}
+
+void SceneJournal::detach() {
+    waitForWrites();
+    file.close();
+    setDocument(QString());
+    sinceCompaction = 0;
+}
+
+bool SceneJournal::isAttached() const {
+    QMutexLocker locker(&mutex);
+    return !document.isEmpty();
+}
+
+QString SceneJournal::documentPath() const {
+    QMutexLocker locker(&mutex);
+    return document;
+}
+
+void SceneJournal::setDocument(const QString &documentPath) {
+    QMutexLocker locker(&mutex);
+    document = documentPath;
+}
+
+void SceneJournal::compact(const Scene &snapshot) {
+    if (!isAttached()) {
+        return;
+    }
+    // The document is resolved when the task runs, after any rebase queued before it.
+    Task task;
+    task.type = TaskType::Compact;
+    task.snapshot = snapshot;
+    enqueue(std::move(task));
+    sinceCompaction = 0;
+}
+
+void SceneJournal::rebase(const QString &documentPath, const QFuture<bool> &saved) {
+    // Also used for a first save of an untitled scene: records made while the
+    // save runs queue behind the rebase and land in the new journal once the
+    // save has succeeded. The document only changes then, in drain().
+    Task task;
+    task.type = TaskType::Rebase;
+    task.documentPath = documentPath;
+    task.saved = saved;
+    {
+        QMutexLocker locker(&mutex);
+        ++pendingRebases;
+    }
+    enqueue(std::move(task));
+    sinceCompaction = 0;
+}
+
+void SceneJournal::rebase(const QString &documentPath) {
+    waitForWrites();
+    if (rebaseOnto(documentPath)) {
+        setDocument(documentPath);
+    }
+    sinceCompaction = 0;
+}
+
+void SceneJournal::waitForWrites() {
+    pool.waitForDone();
+}
+
+void SceneJournal::recordAddPoint(const QPointF &position, const QString &label) {
+    append(payloadFor(AddPoint, [&](QDataStream &out) { out << position << label; }));
+}
+
+void SceneJournal::recordAddLine(int a, int b, const QString &label) {
+    append(payloadFor(AddLine, [&](QDataStream &out) { out << qint32(a) << qint32(b) << label; }));
+}
+
+void SceneJournal::recordAddExtendedLine(const QPointF &a, const QPointF &b, const QString &label) {
+    append(payloadFor(AddExtendedLine, [&](QDataStream &out) { out << a << b << label; }));
+}
+
+void SceneJournal::recordAddCircle(const QPointF &center, double radius, const QString &label) {
+    append(payloadFor(AddCircle, [&](QDataStream &out) { out << center << radius << label; }));
+}
+
+void SceneJournal::recordMovePoint(int index, const QPointF &position) {
+    append(payloadFor(MovePoint, [&](QDataStream &out) { out << qint32(index) << position; }), index);
+}
+
+void SceneJournal::recordSetLabel(int kind, int index, const QString &label) {
+    append(payloadFor(SetLabel, [&](QDataStream &out) { out << quint8(kind) << qint32(index) << label; }));
+}
+
+void SceneJournal::recordRemove(const QVector<int> &points, const QVector<int> &lines, const QVector<int> &extendedLines,
+                                const QVector<int> &circles) {
+    append(payloadFor(Remove, [&](QDataStream &out) { out << points << lines << extendedLines << circles; }));
+}
+
+void SceneJournal::recordClear() {
+    append(payloadFor(Clear, [](QDataStream &) {}));
+}
+
+void SceneJournal::append(const QByteArray &payload, int moveIndex) {
+    {
+        // Records made while an untitled scene's first save runs are kept for the journal it may start.
+        QMutexLocker locker(&mutex);
+        if (document.isEmpty() && pendingRebases == 0) {
+            return;
+        }
+    }
+    QByteArray record;
+    {
+        QDataStream frame(&record, QIODevice::WriteOnly);
+        prepare(frame);
+        frame << quint32(payload.size()) << qChecksum(payload);
+    }
+    record += payload;
+    sinceCompaction += record.size();
+
+    QMutexLocker locker(&mutex);
+    // A drag emits a stream of moves for one point; while unwritten, only the latest is kept.
+    if (moveIndex >= 0 && moveIndex == lastMoveIndex && !queue.isEmpty() && queue.last().type == TaskType::Records) {
+        QByteArray &records = queue.last().records;
+        if (lastMoveOffset + record.size() == records.size()) {
+            records.replace(lastMoveOffset, record.size(), record);
+            sinceCompaction -= record.size();
+            return;
+        }
+    }
+    if (queue.isEmpty() || queue.last().type != TaskType::Records) {
+        queue.append(Task());
+    }
+    lastMoveIndex = moveIndex;
+    lastMoveOffset = queue.last().records.size();
+    queue.last().records += record;
+    if (!draining) {
+        draining = true;
+        pool.start([this]() { drain(); });
+    }
+}
+
+void SceneJournal::enqueue(Task &&task) {
+    QMutexLocker locker(&mutex);
+    queue.append(std::move(task));
+    lastMoveIndex = -1;
+    if (!draining) {
+        draining = true;
+        pool.start([this]() { drain(); });
+    }
+}
+
+void SceneJournal::drain() {
+    while (true) {
+        Task task;
+        {
+            QMutexLocker locker(&mutex);
+            if (queue.isEmpty()) {
+                draining = false;
+                return;
+            }
+            task = queue.takeFirst();
+            if (queue.isEmpty()) {
+                lastMoveIndex = -1;
+            }
+        }
+        switch (task.type) {
+        case TaskType::Records:
+            if (file.isOpen()) {
+                file.write(task.records);
+                file.flush();
+            }
+            break;
+        case TaskType::Compact: {
+            // Records queued before the snapshot are already on disk, so a failed write loses nothing.
+            const QString target = task.documentPath.isEmpty() ? documentPath() : task.documentPath;
+            SceneFile::WriteOptions options;
+            options.format = SceneFile::Format::Binary;
+            if (!target.isEmpty() && SceneFile::write(autosavePath(target), task.snapshot, options)) {
+                writeHeader(target, autosavePath(target), task.holdsEdits);
+            }
+            break;
+        }
+        case TaskType::Rebase: {
+            task.saved.waitForFinished();
+            // A failed save leaves the journal where it was, still on top of the last good base.
+            const bool moved = task.saved.result() && rebaseOnto(task.documentPath);
+            QMutexLocker locker(&mutex);
+            if (moved) {
+                document = task.documentPath;
+            }
+            --pendingRebases;
+            break;
+        }
+        }
+    }
+}
+
+bool SceneJournal::rebaseOnto(const QString &documentPath) {
+    const QString previous = file.isOpen() ? file.fileName() : QString();
+    if (!writeHeader(documentPath, documentPath, false)) {
+        return false;
+    }
+    QFile::remove(autosavePath(documentPath));
+    if (!previous.isEmpty() && previous != journalPath(documentPath)) {
+        // The document moved; the old journal and autosave describe work now saved elsewhere.
+        QFile::remove(previous);
+        QFile::remove(autosavePath(previous.chopped(journalSuffix.size())));
+    }
+    return true;
+}
+
+bool SceneJournal::writeHeader(const QString &documentPath, const QString &basePath, bool baseHoldsEdits) {
+    file.close();
+    file.setFileName(journalPath(documentPath));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const QFileInfo base(basePath);
+    QByteArray header(magic, sizeof(magic));
+    {
+        QDataStream out(&header, QIODevice::WriteOnly | QIODevice::Append);
+        prepare(out);
+        out << journalVersion << quint8(basePath == documentPath ? 0 : 1) << quint8(baseHoldsEdits ? 1 : 0)
+            << qint64(base.exists() ? base.size() : -1) << qint64(base.exists() ? modifiedMs(base) : 0)
+            << ChunkedScene::generation(basePath);
+    }
+    const bool ok = file.write(header) == header.size() && file.flush();
+    if (!ok) {
+        file.close();
+    }
+    return ok;
+}
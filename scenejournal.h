@@ -0,0 +1,111 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QFuture>
+#include <QMutex>
+#include <QPointF>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include "scene.h"
+
+// Append-only log of geometry mutations kept next to a document, so edits
+// survive a crash without rewriting the scene. The journal starts from a base
+// file - the document itself, or an autosave snapshot written by compaction -
+// identified by size and modification time, or by its commit generation when it
+// is a chunked scene. Each record is a length- and
+// checksum-framed binary operation; a torn record at the tail ends replay.
+//
+// Records are queued on the calling thread and written in order on a private
+// single-thread pool. Compaction and rebasing are queued the same way, so
+// every record lands in the journal of the base it follows.
+class SceneJournal {
+public:
+    SceneJournal();
+    ~SceneJournal();
+
+    static QString journalPath(const QString &documentPath);
+    static QString autosavePath(const QString &documentPath);
+    // True when the journal next to documentPath holds edits the document lacks.
+    static bool hasRecoverableEdits(const QString &documentPath);
+    // Loads the journal's base and replays every intact record onto it.
+    static bool recover(const QString &documentPath, Scene &scene);
+    // Deletes the journal and autosave next to documentPath.
+    static void discard(const QString &documentPath);
+
+    // Untitled scenes are journaled as documents named after their session in
+    // this directory; the document file itself never exists. A running session
+    // holds the document's ".lock" file.
+    static QString sessionDirectory();
+    // Sessions no running window holds that have edits to recover, newest
+    // first. Abandoned sessions without edits are discarded.
+    static QStringList abandonedSessions();
+
+    // Starts a fresh journal based on the document as it is on disk now.
+    bool attach(const QString &documentPath);
+    // Keeps appending to an existing journal after recover().
+    bool resume(const QString &documentPath);
+    // Starts a fresh journal for documentPath based on a snapshot of scene
+    // rather than the file on disk, as for an untitled session.
+    void attachSnapshot(const QString &documentPath, const Scene &scene);
+    void detach();
+    bool isAttached() const;
+    QString documentPath() const;
+
+    // Writes snapshot as the new base once queued records are on disk, then
+    // truncates the journal. The snapshot holds unsaved edits.
+    void compact(const Scene &snapshot);
+    // After saved reports success, bases the journal on documentPath, moving
+    // it there when the document was saved under a new name. Until then, and
+    // for good if the save fails, records keep going to the current journal.
+    void rebase(const QString &documentPath, const QFuture<bool> &saved);
+    // Same, for a document that has just been written synchronously.
+    void rebase(const QString &documentPath);
+    qint64 bytesSinceCompaction() const { return sinceCompaction; }
+    void waitForWrites();
+
+    void recordAddPoint(const QPointF &position, const QString &label);
+    void recordAddLine(int a, int b, const QString &label);
+    void recordAddExtendedLine(const QPointF &a, const QPointF &b, const QString &label);
+    void recordAddCircle(const QPointF &center, double radius, const QString &label);
+    void recordMovePoint(int index, const QPointF &position);
+    void recordSetLabel(int kind, int index, const QString &label);
+    // Removes the listed objects; surviving lines are renumbered to the surviving points.
+    void recordRemove(const QVector<int> &points, const QVector<int> &lines, const QVector<int> &extendedLines,
+                      const QVector<int> &circles);
+    void recordClear();
+
+private:
+    enum class TaskType { Records, Compact, Rebase };
+    struct Task {
+        TaskType type = TaskType::Records;
+        QByteArray records;
+        Scene snapshot;
+        // Empty for a compaction of whatever document is current when it runs.
+        QString documentPath;
+        bool holdsEdits = true;
+        QFuture<bool> saved;
+    };
+
+    // Shared with the writer thread, which switches it once a rebase succeeds; guarded by mutex.
+    QString document;
+    int pendingRebases = 0;
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QVector<Task> queue;
+    bool draining = false;
+    QFile file;
+    qint64 sinceCompaction = 0;
+    int lastMoveIndex = -1;
+    int lastMoveOffset = -1;
+
+    void append(const QByteArray &payload, int moveIndex = -1);
+    void enqueue(Task &&task);
+    void drain();
+    void setDocument(const QString &documentPath);
+    bool rebaseOnto(const QString &documentPath);
+    bool writeHeader(const QString &documentPath, const QString &basePath, bool baseHoldsEdits);
+};
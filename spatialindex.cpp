@@ -0,0 +1,208 @@
+#include "spatialindex.h"
+
+#include <QDataStream>
+#include <algorithm>
+#include <vector>
+
+bool SpatialIndex::overlaps(const QRectF &a, const QRectF &b) {
+    return a.left() <= b.right() && b.left() <= a.right() &&
+           a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+QRectF SpatialIndex::unite(const QRectF &a, const QRectF &b) {
+    // QRectF::united() skips zero-size rectangles, which would drop points.
+    return QRectF(QPointF(std::min(a.left(), b.left()), std::min(a.top(), b.top())),
+                  QPointF(std::max(a.right(), b.right()), std::max(a.bottom(), b.bottom())));
+}
+
+void SpatialIndex::clear() {
+    items.clear();
+    nodes.clear();
+    itemLeaf.clear();
+    itemSlot.clear();
+}
+
+void SpatialIndex::build(const QVector<Item> &newItems) {
+    items = newItems;
+    for (auto &item : items) {
+        item.bounds = item.bounds.normalized();
+    }
+    nodes.clear();
+    itemLeaf.clear();
+    itemSlot.clear();
+    if (items.isEmpty()) {
+        return;
+    }
+    nodes.reserve(2 * (items.size() / leafSize + 1));
+    itemLeaf.resize(items.size());
+    buildNode(0, items.size(), -1);
+    itemSlot.reserve(items.size());
+    for (int i = 0; i < items.size(); ++i) {
+        itemSlot.insert(itemKey(items[i].kind, items[i].index), i);
+    }
+}
+
+int SpatialIndex::buildNode(int first, int count, int parent) {
+    const int nodeIndex = nodes.size();
+    nodes.append(Node());
+    nodes[nodeIndex].parent = parent;
+
+    QRectF bounds = items[first].bounds;
+    QRectF centroids(items[first].bounds.center(), QSizeF(0.0, 0.0));
+    for (int i = first + 1; i < first + count; ++i) {
+        bounds = unite(bounds, items[i].bounds);
+        centroids = unite(centroids, QRectF(items[i].bounds.center(), QSizeF(0.0, 0.0)));
+    }
+    nodes[nodeIndex].bounds = bounds;
+
+    if (count <= leafSize) {
+        nodes[nodeIndex].first = first;
+        nodes[nodeIndex].count = count;
+        for (int i = first; i < first + count; ++i) {
+            itemLeaf[i] = nodeIndex;
+        }
+        return nodeIndex;
+    }
+
+    // Median split on the longer axis of the centroid bounds.
+    const bool splitX = centroids.width() >= centroids.height();
+    const int half = count / 2;
+    auto begin = items.begin() + first;
+    std::nth_element(begin, begin + half, begin + count, [splitX](const Item &a, const Item &b) {
+        return splitX ? a.bounds.center().x() < b.bounds.center().x()
+                      : a.bounds.center().y() < b.bounds.center().y();
+    });
+    const int left = buildNode(first, half, nodeIndex);
+    const int right = buildNode(first + half, count - half, nodeIndex);
+    nodes[nodeIndex].left = left;
+    nodes[nodeIndex].right = right;
+    return nodeIndex;
+}
+
+void SpatialIndex::query(const QRectF &rect, QVector<Item> &out) const {
+    if (nodes.isEmpty()) {
+        return;
+    }
+    const QRectF r = rect.normalized();
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const int nodeIndex = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[nodeIndex];
+        if (!overlaps(node.bounds, r)) continue;
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                if (overlaps(items[i].bounds, r)) {
+                    out.append(items[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+bool SpatialIndex::update(int kind, int index, const QRectF &bounds) {
+    auto it = itemSlot.constFind(itemKey(kind, index));
+    if (it == itemSlot.constEnd()) {
+        return false;
+    }
+    const int slot = it.value();
+    items[slot].bounds = bounds.normalized();
+
+    // Recompute the leaf from its items, then each ancestor from its two children.
+    int nodeIndex = itemLeaf[slot];
+    Node &leaf = nodes[nodeIndex];
+    QRectF leafBounds = items[leaf.first].bounds;
+    for (int i = leaf.first + 1; i < leaf.first + leaf.count; ++i) {
+        leafBounds = unite(leafBounds, items[i].bounds);
+    }
+    leaf.bounds = leafBounds;
+    nodeIndex = leaf.parent;
+    while (nodeIndex >= 0) {
+        Node &node = nodes[nodeIndex];
+        node.bounds = unite(nodes[node.left].bounds, nodes[node.right].bounds);
+        nodeIndex = node.parent;
+    }
+    return true;
+}
+
+void SpatialIndex::save(QDataStream &out) const {
+    out << qint32(items.size());
+    for (const auto &item : items) {
+        out << item.bounds << qint32(item.kind) << qint32(item.index);
+    }
+    out << qint32(nodes.size());
+    for (const auto &node : nodes) {
+        out << node.bounds << qint32(node.left) << qint32(node.right) << qint32(node.first) << qint32(node.count)
+            << qint32(node.parent);
+    }
+}
+
+bool SpatialIndex::load(QDataStream &in) {
+    qint32 itemCount = 0;
+    in >> itemCount;
+    if (itemCount < 0 || in.status() != QDataStream::Ok) {
+        return false;
+    }
+    QVector<Item> loadedItems;
+    for (qint32 i = 0; i < itemCount && in.status() == QDataStream::Ok; ++i) {
+        Item item;
+        qint32 kind = 0, index = -1;
+        in >> item.bounds >> kind >> index;
+        item.kind = kind;
+        item.index = index;
+        loadedItems.append(item);
+    }
+    qint32 nodeCount = 0;
+    in >> nodeCount;
+    if (nodeCount < 0 || (nodeCount == 0) != (itemCount == 0) || in.status() != QDataStream::Ok) {
+        return false;
+    }
+    QVector<Node> loadedNodes;
+    for (qint32 i = 0; i < nodeCount && in.status() == QDataStream::Ok; ++i) {
+        Node node;
+        qint32 left = -1, right = -1, first = 0, count = 0, parent = -1;
+        in >> node.bounds >> left >> right >> first >> count >> parent;
+        node.left = left;
+        node.right = right;
+        node.first = first;
+        node.count = count;
+        node.parent = parent;
+        loadedNodes.append(node);
+    }
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    // Every item must sit in exactly one leaf, and every link must stay in range.
+    QVector<int> loadedLeaf(loadedItems.size(), -1);
+    for (int i = 0; i < loadedNodes.size(); ++i) {
+        const Node &node = loadedNodes[i];
+        if (node.parent < -1 || node.parent >= loadedNodes.size() || (i == 0) != (node.parent == -1)) return false;
+        if (node.left >= 0 || node.right >= 0) {
+            if (node.left <= i || node.right <= i || node.left >= loadedNodes.size() || node.right >= loadedNodes.size()) return false;
+            continue;
+        }
+        if (node.first < 0 || node.count <= 0 || node.count > loadedItems.size() - node.first) return false;
+        for (int item = node.first; item < node.first + node.count; ++item) {
+            if (loadedLeaf[item] >= 0) return false;
+            loadedLeaf[item] = i;
+        }
+    }
+    if (loadedLeaf.contains(-1)) {
+        return false;
+    }
+    items = loadedItems;
+    nodes = loadedNodes;
+    itemLeaf = loadedLeaf;
+    itemSlot.clear();
+    itemSlot.reserve(items.size());
+    for (int i = 0; i < items.size(); ++i) {
+        itemSlot.insert(itemKey(items[i].kind, items[i].index), i);
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QHash>
+#include <QRectF>
+#include <QVector>
+
+class QDataStream;
+
+// Static bounding-volume hierarchy over axis-aligned world-space rectangles.
+// Items carry an opaque (kind, index) pair identifying the owning object.
+// Rectangles may be degenerate (points, axis-parallel segments); overlap
+// tests are inclusive so those are still found.
+class SpatialIndex {
+public:
+    struct Item {
+        QRectF bounds;
+        int kind = 0;
+        int index = -1;
+    };
+
+    void build(const QVector<Item> &items);
+    void clear();
+    bool isEmpty() const { return items.isEmpty(); }
+    int size() const { return items.size(); }
+    // Appends every item whose bounds overlap rect to out.
+    void query(const QRectF &rect, QVector<Item> &out) const;
+    // Replaces the bounds of an indexed item and refits its ancestors. The tree
+    // shape is kept, so many large moves degrade query quality until rebuilt.
+    bool update(int kind, int index, const QRectF &bounds);
+    // Writes the built tree; load restores it without rebuilding and rejects
+    // trees whose links are inconsistent.
+    void save(QDataStream &out) const;
+    bool load(QDataStream &in);
+
+    static bool overlaps(const QRectF &a, const QRectF &b);
+    static QRectF unite(const QRectF &a, const QRectF &b);
+
+private:
+    struct Node {
+        QRectF bounds;
+        int left = -1;
+        int right = -1;
+        int first = 0;
+        int count = 0;
+        int parent = -1;
+    };
+
+    static constexpr int leafSize = 4;
+
+    QVector<Item> items;
+    QVector<Node> nodes;
+    QVector<int> itemLeaf;
+    QHash<quint64, int> itemSlot;
+
+    int buildNode(int first, int count, int parent);
+    static quint64 itemKey(int kind, int index) { return (quint64(quint32(kind)) << 32) | quint32(index); }
+};
@@ -0,0 +1,13 @@
+# Headless tests of the scene formats, the edit journal and macro parsing.
+QT = core testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = VibeGeometryTests
+
+include(../core.pri)
+
+SOURCES += \
+    tst_core.cpp
@@ -0,0 +1,341 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "chunkedscene.h"
+#include "macro.h"
+#include "scenefile.h"
+#include "scenejournal.h"
+
+Q_DECLARE_METATYPE(SceneFile::Format)
+
+namespace {
+// Points on a slanted grid with repeated and empty labels, a line between each
+// pair of neighbours and a few extended lines and circles.
+Scene sampleScene(int pointCount = 64) {
+    Scene scene;
+    for (int i = 0; i < pointCount; ++i) {
+        const QString label = i % 3 == 0 ? QString() : QStringLiteral("P%1").arg(i % 5);
+        scene.points.append(Scene::Point(QPointF(i * 1.5 - 20.0, (i % 16) * -0.25 + i / 16), label));
+    }
+    for (int i = 1; i < pointCount; ++i) {
+        scene.lines.append(Scene::Line(i - 1, i, i % 4 == 0 ? QStringLiteral("edge") : QString()));
+    }
+    scene.extendedLines.append(Scene::ExtendedLine(QPointF(-1.0, -1.0), QPointF(1.0, 1.0), QStringLiteral("diagonal")));
+    scene.extendedLines.append(Scene::ExtendedLine(QPointF(0.0, 3.0), QPointF(5.0, 3.0), QString()));
+    for (int i = 0; i < 5; ++i) {
+        scene.circles.append(Scene::Circle(QPointF(i * 10.0, -i * 2.5), 0.5 + i, i == 2 ? QStringLiteral("c") : QString()));
+    }
+    return scene;
+}
+
+bool sameScene(const Scene &a, const Scene &b) {
+    if (a.points.size() != b.points.size() || a.lines.size() != b.lines.size() ||
+        a.extendedLines.size() != b.extendedLines.size() || a.circles.size() != b.circles.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.points.size(); ++i) {
+        if (a.points[i].positiom != b.points[i].positiom || a.points[i].label != b.points[i].label) return false;
+    }
+    for (int i = 0; i < a.lines.size(); ++i) {
+        if (a.lines[i].a != b.lines[i].a || a.lines[i].b != b.lines[i].b || a.lines[i].label != b.lines[i].label) {
+            return false;
+        }
+    }
+    for (int i = 0; i < a.extendedLines.size(); ++i) {
+        const auto &x = a.extendedLines[i];
+        const auto &y = b.extendedLines[i];
+        if (x.a != y.a || x.b != y.b || x.label != y.label) return false;
+    }
+    for (int i = 0; i < a.circles.size(); ++i) {
+        const auto &x = a.circles[i];
+        const auto &y = b.circles[i];
+        if (x.center != y.center || x.radius != y.radius || x.label != y.label) return false;
+    }
+    return true;
+}
+
+bool writeScene(const QString &path, const Scene &scene, SceneFile::Format format, quint64 generation = 1) {
+    SceneFile::WriteOptions options;
+    options.format = format;
+    options.generation = generation;
+    return SceneFile::write(path, scene, options);
+}
+
+// "P0 L3" for the objects a by-id command names.
+QString refsText(const Macro &macro, int index) {
+    static const char letters[] = "PLEC";
+    QStringList refs;
+    for (const Macro::Ref &ref : macro.refs(index)) {
+        refs.append(QStringLiteral("%1%2").arg(QChar(letters[ref.kind])).arg(ref.id));
+    }
+    return refs.join(' ');
+}
+}  // namespace
+
+class TestCore : public QObject {
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void truncated_data();
+    void truncated();
+    void corrupted_data();
+    void corrupted();
+    void chunkedUpdate();
+    void journalRecover();
+    void journalChunkedBase();
+    void macroLines_data();
+    void macroLines();
+    void macroRejectedLines_data();
+    void macroRejectedLines();
+    void macroAppendLines();
+
+private:
+    QTemporaryDir dir;
+
+    void addFormats();
+};
+
+// Every format, with where a header field sits that no reader can accept once clobbered.
+void TestCore::addFormats() {
+    QTest::addColumn<SceneFile::Format>("format");
+    QTest::addColumn<QString>("suffix");
+    QTest::addColumn<int>("headerField");
+    QTest::newRow("json") << SceneFile::Format::Json << "json" << 0;
+    QTest::newRow("binary") << SceneFile::Format::Binary << "vgb" << 16;
+    QTest::newRow("tiled") << SceneFile::Format::Tiled << "vgt" << 16;
+    QTest::newRow("compressed") << SceneFile::Format::Compressed << "vgz" << 16;
+    QTest::newRow("chunked") << SceneFile::Format::Chunked << "vgc" << 16;
+}
+
+void TestCore::roundTrip_data() {
+    addFormats();
+}
+
+void TestCore::roundTrip() {
+    QFETCH(SceneFile::Format, format);
+    QFETCH(QString, suffix);
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("roundtrip." + suffix);
+    const Scene scene = sampleScene();
+    QVERIFY(writeScene(path, scene, format, 7));
+
+    Scene loaded;
+    SceneFile::ReadInfo info;
+    QVERIFY(SceneFile::read(path, loaded, SceneFile::ProgressFunction(), &info));
+    QVERIFY(sameScene(scene, loaded));
+    QCOMPARE(info.generation, format == SceneFile::Format::Chunked ? quint64(7) : quint64(0));
+}
+
+void TestCore::truncated_data() {
+    addFormats();
+}
+
+void TestCore::truncated() {
+    QFETCH(SceneFile::Format, format);
+    QFETCH(QString, suffix);
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("truncated." + suffix);
+    QVERIFY(writeScene(path, sampleScene(), format));
+    QFile file(path);
+    QVERIFY(file.resize(file.size() / 2));
+
+    Scene loaded;
+    QVERIFY(!SceneFile::read(path, loaded));
+}
+
+void TestCore::corrupted_data() {
+    addFormats();
+}
+
+void TestCore::corrupted() {
+    QFETCH(SceneFile::Format, format);
+    QFETCH(QString, suffix);
+    QFETCH(int, headerField);
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("corrupted." + suffix);
+    QVERIFY(writeScene(path, sampleScene(), format));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(headerField));
+    QCOMPARE(file.write(QByteArray(16, '\xff')), qint64(16));
+    file.close();
+
+    Scene loaded;
+    QVERIFY(!SceneFile::read(path, loaded));
+}
+
+void TestCore::chunkedUpdate() {
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("update.vgc");
+    // Several point chunks, so the untouched ones outweigh what is rewritten.
+    const Scene scene = sampleScene(3 * ChunkedScene::chunkObjects + 100);
+    QVERIFY(writeScene(path, scene, SceneFile::Format::Chunked, 1));
+
+    Scene edited = scene;
+    ChunkedScene::Changes changes;
+    edited.points[10].positiom = QPointF(-7.0, 9.5);
+    changes.mark(0, 10);
+    edited.lines[0].label = QStringLiteral("renamed");
+    changes.mark(1, 0);
+    edited.circles.append(Scene::Circle(QPointF(1.0, 2.0), 3.0));
+    changes.mark(3, edited.circles.size() - 1);
+    QVERIFY(ChunkedScene::update(path, edited, changes, 1, 2));
+
+    Scene loaded;
+    SceneFile::ReadInfo info;
+    QVERIFY(SceneFile::read(path, loaded, SceneFile::ProgressFunction(), &info));
+    QVERIFY(sameScene(edited, loaded));
+    QCOMPARE(info.generation, quint64(2));
+    QCOMPARE(ChunkedScene::generation(path), quint64(2));
+
+    // A stale base generation is refused without touching the file.
+    const qint64 size = QFileInfo(path).size();
+    QVERIFY(!ChunkedScene::update(path, scene, changes, 1, 3));
+    QCOMPARE(QFileInfo(path).size(), size);
+    QVERIFY(SceneFile::read(path, loaded, SceneFile::ProgressFunction(), &info));
+    QVERIFY(sameScene(edited, loaded));
+    QCOMPARE(info.generation, quint64(2));
+}
+
+void TestCore::journalRecover() {
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("journaled.vgb");
+    const Scene base = sampleScene(8);
+    QVERIFY(SceneFile::write(path, base));
+
+    SceneJournal journal;
+    QVERIFY(journal.attach(path));
+    QVERIFY(!SceneJournal::hasRecoverableEdits(path));
+    journal.recordAddPoint(QPointF(7.0, 8.0), QStringLiteral("new"));
+    journal.recordAddLine(0, 8, QString());
+    journal.recordMovePoint(1, QPointF(-3.0, 4.0));
+    journal.recordMovePoint(1, QPointF(-3.5, 4.5));
+    journal.recordSetLabel(3, 2, QStringLiteral("ring"));
+    journal.recordAddExtendedLine(QPointF(0.0, 0.0), QPointF(0.0, 1.0), QString());
+    journal.detach();
+
+    Scene expected = base;
+    expected.points.append(Scene::Point(QPointF(7.0, 8.0), QStringLiteral("new")));
+    expected.lines.append(Scene::Line(0, 8, QString()));
+    expected.points[1].positiom = QPointF(-3.5, 4.5);
+    expected.circles[2].label = QStringLiteral("ring");
+    expected.extendedLines.append(Scene::ExtendedLine(QPointF(0.0, 0.0), QPointF(0.0, 1.0), QString()));
+
+    QVERIFY(SceneJournal::hasRecoverableEdits(path));
+    Scene recovered;
+    QVERIFY(SceneJournal::recover(path, recovered));
+    QVERIFY(sameScene(expected, recovered));
+
+    // A torn record at the tail ends replay without losing the ones before it.
+    QFile file(SceneJournal::journalPath(path));
+    QVERIFY(file.open(QIODevice::Append));
+    QCOMPARE(file.write(QByteArray("\x20\0\0\0\x12", 5)), qint64(5));
+    file.close();
+    QVERIFY(SceneJournal::recover(path, recovered));
+    QVERIFY(sameScene(expected, recovered));
+
+    // Once the document changes on disk the journal no longer applies to it.
+    QVERIFY(SceneFile::write(path, expected));
+    QVERIFY(!SceneJournal::hasRecoverableEdits(path));
+    QVERIFY(!SceneJournal::recover(path, recovered));
+    SceneJournal::discard(path);
+    QVERIFY(!QFile::exists(SceneJournal::journalPath(path)));
+}
+
+void TestCore::journalChunkedBase() {
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("journaled.vgc");
+    const Scene base = sampleScene(8);
+    QVERIFY(writeScene(path, base, SceneFile::Format::Chunked, 1));
+
+    SceneJournal journal;
+    QVERIFY(journal.attach(path));
+    journal.recordAddPoint(QPointF(1.0, 1.0), QString());
+    journal.detach();
+    Scene expected = base;
+    expected.points.append(Scene::Point(QPointF(1.0, 1.0), QString()));
+
+    // An update cut short leaves chunks past the end but the header on the previous index.
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::Append));
+    QCOMPARE(file.write(QByteArray(100, '\xab')), qint64(100));
+    file.close();
+    QVERIFY(SceneJournal::hasRecoverableEdits(path));
+    Scene recovered;
+    QVERIFY(SceneJournal::recover(path, recovered));
+    QVERIFY(sameScene(expected, recovered));
+
+    // A save that commits moves the file past the journal's base.
+    SceneFile::WriteOptions options;
+    options.format = SceneFile::Format::Chunked;
+    options.baseGeneration = 1;
+    options.generation = 2;
+    options.changes.markFrom(0, base.points.size());
+    QVERIFY(SceneFile::write(path, recovered, options));
+    QVERIFY(!SceneJournal::hasRecoverableEdits(path));
+}
+
+void TestCore::macroLines_data() {
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<int>("opcode");
+    QTest::addColumn<QString>("refs");
+    QTest::newRow("line by id") << "addLine:#P0|#P12" << int(Macro::Opcode::AddLineById) << "P0 P12";
+    QTest::newRow("circle by id") << "addCircle:#P3|#P4" << int(Macro::Opcode::AddCircleById) << "P3 P4";
+    QTest::newRow("normal by id") << "addNormal:#L2;#P5" << int(Macro::Opcode::AddNormalById) << "L2 P5";
+    QTest::newRow("move by id") << "movePoint:#P7|1.50000000,-2.00000000" << int(Macro::Opcode::MovePointById)
+                                << "P7";
+    QTest::newRow("delete by id") << "deleteObjects:#P1,#L2,#E3,#C4" << int(Macro::Opcode::DeleteById)
+                                  << "P1 L2 E3 C4";
+    QTest::newRow("label by id") << "labelObject:#C9|a|b" << int(Macro::Opcode::SetLabelById) << "C9";
+    QTest::newRow("line by coordinates") << "addLine:1.00000000,2.00000000|3.00000000,4.00000000"
+                                         << int(Macro::Opcode::AddLine) << "";
+    QTest::newRow("point") << "addPoint:0.25000000,-0.50000000" << int(Macro::Opcode::AddPoint) << "";
+}
+
+void TestCore::macroLines() {
+    QFETCH(QString, line);
+    QFETCH(int, opcode);
+    QFETCH(QString, refs);
+    Macro macro;
+    QVERIFY(macro.appendLine(line));
+    QCOMPARE(macro.size(), 1);
+    QCOMPARE(int(macro.at(0).opcode), opcode);
+    // Only by-id commands carry references; the other operands are coordinates.
+    if (opcode >= int(Macro::Opcode::AddLineById)) {
+        QCOMPARE(refsText(macro, 0), refs);
+    }
+    QCOMPARE(macro.line(0), line);
+}
+
+void TestCore::macroRejectedLines_data() {
+    QTest::addColumn<QString>("line");
+    QTest::newRow("one endpoint") << "addLine:#P0";
+    QTest::newRow("unknown kind") << "addLine:#P0|#X1";
+    QTest::newRow("missing id") << "addCircle:#P|#P1";
+    QTest::newRow("wrong separator") << "addNormal:#L2|#P5";
+    QTest::newRow("move without position") << "movePoint:#P7";
+    QTest::newRow("negative id") << "labelObject:#C-1|x";
+    QTest::newRow("bare reference") << "deleteObjects:#P1,P2";
+    QTest::newRow("unknown command") << "explode";
+}
+
+void TestCore::macroRejectedLines() {
+    QFETCH(QString, line);
+    Macro macro;
+    QVERIFY(!macro.appendLine(line));
+    QVERIFY(macro.isEmpty());
+}
+
+void TestCore::macroAppendLines() {
+    Macro macro;
+    QCOMPARE(macro.appendLines({"addPoint:1,2", "", "  deleteObjects:#P0  ", "bogus"}), 1);
+    QCOMPARE(macro.size(), 2);
+    QCOMPARE(macro.line(1), QStringLiteral("deleteObjects:#P0"));
+}
+
+QTEST_GUILESS_MAIN(TestCore)
+#include "tst_core.moc"
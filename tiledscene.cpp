@@ -0,0 +1,472 @@
+#include "tiledscene.h"
+
+#include <QBuffer>
+#include <QIODevice>
+#include <QMap>
+#include <QSet>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+
+#include "binaryscene.h"
+#include "sceneformat.h"
+
+namespace {
+const char magic[8] = {'V', 'G', 'T', 'S', 'C', 'E', 'N', 'E'};
+
+constexpr quint64 headerSize = 8 + 4 + 4 + 8 * 4;
+constexpr quint64 indexEntrySize = 8 * 4 + 8 + 8 + 4 + 4;
+constexpr quint64 tileHeaderSize = 4 + 4 * 4 + 4;
+constexpr quint32 unboundedFlag = 1;
+// Roughly how many objects share a tile; the grid is at most maxGrid cells wide.
+constexpr int objectsPerTile = 4096;
+constexpr int maxGrid = 256;
+
+using SceneFormat::align8;
+using SceneFormat::at;
+using SceneFormat::padTo8;
+using SceneFormat::put;
+
+// Bounds that also grow from a single point, unlike QRectF::united.
+struct Extent {
+    double left = std::numeric_limits<double>::infinity();
+    double top = std::numeric_limits<double>::infinity();
+    double right = -std::numeric_limits<double>::infinity();
+    double bottom = -std::numeric_limits<double>::infinity();
+
+    bool isEmpty() const { return left > right; }
+    void add(const QPointF &p) {
+        left = std::min(left, p.x());
+        right = std::max(right, p.x());
+        top = std::min(top, p.y());
+        bottom = std::max(bottom, p.y());
+    }
+    void add(const QPointF &center, double radius) {
+        add(center - QPointF(radius, radius));
+        add(center + QPointF(radius, radius));
+    }
+};
+
+struct CellObjects {
+    QVector<int> points;
+    QVector<int> lines;
+    QVector<int> circles;
+};
+
+bool validPoint(const Scene &scene, int index) {
+    return index >= 0 && index < scene.points.size();
+}
+
+// Encodes one tile; extended lines only go into the unbounded tile.
+bool encodeTile(const Scene &scene, const CellObjects &cell, bool unbounded, QByteArray &blob, Extent &extent) {
+    TiledScene::Fragment fragment;
+    QHash<int, int> local;
+    for (int i : cell.points) {
+        local.insert(i, fragment.scene.points.size());
+        fragment.scene.points.append(scene.points[i]);
+        fragment.pointIds.append(quint32(i));
+        extent.add(scene.points[i].positiom);
+    }
+    fragment.ownedPoints = fragment.scene.points.size();
+    auto endpoint = [&](int index) {
+        if (!validPoint(scene, index)) return -1;
+        auto it = local.constFind(index);
+        if (it != local.constEnd()) return it.value();
+        // Copy of a point owned by another tile, so the line can be drawn without it.
+        const int slot = fragment.scene.points.size();
+        local.insert(index, slot);
+        fragment.scene.points.append(scene.points[index]);
+        fragment.pointIds.append(quint32(index));
+        return slot;
+    };
+    for (int i : cell.lines) {
+        const auto &line = scene.lines[i];
+        fragment.scene.lines.append(Scene::Line(endpoint(line.a), endpoint(line.b), line.label));
+        fragment.lineIds.append(quint32(i));
+        if (validPoint(scene, line.a)) extent.add(scene.points[line.a].positiom);
+        if (validPoint(scene, line.b)) extent.add(scene.points[line.b].positiom);
+    }
+    for (int i : cell.circles) {
+        fragment.scene.circles.append(scene.circles[i]);
+        fragment.circleIds.append(quint32(i));
+        extent.add(scene.circles[i].center, scene.circles[i].radius);
+    }
+    if (unbounded) {
+        fragment.scene.extendedLines = scene.extendedLines;
+        for (int i = 0; i < scene.extendedLines.size(); ++i) fragment.extendedLineIds.append(quint32(i));
+    }
+
+    blob.resize(0);
+    put<quint32>(blob, quint32(fragment.ownedPoints));
+    put<quint32>(blob, quint32(fragment.pointIds.size()));
+    put<quint32>(blob, quint32(fragment.lineIds.size()));
+    put<quint32>(blob, quint32(fragment.extendedLineIds.size()));
+    put<quint32>(blob, quint32(fragment.circleIds.size()));
+    put<quint32>(blob, 0);
+    for (const QVector<quint32> *ids : {&fragment.pointIds, &fragment.lineIds, &fragment.extendedLineIds, &fragment.circleIds}) {
+        for (quint32 id : *ids) put<quint32>(blob, id);
+    }
+    padTo8(blob);
+    QBuffer buffer(&blob);
+    if (!buffer.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    return BinaryScene::write(buffer, fragment.scene);
+}
+
+bool overlaps(const QRectF &a, const QRectF &b) {
+    // Inclusive, so tiles of a single point (zero size) still match.
+    return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+}  // namespace
+
+TiledScene::~TiledScene() {
+    close();
+}
+
+bool TiledScene::matches(const QByteArray &head) {
+    return head.size() >= int(sizeof(magic)) && std::memcmp(head.constData(), magic, sizeof(magic)) == 0;
+}
+
+bool TiledScene::write(QIODevice &device, const Scene &scene) {
+    Extent sceneExtent;
+    for (const auto &p : scene.points) sceneExtent.add(p.positiom);
+    for (const auto &c : scene.circles) sceneExtent.add(c.center);
+    const int objects = scene.points.size() + scene.lines.size() + scene.circles.size();
+    const int grid = std::clamp(int(std::ceil(std::sqrt(double(objects) / objectsPerTile))), 1, maxGrid);
+    const double cellWidth = sceneExtent.isEmpty() ? 1.0 : std::max((sceneExtent.right - sceneExtent.left) / grid, 1e-9);
+    const double cellHeight = sceneExtent.isEmpty() ? 1.0 : std::max((sceneExtent.bottom - sceneExtent.top) / grid, 1e-9);
+    auto cellOf = [&](const QPointF &p) {
+        const int x = std::clamp(int((p.x() - sceneExtent.left) / cellWidth), 0, grid - 1);
+        const int y = std::clamp(int((p.y() - sceneExtent.top) / cellHeight), 0, grid - 1);
+        return y * grid + x;
+    };
+
+    // Cell -1 is the unbounded tile.
+    QMap<int, CellObjects> cells;
+    cells[-1];
+    QVector<int> pointCell(scene.points.size());
+    for (int i = 0; i < scene.points.size(); ++i) {
+        pointCell[i] = cellOf(scene.points[i].positiom);
+        cells[pointCell[i]].points.append(i);
+    }
+    for (int i = 0; i < scene.lines.size(); ++i) {
+        const int a = scene.lines[i].a;
+        cells[validPoint(scene, a) ? pointCell[a] : -1].lines.append(i);
+    }
+    for (int i = 0; i < scene.circles.size(); ++i) {
+        cells[cellOf(scene.circles[i].center)].circles.append(i);
+    }
+
+    QByteArray out;
+    out.append(magic, sizeof(magic));
+    put<quint32>(out, version);
+    put<quint32>(out, quint32(cells.size()));
+    put<quint64>(out, quint64(scene.points.size()));
+    put<quint64>(out, quint64(scene.lines.size()));
+    put<quint64>(out, quint64(scene.extendedLines.size()));
+    put<quint64>(out, quint64(scene.circles.size()));
+    if (device.write(out) != out.size()) {
+        return false;
+    }
+
+    quint64 offset = headerSize;
+    QByteArray entries;
+    QByteArray blob;
+    for (auto it = cells.constBegin(); it != cells.constEnd(); ++it) {
+        const bool unbounded = it.key() < 0;
+        Extent extent;
+        if (!encodeTile(scene, it.value(), unbounded, blob, extent)) {
+            return false;
+        }
+        padTo8(blob);
+        if (device.write(blob) != blob.size()) {
+            return false;
+        }
+        const quint32 count = quint32(it->points.size() + it->lines.size() + it->circles.size()
+                                      + (unbounded ? scene.extendedLines.size() : 0));
+        put<double>(entries, extent.isEmpty() ? 0.0 : extent.left);
+        put<double>(entries, extent.isEmpty() ? 0.0 : extent.top);
+        put<double>(entries, extent.isEmpty() ? 0.0 : extent.right);
+        put<double>(entries, extent.isEmpty() ? 0.0 : extent.bottom);
+        put<quint64>(entries, offset);
+        put<quint64>(entries, quint64(blob.size()));
+        put<quint32>(entries, unbounded ? unboundedFlag : 0);
+        put<quint32>(entries, count);
+        offset += quint64(blob.size());
+    }
+    put<quint64>(entries, offset);
+    return device.write(entries) == entries.size();
+}
+
+bool TiledScene::read(QFile &file, Scene &scene) {
+    TiledScene tiled;
+    return tiled.open(file.fileName()) && tiled.readAll(scene);
+}
+
+bool TiledScene::open(const QString &path) {
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    size = quint64(file.size());
+    base = size >= headerSize + 8 ? file.map(0, qint64(size)) : nullptr;
+    if (!base || !parse()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TiledScene::close() {
+    if (base) {
+        file.unmap(base);
+        base = nullptr;
+    }
+    file.close();
+    size = 0;
+    std::fill(std::begin(counts), std::end(counts), 0);
+    index.clear();
+}
+
+// Validates the header, trailer and every index entry against the mapped size.
+bool TiledScene::parse() {
+    if (std::memcmp(base, magic, sizeof(magic)) != 0 || at<quint32>(base, 8) != version) {
+        return false;
+    }
+    const quint64 tileCount = at<quint32>(base, 12);
+    for (int i = 0; i < 4; ++i) {
+        counts[i] = at<quint64>(base, 16, quint64(i));
+        if (counts[i] > quint64(std::numeric_limits<int>::max())) return false;
+    }
+    const quint64 indexOffset = at<quint64>(base, size - 8);
+    if (indexOffset < headerSize || indexOffset % 8 != 0 || indexOffset > size - 8
+        || tileCount * indexEntrySize != size - 8 - indexOffset) {
+        return false;
+    }
+    index.reserve(int(tileCount));
+    for (quint64 i = 0; i < tileCount; ++i) {
+        const quint64 entry = indexOffset + i * indexEntrySize;
+        Tile tile;
+        tile.bounds = QRectF(QPointF(at<double>(base, entry), at<double>(base, entry + 8)),
+                             QPointF(at<double>(base, entry + 16), at<double>(base, entry + 24)));
+        tile.offset = at<quint64>(base, entry + 32);
+        tile.size = at<quint64>(base, entry + 40);
+        tile.unbounded = (at<quint32>(base, entry + 48) & unboundedFlag) != 0;
+        tile.objects = at<quint32>(base, entry + 52);
+        if (tile.offset < headerSize || tile.offset % 8 != 0 || tile.offset > indexOffset
+            || tile.size > indexOffset - tile.offset) {
+            return false;
+        }
+        index.append(tile);
+    }
+    return true;
+}
+
+bool TiledScene::readTile(int tile, Fragment &fragment) const {
+    if (!base || tile < 0 || tile >= index.size()) {
+        return false;
+    }
+    const uchar *blob = base + index[tile].offset;
+    const quint64 blobSize = index[tile].size;
+    if (blobSize < tileHeaderSize) {
+        return false;
+    }
+    const quint64 owned = at<quint32>(blob, 0);
+    quint64 idCounts[4];
+    quint64 idTotal = 0;
+    for (int i = 0; i < 4; ++i) {
+        idCounts[i] = at<quint32>(blob, 4, quint64(i));
+        idTotal += idCounts[i];
+    }
+    const quint64 sceneOffset = align8(tileHeaderSize + 4 * idTotal);
+    if (sceneOffset > blobSize || owned > idCounts[0]) {
+        return false;
+    }
+
+    Fragment loaded;
+    QVector<quint32> *ids[4] = {&loaded.pointIds, &loaded.lineIds, &loaded.extendedLineIds, &loaded.circleIds};
+    quint64 cursor = tileHeaderSize;
+    for (int kind = 0; kind < 4; ++kind) {
+        ids[kind]->reserve(int(idCounts[kind]));
+        for (quint64 i = 0; i < idCounts[kind]; ++i, cursor += 4) {
+            const quint32 id = at<quint32>(blob, cursor);
+            if (id >= counts[kind]) return false;
+            ids[kind]->append(id);
+        }
+    }
+    if (!BinaryScene::read(blob + sceneOffset, blobSize - sceneOffset, loaded.scene)) {
+        return false;
+    }
+    const Scene &scene = loaded.scene;
+    if (quint64(scene.points.size()) != idCounts[0] || quint64(scene.lines.size()) != idCounts[1]
+        || quint64(scene.extendedLines.size()) != idCounts[2] || quint64(scene.circles.size()) != idCounts[3]) {
+        return false;
+    }
+    for (const auto &line : scene.lines) {
+        if (line.a >= scene.points.size() || line.b >= scene.points.size()) return false;
+    }
+    loaded.ownedPoints = int(owned);
+    fragment = std::move(loaded);
+    return true;
+}
+
+bool TiledScene::readAll(Scene &scene) const {
+    if (!base) {
+        return false;
+    }
+    Scene loaded;
+    loaded.points.resize(int(counts[0]));
+    loaded.lines.resize(int(counts[1]));
+    loaded.extendedLines.resize(int(counts[2]));
+    loaded.circles.resize(int(counts[3]));
+    // Every object must be owned by exactly one tile.
+    QVector<bool> seen[4];
+    for (int kind = 0; kind < 4; ++kind) seen[kind].fill(false, int(counts[kind]));
+    auto claim = [&](int kind, quint32 id) {
+        if (seen[kind][int(id)]) return false;
+        seen[kind][int(id)] = true;
+        return true;
+    };
+    Fragment fragment;
+    for (int t = 0; t < index.size(); ++t) {
+        if (!readTile(t, fragment)) return false;
+        const Scene &part = fragment.scene;
+        for (int i = 0; i < fragment.ownedPoints; ++i) {
+            if (!claim(0, fragment.pointIds[i])) return false;
+            loaded.points[int(fragment.pointIds[i])] = part.points[i];
+        }
+        for (int i = 0; i < part.lines.size(); ++i) {
+            if (!claim(1, fragment.lineIds[i])) return false;
+            const auto &line = part.lines[i];
+            const int a = line.a >= 0 ? int(fragment.pointIds[line.a]) : -1;
+            const int b = line.b >= 0 ? int(fragment.pointIds[line.b]) : -1;
+            loaded.lines[int(fragment.lineIds[i])] = Scene::Line(a, b, line.label);
+        }
+        for (int i = 0; i < part.extendedLines.size(); ++i) {
+            if (!claim(2, fragment.extendedLineIds[i])) return false;
+            loaded.extendedLines[int(fragment.extendedLineIds[i])] = part.extendedLines[i];
+        }
+        for (int i = 0; i < part.circles.size(); ++i) {
+            if (!claim(3, fragment.circleIds[i])) return false;
+            loaded.circles[int(fragment.circleIds[i])] = part.circles[i];
+        }
+    }
+    for (const auto &kind : seen) {
+        if (kind.contains(false)) return false;
+    }
+    scene = std::move(loaded);
+    return true;
+}
+
+bool TilePager::open(const QString &path) {
+    auto next = std::make_unique<TiledScene>();
+    if (!next->open(path)) {
+        return false;
+    }
+    close();
+    source = std::move(next);
+    return true;
+}
+
+void TilePager::close() {
+    source.reset();
+    resident.clear();
+    used = 0;
+}
+
+bool TilePager::update(const QRectF &visible) {
+    if (!source) {
+        return false;
+    }
+    const QRectF view = visible.normalized();
+    const QRectF wanted = view.adjusted(-view.width(), -view.height(), view.width(), view.height());
+    ++clock;
+    bool changed = false;
+    QSet<int> needed;
+    const QVector<TiledScene::Tile> &tiles = source->tiles();
+    for (int i = 0; i < tiles.size(); ++i) {
+        if (!tiles[i].unbounded && !overlaps(tiles[i].bounds.normalized(), wanted)) continue;
+        needed.insert(i);
+        auto it = resident.find(i);
+        if (it != resident.end()) {
+            it->lastUse = clock;
+            continue;
+        }
+        Entry entry;
+        if (!source->readTile(i, entry.fragment)) continue;
+        entry.bytes = estimateBytes(entry.fragment);
+        entry.lastUse = clock;
+        used += entry.bytes;
+        resident.insert(i, entry);
+        changed = true;
+    }
+    if (used > budget) {
+        QVector<QPair<quint64, int>> cold;
+        for (auto it = resident.constBegin(); it != resident.constEnd(); ++it) {
+            if (!needed.contains(it.key())) cold.append({it->lastUse, it.key()});
+        }
+        std::sort(cold.begin(), cold.end());
+        for (const auto &tile : cold) {
+            if (used <= budget) break;
+            used -= resident.constFind(tile.second)->bytes;
+            resident.remove(tile.second);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void TilePager::residentScene(Scene &scene, Ids &ids) const {
+    Scene merged;
+    Ids mergedIds;
+    QList<int> order = resident.keys();
+    std::sort(order.begin(), order.end());
+    // Endpoint copies resolve to the one resident instance of their point.
+    QHash<quint32, int> pointSlot;
+    for (int t : order) {
+        const TiledScene::Fragment &fragment = resident.constFind(t)->fragment;
+        for (int i = 0; i < fragment.scene.points.size(); ++i) {
+            const quint32 id = fragment.pointIds[i];
+            if (pointSlot.contains(id)) continue;
+            pointSlot.insert(id, merged.points.size());
+            merged.points.append(fragment.scene.points[i]);
+            mergedIds.points.append(id);
+        }
+    }
+    for (int t : order) {
+        const TiledScene::Fragment &fragment = resident.constFind(t)->fragment;
+        for (int i = 0; i < fragment.scene.lines.size(); ++i) {
+            const auto &line = fragment.scene.lines[i];
+            const int a = line.a >= 0 ? pointSlot.value(fragment.pointIds[line.a]) : -1;
+            const int b = line.b >= 0 ? pointSlot.value(fragment.pointIds[line.b]) : -1;
+            merged.lines.append(Scene::Line(a, b, line.label));
+            mergedIds.lines.append(fragment.lineIds[i]);
+        }
+        merged.extendedLines += fragment.scene.extendedLines;
+        mergedIds.extendedLines += fragment.extendedLineIds;
+        merged.circles += fragment.scene.circles;
+        mergedIds.circles += fragment.circleIds;
+    }
+    scene = std::move(merged);
+    ids = std::move(mergedIds);
+}
+
+qint64 TilePager::estimateBytes(const TiledScene::Fragment &fragment) {
+    qint64 bytes = 0;
+    auto add = [&bytes](const auto &objects) {
+        using Object = typename std::decay_t<decltype(objects)>::value_type;
+        bytes += qint64(objects.size()) * qint64(sizeof(Object) + sizeof(quint32));
+        for (const auto &object : objects) bytes += qint64(object.label.size()) * qint64(sizeof(QChar));
+    };
+    add(fragment.scene.points);
+    add(fragment.scene.lines);
+    add(fragment.scene.extendedLines);
+    add(fragment.scene.circles);
+    return bytes;
+}
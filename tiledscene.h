@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QRectF>
+#include <QVector>
+#include <QtGlobal>
+#include <memory>
+
+#include "scene.h"
+
+class QIODevice;
+
+// Spatially chunked scene format for scenes too large to load at once.
+// Objects are grouped by a uniform grid over the scene, and each non-empty
+// cell becomes a tile: a small binary scene plus the scene-wide index of every
+// object in it. Lines belong to the tile of their first point and carry a copy
+// of any endpoint owned by another tile. Extended lines are unbounded and live
+// in one tile that is always resident. A tile index with each tile's bounds
+// ends the file, so a reader can pick tiles without touching the rest.
+//
+// Layout, every section starting on an 8-byte boundary:
+//   header    magic "VGTSCENE", u32 version, u32 tile count,
+//             u64 counts[points, lines, extended lines, circles]
+//   tiles     u32 owned points, u32 id counts[4], u32 padding,
+//             u32 ids[points, lines, extended lines, circles], binary scene
+//   index     per tile: f64 left, top, right, bottom, u64 offset, u64 size,
+//             u32 flags, u32 object count
+//   trailer   u64 index offset
+// The index trails the tiles so the file is written in one pass.
+class TiledScene {
+public:
+    static constexpr quint32 version = 1;
+
+    struct Tile {
+        QRectF bounds;
+        bool unbounded = false;
+        quint64 offset = 0;
+        quint64 size = 0;
+        quint32 objects = 0;
+    };
+
+    // One tile's objects. Lines index into scene.points; points from
+    // ownedPoints on are copies of endpoints owned by other tiles.
+    struct Fragment {
+        Scene scene;
+        QVector<quint32> pointIds;
+        QVector<quint32> lineIds;
+        QVector<quint32> extendedLineIds;
+        QVector<quint32> circleIds;
+        int ownedPoints = 0;
+    };
+
+    TiledScene() = default;
+    ~TiledScene();
+    TiledScene(const TiledScene &) = delete;
+    TiledScene &operator=(const TiledScene &) = delete;
+
+    static bool matches(const QByteArray &head);
+    static bool write(QIODevice &device, const Scene &scene);
+    // Reads every tile back into one scene with the original indices.
+    static bool read(QFile &file, Scene &scene);
+
+    // Maps the file and reads its tile index; tiles are read on demand.
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+    QString path() const { return file.fileName(); }
+    const QVector<Tile> &tiles() const { return index; }
+    int pointCount() const { return int(counts[0]); }
+    int objectCount() const { return int(counts[0] + counts[1] + counts[2] + counts[3]); }
+    bool readTile(int tile, Fragment &fragment) const;
+    bool readAll(Scene &scene) const;
+
+private:
+    QFile file;
+    uchar *base = nullptr;
+    quint64 size = 0;
+    quint64 counts[4] = {0, 0, 0, 0};
+    QVector<Tile> index;
+
+    bool parse();
+};
+
+// Keeps the tiles of a TiledScene that a view needs in memory. Tiles within
+// one view's width or height of the visible area are made resident, so
+// panning finds its neighbours already loaded; tiles outside that margin are
+// evicted least recently used first once the estimated memory of resident
+// tiles exceeds the budget. The unbounded tile never leaves.
+class TilePager {
+public:
+    // Scene-wide index of each object in the resident scene.
+    struct Ids {
+        QVector<quint32> points;
+        QVector<quint32> lines;
+        QVector<quint32> extendedLines;
+        QVector<quint32> circles;
+    };
+
+    // Leaves the current file paged in when path cannot be opened.
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return source != nullptr; }
+    const TiledScene &scene() const { return *source; }
+    void setBudget(qint64 bytes) { budget = bytes; }
+    qint64 residentBytes() const { return used; }
+    int residentTiles() const { return resident.size(); }
+
+    // Pages in the tiles around visible; true when the resident set changed.
+    bool update(const QRectF &visible);
+    // Merges resident tiles into one scene, sharing endpoints between tiles.
+    void residentScene(Scene &scene, Ids &ids) const;
+
+private:
+    struct Entry {
+        TiledScene::Fragment fragment;
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    std::unique_ptr<TiledScene> source;
+    QHash<int, Entry> resident;
+    qint64 budget = qint64(256) << 20;
+    qint64 used = 0;
+    quint64 clock = 0;
+
+    static qint64 estimateBytes(const TiledScene::Fragment &fragment);
+};
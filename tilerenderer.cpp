@@ -0,0 +1,77 @@
+#include "tilerenderer.h"
+
+#include <QPainter>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+struct Tile {
+    QRect device;
+    QImage image;
+};
+
+QRectF logicalRect(const QRect &device, qreal dpr) {
+    return QRectF(device.x() / dpr, device.y() / dpr, device.width() / dpr, device.height() / dpr);
+}
+}  // namespace
+
+TileRenderer::TileRenderer(int tileSize)
+    : tilePixels(std::max(16, tileSize)) {
+}
+
+void TileRenderer::render(QImage &target, const DrawFunction &draw, const QRegion &region) const {
+    if (target.isNull()) {
+        return;
+    }
+    if (target.format() != QImage::Format_ARGB32_Premultiplied) {
+        target = target.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+    const qreal dpr = target.devicePixelRatio();
+
+    // Tiles are laid out on whole device pixels so neighbours never overlap.
+    QVector<Tile> tiles;
+    for (int y = 0; y < target.height(); y += tilePixels) {
+        for (int x = 0; x < target.width(); x += tilePixels) {
+            QRect device(x, y, std::min(tilePixels, target.width() - x), std::min(tilePixels, target.height() - y));
+            if (!region.isEmpty() && !region.intersects(logicalRect(device, dpr).toAlignedRect())) {
+                continue;
+            }
+            tiles.append(Tile{device, QImage()});
+        }
+    }
+    if (tiles.isEmpty()) {
+        return;
+    }
+
+    QtConcurrent::blockingMap(tiles, [&](Tile &tile) {
+        tile.image = QImage(tile.device.size(), QImage::Format_ARGB32_Premultiplied);
+        tile.image.setDevicePixelRatio(dpr);
+        tile.image.fill(Qt::transparent);
+        const QRectF logical = logicalRect(tile.device, dpr);
+        QPainter painter(&tile.image);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.translate(-logical.topLeft());
+        draw(painter, logical);
+    });
+
+    // Composite by plain row copies; tiles own disjoint pixels of the target.
+    for (const auto &tile : tiles) {
+        const size_t bytes = size_t(tile.device.width()) * 4;
+        for (int row = 0; row < tile.device.height(); ++row) {
+            uchar *dst = target.scanLine(tile.device.y() + row) + size_t(tile.device.x()) * 4;
+            std::memcpy(dst, tile.image.constScanLine(row), bytes);
+        }
+    }
+}
+
+QImage TileRenderer::render(const QSize &size, qreal devicePixelRatio, const DrawFunction &draw) const {
+    const QSize deviceSize(int(std::ceil(size.width() * devicePixelRatio)), int(std::ceil(size.height() * devicePixelRatio)));
+    QImage image(deviceSize, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(devicePixelRatio);
+    image.fill(Qt::transparent);
+    render(image, draw);
+    return image;
+}
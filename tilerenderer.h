@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QImage>
+#include <QRectF>
+#include <QRegion>
+#include <QSize>
+#include <functional>
+
+class QPainter;
+
+// Renders into a QImage by splitting it into square tiles that are painted
+// concurrently on the global thread pool, each with its own QPainter, and then
+// copied into the target. The draw callback receives a painter already
+// translated to logical target coordinates plus the tile's logical rectangle,
+// and must only read shared state.
+class TileRenderer {
+public:
+    using DrawFunction = std::function<void(QPainter &painter, const QRectF &tileRect)>;
+
+    explicit TileRenderer(int tileSize = 256);
+
+    int tileSize() const { return tilePixels; }
+    // Re-renders the tiles of target intersecting region (logical coordinates),
+    // or every tile when region is empty. Untouched tiles keep their pixels.
+    void render(QImage &target, const DrawFunction &draw, const QRegion &region = QRegion()) const;
+    QImage render(const QSize &size, qreal devicePixelRatio, const DrawFunction &draw) const;
+
+private:
+    int tilePixels;
+};
@@ -0,0 +1,65 @@
+#include "viewport.h"
+
+#include <algorithm>
+
+namespace {
+const double kPadding = 16.0;
+const double kHomeSpan = 10.0;  // -5 to 5 on each axis
+const double kMinZoom = 1e-4;
+const double kMaxZoom = 1e6;
+}  // namespace
+
+Viewport::Viewport() {
+    recompute();
+}
+
+void Viewport::setWidgetSize(const QSizeF &newSize) {
+    if (newSize == size) {
+        return;
+    }
+    size = newSize;
+    recompute();
+}
+
+void Viewport::panBy(const QPointF &screenDelta) {
+    if (screenDelta.isNull()) {
+        return;
+    }
+    worldCenter -= QPointF(screenDelta.x() / pixelsPerUnit, -screenDelta.y() / pixelsPerUnit);
+    recompute();
+}
+
+void Viewport::zoomAt(const QPointF &screenPos, double factor) {
+    const double newZoom = std::clamp(zoomFactor * factor, kMinZoom, kMaxZoom);
+    if (newZoom == zoomFactor) {
+        return;
+    }
+    // Keep the world point under the cursor fixed on screen.
+    const QPointF anchor = mapToWorld(screenPos);
+    zoomFactor = newZoom;
+    recompute();
+    const QPointF moved = mapToScreen(anchor);
+    worldCenter += QPointF((moved.x() - screenPos.x()) / pixelsPerUnit, -(moved.y() - screenPos.y()) / pixelsPerUnit);
+    recompute();
+}
+
+void Viewport::reset() {
+    worldCenter = QPointF();
+    zoomFactor = 1.0;
+    recompute();
+}
+
+QRectF Viewport::visibleWorldRect() const {
+    return toWorld.mapRect(QRectF(QPointF(0, 0), size));
+}
+
+void Viewport::recompute() {
+    const double w = std::max(1.0, size.width() - 2 * kPadding);
+    const double h = std::max(1.0, size.height() - 2 * kPadding);
+    pixelsPerUnit = std::min(w, h) / kHomeSpan * zoomFactor;
+    const double ox = size.width() / 2.0 - worldCenter.x() * pixelsPerUnit;
+    const double oy = size.height() / 2.0 + worldCenter.y() * pixelsPerUnit;
+    toScreen = QTransform(pixelsPerUnit, 0.0, 0.0, -pixelsPerUnit, ox, oy);
+    toWorld = toScreen.inverted();
+    ++rev;
+}
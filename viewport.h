@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QPointF>
+#include <QRectF>
+#include <QSizeF>
+#include <QTransform>
+
+// Maps world coordinates (y up) to widget pixels (y down). At zoom 1 the
+// [-5,5] box fits the widget with a small padding; pan moves the world point
+// shown at the widget centre. The transform and its inverse are cached and
+// only recomputed when size, pan or zoom change.
+class Viewport {
+public:
+    Viewport();
+
+    void setWidgetSize(const QSizeF &size);
+    QSizeF widgetSize() const { return size; }
+    void panBy(const QPointF &screenDelta);
+    void zoomAt(const QPointF &screenPos, double factor);
+    void reset();
+
+    double zoom() const { return zoomFactor; }
+    double scale() const { return pixelsPerUnit; }
+    QPointF center() const { return worldCenter; }
+    const QTransform &worldToScreen() const { return toScreen; }
+    const QTransform &screenToWorld() const { return toWorld; }
+    QPointF mapToScreen(const QPointF &world) const { return toScreen.map(world); }
+    QPointF mapToWorld(const QPointF &screen) const { return toWorld.map(screen); }
+    QRectF visibleWorldRect() const;
+    quint64 revision() const { return rev; }
+
+private:
+    QSizeF size;
+    QPointF worldCenter;
+    double zoomFactor = 1.0;
+    double pixelsPerUnit = 1.0;
+    QTransform toScreen;
+    QTransform toWorld;
+    quint64 rev = 0;
+
+    void recompute();
+};